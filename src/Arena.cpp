@@ -0,0 +1,52 @@
+#include "Arena.h"
+#include <stdlib.h>
+
+Arena::Arena()
+    : mBlocks(0), mPos(0), mEnd(0), mUsed(0), mFreed(0), mAllocated(0),
+      mNextBlockSize(MinBlockSize), mBlockCount(0)
+{
+}
+
+Arena::~Arena()
+{
+    while (mBlocks) {
+        Block *next = mBlocks->next;
+        ::free(mBlocks);
+        mBlocks = next;
+    }
+}
+
+void *Arena::allocate(size_t size)
+{
+    size = (size + 7) & ~static_cast<size_t>(7);
+    mUsed += size;
+    if (size <= static_cast<size_t>(mEnd - mPos)) {
+        void *ret = mPos;
+        mPos += size;
+        return ret;
+    }
+
+    const size_t header = (sizeof(Block) + 7) & ~static_cast<size_t>(7);
+    // big ones get a block of their own so the rest of the current block
+    // isn't thrown away
+    const bool own = size > MaxBlockSize / 4;
+    size_t blockSize = header + size;
+    if (!own && blockSize < mNextBlockSize)
+        blockSize = mNextBlockSize;
+    Block *block = static_cast<Block*>(::malloc(blockSize));
+    if (!block)
+        throw std::bad_alloc();
+    block->next = mBlocks;
+    mBlocks = block;
+    mAllocated += blockSize;
+    ++mBlockCount;
+
+    char *ret = reinterpret_cast<char*>(block) + header;
+    if (!own) {
+        mPos = ret + size;
+        mEnd = reinterpret_cast<char*>(block) + blockSize;
+        if (mNextBlockSize < MaxBlockSize)
+            mNextBlockSize *= 2;
+    }
+    return ret;
+}
@@ -0,0 +1,107 @@
+#ifndef Arena_h
+#define Arena_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+/*
+  Bump allocator for memory that's all freed together. Allocations come out
+  of blocks that double in size up to MaxBlockSize and nothing is returned
+  until the arena is destroyed, which frees the blocks. Not thread safe, an
+  arena belongs to one IndexData and is only used by whoever fills it in.
+*/
+
+class Arena
+{
+public:
+    enum {
+        MinBlockSize = 64 * 1024,
+        MaxBlockSize = 4 * 1024 * 1024
+    };
+
+    Arena();
+    ~Arena();
+
+    void *allocate(size_t size);
+    void deallocate(void *, size_t size) { mFreed += size; }
+
+    size_t used() const { return mUsed - mFreed; }
+    size_t allocated() const { return mAllocated; }
+    int blockCount() const { return mBlockCount; }
+private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    struct Block {
+        Block *next;
+    };
+    Block *mBlocks;
+    char *mPos, *mEnd;
+    size_t mUsed, mFreed, mAllocated, mNextBlockSize;
+    int mBlockCount;
+};
+
+// Allocator for std containers that allocates from arena. One made without
+// an arena uses the heap, so containers that are default constructed, like
+// the values of a map, still work.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template <typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    ArenaAllocator(Arena *arena = 0)
+        : mArena(arena)
+    {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other)
+        : mArena(other.arena())
+    {}
+
+    Arena *arena() const { return mArena; }
+
+    pointer address(reference t) const { return &t; }
+    const_pointer address(const_reference t) const { return &t; }
+    size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+    pointer allocate(size_type count, const void * = 0)
+    {
+        const size_t size = count * sizeof(T);
+        return static_cast<pointer>(mArena ? mArena->allocate(size) : ::operator new(size));
+    }
+    void deallocate(pointer p, size_type count)
+    {
+        if (mArena) {
+            mArena->deallocate(p, count * sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    void construct(pointer p, const T &t) { new (p) T(t); }
+    void destroy(pointer p) { p->~T(); }
+private:
+    Arena *mArena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &l, const ArenaAllocator<U> &r)
+{
+    return l.arena() == r.arena();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &l, const ArenaAllocator<U> &r)
+{
+    return l.arena() != r.arena();
+}
+
+#endif
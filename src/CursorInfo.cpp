@@ -1,5 +1,6 @@
 #include "CursorInfo.h"
 #include "RTagsClang.h"
+#include "SymbolStore.h"
 
 ByteArray CursorInfo::toString(unsigned cursorInfoFlags, unsigned keyFlags) const
 {
@@ -10,7 +11,7 @@ ByteArray CursorInfo::toString(unsigned cursorInfoFlags, unsigned keyFlags) cons
                                             "%s" // range
                                             "%s" // enumValue
                                             "%s", // definition
-                                            symbolName.constData(),
+                                            symbolName().constData(),
                                             RTags::eatString(clang_getCursorKindSpelling(kind)).constData(),
                                             RTags::eatString(clang_getTypeKindSpelling(type)).constData(),
                                             symbolLength,
@@ -20,18 +21,12 @@ ByteArray CursorInfo::toString(unsigned cursorInfoFlags, unsigned keyFlags) cons
 
     if (!targets.isEmpty() && !(cursorInfoFlags & IgnoreTargets)) {
         ret.append("Targets:\n");
-        for (Set<Location>::const_iterator tit = targets.begin(); tit != targets.end(); ++tit) {
-            const Location &l = *tit;
-            ret.append(ByteArray::format<128>("    %s\n", l.key(keyFlags).constData()));
-        }
+        Location::appendKeys(targets.toList(), keyFlags, ret, "    ");
     }
 
     if (!references.isEmpty() && !(cursorInfoFlags & IgnoreReferences)) {
         ret.append("References:\n");
-        for (Set<Location>::const_iterator rit = references.begin(); rit != references.end(); ++rit) {
-            const Location &l = *rit;
-            ret.append(ByteArray::format<128>("    %s\n", l.key(keyFlags).constData()));
-        }
+        Location::appendKeys(references.toList(), keyFlags, ret, "    ");
     }
     return ret;
 }
@@ -55,7 +50,8 @@ int CursorInfo::cursorRank(CXCursorKind kind)
     }
 }
 
-CursorInfo CursorInfo::bestTarget(const SymbolMap &map, Location *loc) const
+template <typename Symbols>
+CursorInfo CursorInfo::bestTarget(const Symbols &map, Location *loc) const
 {
     const SymbolMap targets = targetInfos(map);
 
@@ -77,11 +73,12 @@ CursorInfo CursorInfo::bestTarget(const SymbolMap &map, Location *loc) const
     return CursorInfo();
 }
 
-SymbolMap CursorInfo::targetInfos(const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::targetInfos(const Symbols &map) const
 {
     SymbolMap ret;
-    for (Set<Location>::const_iterator it = targets.begin(); it != targets.end(); ++it) {
-        SymbolMap::const_iterator found = RTags::findCursorInfo(map, *it);
+    for (LocationSet::const_iterator it = targets.begin(); it != targets.end(); ++it) {
+        const typename Symbols::const_iterator found = RTags::findCursorInfo(map, *it);
         if (found != map.end()) {
             ret[*it] = found->second;
         } else {
@@ -93,11 +90,12 @@ SymbolMap CursorInfo::targetInfos(const SymbolMap &map) const
     return ret;
 }
 
-SymbolMap CursorInfo::referenceInfos(const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::referenceInfos(const Symbols &map) const
 {
     SymbolMap ret;
-    for (Set<Location>::const_iterator it = references.begin(); it != references.end(); ++it) {
-        SymbolMap::const_iterator found = RTags::findCursorInfo(map, *it);
+    for (LocationSet::const_iterator it = references.begin(); it != references.end(); ++it) {
+        const typename Symbols::const_iterator found = RTags::findCursorInfo(map, *it);
         if (found != map.end()) {
             ret[*it] = found->second;
         }
@@ -105,13 +103,14 @@ SymbolMap CursorInfo::referenceInfos(const SymbolMap &map) const
     return ret;
 }
 
-SymbolMap CursorInfo::callers(const Location &loc, const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::callers(const Location &loc, const Symbols &map) const
 {
     SymbolMap ret;
     const SymbolMap cursors = virtuals(loc, map);
     for (SymbolMap::const_iterator c = cursors.begin(); c != cursors.end(); ++c) {
-        for (Set<Location>::const_iterator it = c->second.references.begin(); it != c->second.references.end(); ++it) {
-            const SymbolMap::const_iterator found = RTags::findCursorInfo(map, *it);
+        for (LocationSet::const_iterator it = c->second.references.begin(); it != c->second.references.end(); ++it) {
+            const typename Symbols::const_iterator found = RTags::findCursorInfo(map, *it);
             if (found == map.end())
                 continue;
             if (RTags::isReference(found->second.kind)) { // is this always right?
@@ -130,12 +129,12 @@ enum Mode {
     NormalRefs
 };
 
-static inline void allImpl(const SymbolMap &map, const Location &loc, const CursorInfo &info, SymbolMap &out, Mode mode, CXCursorKind kind)
+template <typename Symbols>
+static inline void allImpl(const Symbols &map, const Location &loc, const CursorInfo &info, SymbolMap &out, Mode mode, CXCursorKind kind)
 {
     if (out.contains(loc))
         return;
     out[loc] = info;
-    typedef SymbolMap (CursorInfo::*Function)(const SymbolMap &map) const;
     const SymbolMap targets = info.targetInfos(map);
     for (SymbolMap::const_iterator t = targets.begin(); t != targets.end(); ++t) {
         bool ok = false;
@@ -178,7 +177,8 @@ static inline void allImpl(const SymbolMap &map, const Location &loc, const Curs
     }
 }
 
-SymbolMap CursorInfo::allReferences(const Location &loc, const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::allReferences(const Location &loc, const Symbols &map) const
 {
     SymbolMap ret;
     Mode mode = NormalRefs;
@@ -199,7 +199,8 @@ SymbolMap CursorInfo::allReferences(const Location &loc, const SymbolMap &map) c
     return ret;
 }
 
-SymbolMap CursorInfo::virtuals(const Location &loc, const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::virtuals(const Location &loc, const Symbols &map) const
 {
     SymbolMap ret;
     ret[loc] = *this;
@@ -211,7 +212,8 @@ SymbolMap CursorInfo::virtuals(const Location &loc, const SymbolMap &map) const
     return ret;
 }
 
-SymbolMap CursorInfo::declarationAndDefinition(const Location &loc, const SymbolMap &map) const
+template <typename Symbols>
+SymbolMap CursorInfo::declarationAndDefinition(const Location &loc, const Symbols &map) const
 {
     SymbolMap cursors;
     cursors[loc] = *this;
@@ -223,3 +225,14 @@ SymbolMap CursorInfo::declarationAndDefinition(const Location &loc, const Symbol
         cursors[l] = t;
     return cursors;
 }
+
+template CursorInfo CursorInfo::bestTarget(const SymbolStore &, Location *) const;
+template SymbolMap CursorInfo::targetInfos(const SymbolStore &) const;
+template SymbolMap CursorInfo::referenceInfos(const SymbolStore &) const;
+template SymbolMap CursorInfo::callers(const Location &, const SymbolStore &) const;
+template SymbolMap CursorInfo::allReferences(const Location &, const SymbolStore &) const;
+template SymbolMap CursorInfo::virtuals(const Location &, const SymbolStore &) const;
+template SymbolMap CursorInfo::declarationAndDefinition(const Location &, const SymbolStore &) const;
+// IndexerJob resolves targets in its own SymbolMap
+template CursorInfo CursorInfo::bestTarget(const SymbolMap &, Location *) const;
+template CursorInfo CursorInfo::bestTarget(const ArenaSymbolMap &, Location *) const;
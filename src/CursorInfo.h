@@ -1,21 +1,49 @@
 #ifndef CursorInfo_h
 #define CursorInfo_h
 
+#include "Arena.h"
 #include "ByteArray.h"
 #include "Location.h"
 #include "Path.h"
 #include "Log.h"
 #include "List.h"
+#include "LocationSet.h"
+#include "StringPool.h"
 #include <clang-c/Index.h>
 
 class CursorInfo;
 typedef Map<Location, CursorInfo> SymbolMap;
+typedef Map<Location, CursorInfo, ArenaAllocator<std::pair<const Location, CursorInfo> > > ArenaSymbolMap;
 class CursorInfo
 {
 public:
     CursorInfo()
-        : symbolLength(0), kind(CXCursor_FirstInvalid), type(CXType_Invalid), enumValue(0), start(-1), end(-1)
+        : symbolNameId(0), symbolLength(0), kind(CXCursor_FirstInvalid), type(CXType_Invalid), start(-1), end(-1), enumValue(0)
     {}
+    CursorInfo(const CursorInfo &other)
+        : symbolNameId(other.symbolNameId), symbolLength(other.symbolLength), kind(other.kind), type(other.type),
+          start(other.start), end(other.end), enumValue(other.enumValue), targets(other.targets),
+          references(other.references)
+    {
+        StringPool::ref(symbolNameId);
+    }
+    ~CursorInfo()
+    {
+        StringPool::deref(symbolNameId);
+    }
+    CursorInfo &operator=(const CursorInfo &other)
+    {
+        setSymbolNameId(other.symbolNameId);
+        symbolLength = other.symbolLength;
+        kind = other.kind;
+        type = other.type;
+        start = other.start;
+        end = other.end;
+        enumValue = other.enumValue;
+        targets = other.targets;
+        references = other.references;
+        return *this;
+    }
 
     static int cursorRank(CXCursorKind kind);
     void clear()
@@ -27,26 +55,12 @@ public:
         enumValue = 0;
         targets.clear();
         references.clear();
-        symbolName.clear();
+        setSymbolNameId(0);
     }
 
     bool dirty(const Set<uint32_t> &dirty)
     {
-        bool changed = false;
-        Set<Location> *locations[] = { &targets, &references };
-        for (int i=0; i<2; ++i) {
-            Set<Location> &l = *locations[i];
-            Set<Location>::iterator it = l.begin();
-            while (it != l.end()) {
-                if (dirty.contains(it->fileId())) {
-                    changed = true;
-                    l.erase(it++);
-                } else {
-                    ++it;
-                }
-            }
-        }
-        return changed;
+        return (targets.removeFiles(dirty) + references.removeFiles(dirty)) > 0;
     }
 
     bool isValid() const
@@ -59,13 +73,14 @@ public:
         return isEmpty();
     }
 
-    CursorInfo bestTarget(const SymbolMap &map, Location *loc = 0) const;
-    SymbolMap targetInfos(const SymbolMap &map) const;
-    SymbolMap referenceInfos(const SymbolMap &map) const;
-    SymbolMap callers(const Location &loc, const SymbolMap &map) const;
-    SymbolMap allReferences(const Location &loc, const SymbolMap &map) const;
-    SymbolMap virtuals(const Location &loc, const SymbolMap &map) const;
-    SymbolMap declarationAndDefinition(const Location &loc, const SymbolMap &map) const;
+    // Symbols is either a SymbolStore or a SymbolMap, see CursorInfo.cpp
+    template <typename Symbols> CursorInfo bestTarget(const Symbols &map, Location *loc = 0) const;
+    template <typename Symbols> SymbolMap targetInfos(const Symbols &map) const;
+    template <typename Symbols> SymbolMap referenceInfos(const Symbols &map) const;
+    template <typename Symbols> SymbolMap callers(const Location &loc, const Symbols &map) const;
+    template <typename Symbols> SymbolMap allReferences(const Location &loc, const Symbols &map) const;
+    template <typename Symbols> SymbolMap virtuals(const Location &loc, const Symbols &map) const;
+    template <typename Symbols> SymbolMap declarationAndDefinition(const Location &loc, const Symbols &map) const;
 
     bool isClass() const
     {
@@ -90,6 +105,18 @@ public:
         return !symbolLength && targets.isEmpty() && references.isEmpty() && start == -1 && end == -1;
     }
 
+    // Becomes other, other's targets and references are moved rather than
+    // copied and it's left without any
+    void take(CursorInfo &other)
+    {
+        LocationSet otherTargets, otherReferences;
+        otherTargets.swap(other.targets);
+        otherReferences.swap(other.references);
+        *this = other;
+        targets.swap(otherTargets);
+        references.swap(otherReferences);
+    }
+
     bool unite(const CursorInfo &other)
     {
         bool changed = false;
@@ -114,7 +141,7 @@ public:
             kind = other.kind;
             enumValue = other.enumValue;
             type = other.type;
-            symbolName = other.symbolName;
+            setSymbolNameId(other.symbolNameId);
             changed = true;
         }
         const int oldSize = references.size();
@@ -137,22 +164,41 @@ public:
         IgnoreReferences = 0x2
     };
     ByteArray toString(unsigned cursorInfoFlags = 0, unsigned keyFlags = 0) const;
+
+    // this is fully qualified Foobar::Barfoo::foo
+    const ByteArray &symbolName() const { return StringPool::string(symbolNameId); }
+    void setSymbolName(const ByteArray &name)
+    {
+        const uint32_t id = StringPool::insert(name);
+        StringPool::deref(symbolNameId);
+        symbolNameId = id;
+    }
+    void setSymbolNameId(uint32_t id)
+    {
+        StringPool::ref(id);
+        StringPool::deref(symbolNameId);
+        symbolNameId = id;
+    }
+
+    // Bytes allocated outside of the object itself
+    int heapSize() const { return targets.heapSize() + references.heapSize(); }
+
+    uint32_t symbolNameId; // interned in StringPool, use setSymbolNameId() to change it
     uint16_t symbolLength; // this is just the symbol name length e.g. foo => 3
-    ByteArray symbolName; // this is fully qualified Foobar::Barfoo::foo
-    CXCursorKind kind;
-    CXTypeKind type;
+    CXCursorKind kind : 16;
+    CXTypeKind type : 16;
+    int start, end;
     union {
         bool definition;
         int64_t enumValue; // only used if type == CXCursor_EnumConstantDecl
     };
-    Set<Location> targets, references;
-    int start, end;
+    LocationSet targets, references;
 };
 
 
 template <> inline Serializer &operator<<(Serializer &s, const CursorInfo &t)
 {
-    s << t.symbolLength << t.symbolName << static_cast<int>(t.kind)
+    s << t.symbolLength << t.symbolName() << static_cast<int>(t.kind)
       << static_cast<int>(t.type) << t.enumValue << t.targets << t.references << t.start << t.end;
     return s;
 }
@@ -160,8 +206,10 @@ template <> inline Serializer &operator<<(Serializer &s, const CursorInfo &t)
 template <> inline Deserializer &operator>>(Deserializer &s, CursorInfo &t)
 {
     int kind, type;
-    s >> t.symbolLength >> t.symbolName >> kind >> type
+    ByteArray symbolName;
+    s >> t.symbolLength >> symbolName >> kind >> type
       >> t.enumValue >> t.targets >> t.references >> t.start >> t.end;
+    t.setSymbolName(symbolName);
     t.kind = static_cast<CXCursorKind>(kind);
     t.type = static_cast<CXTypeKind>(type);
     return s;
@@ -10,41 +10,36 @@ CursorInfoJob::CursorInfoJob(const Location &loc, const QueryMessage &query, con
 
 void CursorInfoJob::execute()
 {
-    Scope<const SymbolMap &> scope = project()->lockSymbolsForRead();
+    Scope<const SymbolStore&> scope = project()->lockSymbolsForRead();
     if (scope.isNull())
         return;
-    const SymbolMap &map = scope.data();
+    const SymbolStore &map = scope.data();
     if (map.isEmpty())
         return;
-    SymbolMap::const_iterator it = RTags::findCursorInfo(map, location);
+    SymbolStore::const_iterator it = RTags::findCursorInfo(map, location);
     unsigned ciFlags = 0;
     if (queryFlags() & QueryMessage::CursorInfoIgnoreTargets)
         ciFlags |= CursorInfo::IgnoreTargets;
     if (queryFlags() & QueryMessage::CursorInfoIgnoreReferences)
         ciFlags |= CursorInfo::IgnoreReferences;
+    uint32_t end = location.offset();
     if (it != map.end()) {
         write(it->first);
         write(it->second, ciFlags);
-    } else {
-        it = map.lower_bound(location);
-        if (it == map.end())
-            --it;
+        end = it->first.offset();
     }
     ciFlags |= CursorInfo::IgnoreTargets|CursorInfo::IgnoreReferences;
-    if (it != map.begin() && !(queryFlags() & QueryMessage::CursorInfoIgnoreParents)) {
-        const uint32_t fileId = location.fileId();
+    const SymbolStore::FileSymbols *symbols = map.symbols(location.fileId());
+    if (symbols && !(queryFlags() & QueryMessage::CursorInfoIgnoreParents)) {
         const int offset = location.offset();
-        while (true) {
-            --it;
-            if (it->first.fileId() != fileId)
-                break;
-            if (it->second.isDefinition() && RTags::isContainer(it->second.kind) && offset >= it->second.start && offset <= it->second.end) {
+        int idx = SymbolStore::lowerBound(*symbols, end);
+        while (idx > 0) {
+            const SymbolStore::Entry &entry = symbols->at(--idx);
+            if (entry.second.isDefinition() && RTags::isContainer(entry.second.kind) && offset >= entry.second.start && offset <= entry.second.end) {
                 write("Container:");
-                write(it->first);
-                write(it->second, ciFlags);
+                write(entry.first);
+                write(entry.second, ciFlags);
             }
-            if (it == map.begin())
-                break;
         }
     }
 }
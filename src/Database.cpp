@@ -0,0 +1,437 @@
+#include "Database.h"
+#include "Server.h"
+#include <algorithm>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+Database::Database()
+    : mHeader(0)
+{
+}
+
+bool Database::open(const Path &path)
+{
+    close();
+    if (!mFile.open(path))
+        return false;
+
+    const Header *header = at<Header>(0);
+    const uint64_t size = mFile.size();
+    if (size < sizeof(Header)) {
+        error("%s is too small to be a database", path.constData());
+    } else if (header->version != Server::DatabaseVersion) {
+        error("Wrong database version. Expected %d, got %d for %s.",
+              Server::DatabaseVersion, header->version, path.constData());
+    } else if (header->size != size || !validate(header)) {
+        error("%s seems to be corrupted", path.constData());
+    } else {
+        mHeader = header;
+        return true;
+    }
+    mFile.close();
+    return false;
+}
+
+// Written so that garbage offsets and counts can't overflow
+static inline bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t limit)
+{
+    return offset <= limit && count <= (limit - offset) / size;
+}
+
+// Checks every offset and count in the file so a truncated or corrupted
+// database is rejected and reindexed instead of read out of bounds
+bool Database::validate(const Header *header) const
+{
+    const uint64_t size = mFile.size();
+    if (!fits(header->symbolTable, header->symbolCount, sizeof(SymbolEntry), size)
+        || !fits(header->symbolNameTable, header->symbolNameCount, sizeof(NameEntry), size)
+        || !fits(header->usrTable, header->usrCount, sizeof(NameEntry), size)
+        || !fits(header->stringPool, header->stringPoolSize, 1, size)
+        || !fits(header->projectData, header->projectDataSize, 1, size)
+        || header->projectDataSize > INT_MAX
+        || (header->symbolCount | header->symbolNameCount | header->usrCount) > INT_MAX
+        || (header->symbolTable | header->symbolNameTable | header->usrTable) % sizeof(uint64_t)) {
+        return false;
+    }
+
+    const SymbolEntry *symbols = at<SymbolEntry>(header->symbolTable);
+    for (uint32_t i=0; i<header->symbolCount; ++i) {
+        const uint64_t offset = symbols[i].record;
+        if (offset % sizeof(uint64_t) || !fits(offset, 1, sizeof(CursorRecord), size))
+            return false;
+        const CursorRecord *record = at<CursorRecord>(offset);
+        if (!fits(offset + sizeof(CursorRecord), uint64_t(record->targetCount) + record->referenceCount,
+                  sizeof(uint64_t), size)
+            || !fits(record->symbolName, record->symbolNameLength, 1, header->stringPoolSize)) {
+            return false;
+        }
+    }
+
+    const struct {
+        uint64_t table;
+        uint32_t count;
+    } tables[] = {
+        { header->symbolNameTable, header->symbolNameCount },
+        { header->usrTable, header->usrCount }
+    };
+    for (unsigned t=0; t<sizeof(tables) / sizeof(tables[0]); ++t) {
+        const NameEntry *entries = at<NameEntry>(tables[t].table);
+        for (uint32_t i=0; i<tables[t].count; ++i) {
+            const NameEntry &entry = entries[i];
+            if (entry.locations % sizeof(uint64_t)
+                || !fits(entry.locations, entry.locationCount, sizeof(uint64_t), size)
+                || !fits(entry.name, entry.nameLength, 1, header->stringPoolSize)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Database::close()
+{
+    mHeader = 0;
+    mFile.close();
+}
+
+int Database::symbolCount() const
+{
+    assert(mHeader);
+    return mHeader->symbolCount;
+}
+
+Location Database::location(int idx) const
+{
+    assert(mHeader);
+    assert(idx >= 0 && idx < symbolCount());
+    return Location(at<SymbolEntry>(mHeader->symbolTable)[idx].location);
+}
+
+void Database::readLocations(uint64_t offset, int count, Set<Location> &locations) const
+{
+    const uint64_t *data = at<uint64_t>(offset);
+    for (int i=0; i<count; ++i) {
+        locations.insert(locations.end(), Location(data[i]));
+    }
+}
+
+void Database::readLocations(uint64_t offset, int count, LocationSet &locations) const
+{
+    const uint64_t *data = at<uint64_t>(offset);
+    for (int i=0; i<count; ++i) {
+        locations.insert(Location(data[i]));
+    }
+}
+
+CursorInfo Database::cursorInfo(int idx) const
+{
+    assert(mHeader);
+    assert(idx >= 0 && idx < symbolCount());
+    const uint64_t offset = at<SymbolEntry>(mHeader->symbolTable)[idx].record;
+    const CursorRecord *record = at<CursorRecord>(offset);
+    CursorInfo ret;
+    ret.symbolLength = record->symbolLength;
+    if (record->symbolNameLength)
+        ret.setSymbolName(ByteArray(at<char>(mHeader->stringPool + record->symbolName), record->symbolNameLength));
+    ret.kind = static_cast<CXCursorKind>(record->kind);
+    ret.type = static_cast<CXTypeKind>(record->type);
+    ret.enumValue = record->enumValue;
+    ret.start = record->start;
+    ret.end = record->end;
+    const uint64_t locations = offset + sizeof(CursorRecord);
+    readLocations(locations, record->targetCount, ret.targets);
+    readLocations(locations + (record->targetCount * sizeof(uint64_t)), record->referenceCount, ret.references);
+    return ret;
+}
+
+const Database::NameEntry *Database::nameTable(Section section, int *count) const
+{
+    assert(mHeader);
+    switch (section) {
+    case SymbolNames:
+        *count = mHeader->symbolNameCount;
+        return at<NameEntry>(mHeader->symbolNameTable);
+    case Usr:
+        *count = mHeader->usrCount;
+        return at<NameEntry>(mHeader->usrTable);
+    default:
+        break;
+    }
+    assert(0 && "Invalid section for nameTable");
+    *count = 0;
+    return 0;
+}
+
+int Database::count(Section section) const
+{
+    if (section == Symbols)
+        return symbolCount();
+    int ret;
+    nameTable(section, &ret);
+    return ret;
+}
+
+ByteArray Database::name(Section section, int idx) const
+{
+    int count;
+    const NameEntry *entry = nameTable(section, &count) + idx;
+    assert(idx >= 0 && idx < count);
+    return ByteArray(at<char>(mHeader->stringPool + entry->name), entry->nameLength);
+}
+
+Set<Location> Database::locations(Section section, int idx) const
+{
+    int count;
+    const NameEntry *entry = nameTable(section, &count) + idx;
+    assert(idx >= 0 && idx < count);
+    Set<Location> ret;
+    readLocations(entry->locations, entry->locationCount, ret);
+    return ret;
+}
+
+int Database::find(Section section, const ByteArray &name) const
+{
+    int count;
+    const NameEntry *entries = nameTable(section, &count);
+    int lower = 0, upper = count;
+    int cmp = 1;
+    while (lower < upper) {
+        const int mid = lower + ((upper - lower) / 2);
+        const NameEntry &entry = entries[mid];
+        const int length = std::min<int>(entry.nameLength, name.size());
+        cmp = memcmp(at<char>(mHeader->stringPool + entry.name), name.constData(), length);
+        if (!cmp)
+            cmp = static_cast<int>(entry.nameLength) - name.size();
+        if (!cmp)
+            return mid;
+        if (cmp < 0) {
+            lower = mid + 1;
+        } else {
+            upper = mid;
+        }
+    }
+    return -1;
+}
+
+// Every cursor in the database, meant for shards where they're all in the
+// same file
+void Database::read(SymbolStore::FileSymbols &symbols) const
+{
+    const int count = symbolCount();
+    symbols.reserve(symbols.size() + count);
+    for (int i=0; i<count; ++i)
+        symbols.append(std::make_pair(location(i), cursorInfo(i)));
+}
+
+void Database::read(Section section, Map<InternedString, Set<Location> > &names) const
+{
+    int count;
+    const NameEntry *entries = nameTable(section, &count);
+    for (int i=0; i<count; ++i) {
+        const NameEntry &entry = entries[i];
+        const InternedString key(ByteArray(at<char>(mHeader->stringPool + entry.name), entry.nameLength));
+        Map<InternedString, Set<Location> >::iterator it = names.insert(names.end(), std::make_pair(key, Set<Location>()));
+        readLocations(entry.locations, entry.locationCount, it->second);
+    }
+}
+
+void Database::read(UsrIndex &usr) const
+{
+    int count;
+    const NameEntry *entries = nameTable(Usr, &count);
+    for (int i=0; i<count; ++i) {
+        const NameEntry &entry = entries[i];
+        const ByteArray key(at<char>(mHeader->stringPool + entry.name), entry.nameLength);
+        readLocations(entry.locations, entry.locationCount, usr.insert(key, UsrIndex::hash(key)));
+    }
+}
+
+const char *Database::projectData() const
+{
+    assert(mHeader);
+    return at<char>(mHeader->projectData);
+}
+
+int Database::projectDataSize() const
+{
+    assert(mHeader);
+    return mHeader->projectDataSize;
+}
+
+class DatabaseWriter
+{
+public:
+    DatabaseWriter(FILE *f)
+        : mFile(f), mOffset(0), mStringPoolSize(0), mError(false)
+    {}
+
+    uint64_t offset() const { return mOffset; }
+    bool hasError() const { return mError; }
+
+    template <typename T> void write(const T &t)
+    {
+        write(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+    void write(const char *data, int size)
+    {
+        if (size && fwrite(data, sizeof(char), size, mFile) != static_cast<size_t>(size))
+            mError = true;
+        mOffset += size;
+    }
+
+    template <typename Locations> void writeLocations(const Locations &locations)
+    {
+        for (typename Locations::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+            write(it->mData);
+        }
+    }
+
+    // string has to be in StringPool, the pool is what makes the string
+    // pointers unique
+    uint64_t addString(const ByteArray &string)
+    {
+        if (string.isEmpty())
+            return 0;
+        uint64_t &offset = mStrings[&string];
+        if (!offset) {
+            // offsets are stored off by one so 0 can mean "not added yet"
+            offset = mStringPoolSize + 1;
+            mStringPoolSize += string.size();
+            mStringOrder.append(&string);
+        }
+        return offset - 1;
+    }
+
+    static const ByteArray &name(const SymbolNameMap::value_type &entry) { return entry.first; }
+    static const ByteArray &name(const UsrIndex::Entry &entry) { return entry.usr; }
+    static const Set<Location> &locations(const SymbolNameMap::value_type &entry) { return entry.second; }
+    static const Set<Location> &locations(const UsrIndex::Entry &entry) { return entry.locations; }
+
+    template <typename Names> void writeNames(const Names &names)
+    {
+        uint64_t offset = mOffset + (names.size() * sizeof(Database::NameEntry));
+        for (typename Names::const_iterator it = names.begin(); it != names.end(); ++it) {
+            const ByteArray &n = name(*it);
+            const Set<Location> &l = locations(*it);
+            const Database::NameEntry entry = {
+                addString(n), offset,
+                static_cast<uint32_t>(n.size()), static_cast<uint32_t>(l.size())
+            };
+            write(entry);
+            offset += l.size() * sizeof(uint64_t);
+        }
+        for (typename Names::const_iterator it = names.begin(); it != names.end(); ++it) {
+            writeLocations(locations(*it));
+        }
+    }
+
+    uint64_t stringPoolSize() const { return mStringPoolSize; }
+    void writeStringPool()
+    {
+        for (int i=0; i<mStringOrder.size(); ++i) {
+            const ByteArray &string = *mStringOrder.at(i);
+            write(string.constData(), string.size());
+        }
+    }
+private:
+    FILE *mFile;
+    uint64_t mOffset, mStringPoolSize;
+    bool mError;
+    Map<const ByteArray*, uint64_t> mStrings;
+    List<const ByteArray*> mStringOrder;
+};
+
+template <typename Usrs>
+bool Database::writeFile(const Path &path, const SymbolStore &symbols, const SymbolNameMap &symbolNames,
+                         const Usrs &usr, const ByteArray &projectData)
+{
+    // Write to a temporary file and rename it into place so that a
+    // Database that still maps the old file stays valid.
+    const Path tmp = path + ".tmp";
+    FILE *f = fopen(tmp.constData(), "w");
+    if (!f) {
+        error("Can't open file %s", tmp.constData());
+        return false;
+    }
+
+    DatabaseWriter writer(f);
+    Header header;
+    memset(&header, 0, sizeof(header));
+    writer.write(header); // placeholder, rewritten below
+
+    header.version = Server::DatabaseVersion;
+    header.symbolCount = symbols.size();
+    header.symbolTable = writer.offset();
+    {
+        uint64_t record = header.symbolTable + (symbols.size() * sizeof(SymbolEntry));
+        for (SymbolStore::const_iterator it = symbols.begin(); it != symbols.end(); ++it) {
+            const SymbolEntry entry = { it->first.mData, record };
+            writer.write(entry);
+            record += sizeof(CursorRecord) + ((it->second.targets.size() + it->second.references.size()) * sizeof(uint64_t));
+        }
+    }
+    for (SymbolStore::const_iterator it = symbols.begin(); it != symbols.end(); ++it) {
+        const CursorInfo &info = it->second;
+        CursorRecord record;
+        memset(&record, 0, sizeof(record));
+        record.enumValue = info.enumValue;
+        const ByteArray &symbolName = info.symbolName();
+        record.symbolName = writer.addString(symbolName);
+        record.symbolNameLength = symbolName.size();
+        record.kind = info.kind;
+        record.type = info.type;
+        record.start = info.start;
+        record.end = info.end;
+        record.targetCount = info.targets.size();
+        record.referenceCount = info.references.size();
+        record.symbolLength = info.symbolLength;
+        writer.write(record);
+        writer.writeLocations(info.targets);
+        writer.writeLocations(info.references);
+    }
+
+    header.symbolNameCount = symbolNames.size();
+    header.symbolNameTable = writer.offset();
+    writer.writeNames(symbolNames);
+
+    header.usrCount = usr.size();
+    header.usrTable = writer.offset();
+    writer.writeNames(usr);
+
+    header.stringPool = writer.offset();
+    header.stringPoolSize = writer.stringPoolSize();
+    writer.writeStringPool();
+
+    header.projectData = writer.offset();
+    header.projectDataSize = projectData.size();
+    writer.write(projectData.constData(), projectData.size());
+
+    // The data has to be on disk before the rename replaces the old file,
+    // otherwise a crash could leave a valid looking but truncated database
+    header.size = writer.offset();
+    bool ok = !fseek(f, 0, SEEK_SET);
+    writer.write(header);
+    ok = ok && !writer.hasError() && !fflush(f) && !fsync(fileno(f));
+    if (fclose(f))
+        ok = false;
+    if (!ok || rename(tmp.constData(), path.constData())) {
+        error("Failed to write %s", path.constData());
+        Path::rm(tmp);
+        return false;
+    }
+    return true;
+}
+
+bool Database::write(const Path &path, const SymbolStore &symbols,
+                     const SymbolNameMap &symbolNames, const UsrIndex &usr,
+                     const ByteArray &projectData)
+{
+    return writeFile(path, symbols, symbolNames, usr, projectData);
+}
+
+bool Database::writeNameIndex(const Path &path, const SymbolNameMap &symbolNames,
+                              const SymbolNameMap &usrs, const ByteArray &projectData)
+{
+    return writeFile(path, SymbolStore(), symbolNames, usrs, projectData);
+}
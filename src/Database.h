@@ -0,0 +1,123 @@
+#ifndef Database_h
+#define Database_h
+
+#include "CursorInfo.h"
+#include "MappedFile.h"
+#include "RTags.h"
+#include "SymbolStore.h"
+#include "UsrIndex.h"
+
+/*
+  On-disk format of a project database. Everything is written in native byte
+  order and laid out so that a mapped file can be used as is:
+
+  Header
+  Symbol table:         SymbolEntry[symbolCount], grouped by fileId and
+                        sorted by offset, like SymbolStore
+  Cursor records:       CursorRecord followed by its target and reference
+                        locations, pointed to by SymbolEntry::record
+  SymbolName table:     NameEntry[symbolNameCount], sorted like SymbolNameMap,
+                        followed by the locations of each entry
+  Usr table:            NameEntry[usrCount] in UsrIndex order, followed by
+                        the locations of each entry
+  String pool:          symbol names and usrs, shared between all tables
+  Project data:         Serialized blob owned by Project
+
+  Tables and records are 8-byte aligned so they can be read straight out of
+  the mapping. Offsets and sizes are 64 bit, counts are 32 bit and limited
+  to INT_MAX like the containers they're read into.
+
+  A name index, see writeNameIndex(), has no symbols and both name tables
+  sorted by name so find() can binary search them in place.
+*/
+
+class Database
+{
+public:
+    Database();
+
+    enum Section {
+        Symbols = 0x1,
+        SymbolNames = 0x2,
+        Usr = 0x4,
+        AllSections = Symbols|SymbolNames|Usr
+    };
+
+    bool open(const Path &path);
+    void close();
+    bool isOpen() const { return mHeader; }
+    Path path() const { return mFile.path(); }
+
+    int symbolCount() const;
+    Location location(int idx) const;
+    CursorInfo cursorInfo(int idx) const;
+
+    int count(Section section) const;
+    ByteArray name(Section section, int idx) const;
+    Set<Location> locations(Section section, int idx) const;
+    // Index of name in section's table or -1, the table has to be sorted
+    int find(Section section, const ByteArray &name) const;
+
+    void read(SymbolStore::FileSymbols &symbols) const;
+    void read(Section section, Map<InternedString, Set<Location> > &names) const;
+    void read(UsrIndex &usr) const;
+
+    const char *projectData() const;
+    int projectDataSize() const;
+
+    static bool write(const Path &path, const SymbolStore &symbols,
+                      const SymbolNameMap &symbolNames, const UsrIndex &usr,
+                      const ByteArray &projectData);
+    // Writes usrs sorted too, it's otherwise the same as write()
+    static bool writeNameIndex(const Path &path, const SymbolNameMap &symbolNames,
+                               const SymbolNameMap &usrs, const ByteArray &projectData);
+private:
+    friend class DatabaseWriter;
+    Database(const Database &);
+    Database &operator=(const Database &);
+
+    struct Header {
+        int32_t version, padding;
+        uint64_t size;
+        uint64_t symbolTable, symbolNameTable, usrTable;
+        uint32_t symbolCount, symbolNameCount, usrCount, padding2;
+        uint64_t stringPool, stringPoolSize;
+        uint64_t projectData, projectDataSize;
+    };
+
+    struct SymbolEntry {
+        uint64_t location;
+        uint64_t record;
+    };
+
+    struct CursorRecord {
+        int64_t enumValue;
+        uint64_t symbolName;
+        uint32_t symbolNameLength;
+        int32_t kind, type, start, end;
+        uint32_t targetCount, referenceCount;
+        uint16_t symbolLength, padding;
+    };
+
+    struct NameEntry {
+        uint64_t name, locations;
+        uint32_t nameLength, locationCount;
+    };
+
+    template <typename T> const T *at(uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(mFile.data() + offset);
+    }
+    bool validate(const Header *header) const;
+    template <typename Usrs>
+    static bool writeFile(const Path &path, const SymbolStore &symbols, const SymbolNameMap &symbolNames,
+                          const Usrs &usrs, const ByteArray &projectData);
+    const NameEntry *nameTable(Section section, int *count) const;
+    void readLocations(uint64_t offset, int count, Set<Location> &locations) const;
+    void readLocations(uint64_t offset, int count, LocationSet &locations) const;
+
+    MappedFile mFile;
+    const Header *mHeader;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "FileCache.h"
+#include "Location.h"
+#include "MutexLocker.h"
+#include <stdio.h>
+
+Mutex FileCache::sMutex;
+Map<uint32_t, FileCache::Entry> FileCache::sFiles;
+FileCache::Entry *FileCache::sFirst = 0;
+FileCache::Entry *FileCache::sLast = 0;
+Map<uint32_t, uint32_t> FileCache::sGenerations;
+uint32_t FileCache::sClearGeneration = 0;
+int64_t FileCache::sBytes = 0;
+
+int FileCache::Contents::lineIndex(uint32_t offset) const
+{
+    // the last line that starts at or before offset
+    return (std::upper_bound(mLines.begin(), mLines.end(), offset) - mLines.begin()) - 1;
+}
+
+bool FileCache::Contents::convertOffset(uint32_t offset, int &line, int &col) const
+{
+    const uint32_t size = mData.size();
+    // an offset at the very end is fine as long as the last line doesn't end
+    // with a newline
+    if (offset > size || (offset == size && (!size || mData.at(size - 1) == '\n'))) {
+        line = col = -1;
+        return false;
+    }
+    const int idx = lineIndex(offset);
+    line = idx + 1;
+    col = offset - mLines.at(idx) + 1;
+    return true;
+}
+
+ByteArray FileCache::Contents::line(uint32_t offset, int *column) const
+{
+    const uint32_t size = mData.size();
+    if (offset >= size)
+        return ByteArray();
+    const int idx = lineIndex(offset);
+    const uint32_t start = mLines.at(idx);
+    uint32_t end = idx + 1 < mLines.size() ? mLines.at(idx + 1) : size;
+    if (end > start && mData.at(end - 1) == '\n')
+        --end;
+    enum { MaxLength = 1023 };
+    if (end - start > MaxLength)
+        end = start + MaxLength;
+    if (column)
+        *column = offset - start;
+    return ByteArray(mData.constData() + start, end - start);
+}
+
+shared_ptr<const FileCache::Contents> FileCache::read(uint32_t fileId)
+{
+    shared_ptr<Contents> ret;
+    const Path path = Location::path(fileId);
+    FILE *f = path.isEmpty() ? 0 : fopen(path.constData(), "r");
+    if (!f)
+        return ret;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    if (size >= 0) {
+        ret.reset(new Contents);
+        fseek(f, 0, SEEK_SET);
+        ret->mData = ByteArray(size, '\0');
+        if (size && fread(ret->mData.data(), sizeof(char), size, f) != static_cast<size_t>(size)) {
+            ret.reset();
+        } else {
+            const char *data = ret->mData.constData();
+            ret->mLines.append(0);
+            for (long i=0; i<size; ++i) {
+                if (data[i] == '\n' && i + 1 < size)
+                    ret->mLines.append(i + 1);
+            }
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+// Called with sMutex held
+void FileCache::link(Entry *entry)
+{
+    entry->prev = 0;
+    entry->next = sFirst;
+    if (sFirst) {
+        sFirst->prev = entry;
+    } else {
+        sLast = entry;
+    }
+    sFirst = entry;
+}
+
+// Called with sMutex held
+void FileCache::unlink(Entry *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        sFirst = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        sLast = entry->prev;
+    }
+    entry->prev = entry->next = 0;
+}
+
+// Called with sMutex held
+void FileCache::erase(Map<uint32_t, Entry>::iterator it)
+{
+    unlink(&it->second);
+    sBytes -= it->second.contents->data().size();
+    sFiles.erase(it);
+}
+
+shared_ptr<const FileCache::Contents> FileCache::contents(uint32_t fileId)
+{
+    uint32_t generation, clearGeneration;
+    {
+        MutexLocker lock(&sMutex);
+        const Map<uint32_t, Entry>::iterator it = sFiles.find(fileId);
+        if (it != sFiles.end()) {
+            if (sFirst != &it->second) {
+                unlink(&it->second);
+                link(&it->second);
+            }
+            return it->second.contents;
+        }
+        generation = sGenerations.value(fileId);
+        clearGeneration = sClearGeneration;
+    }
+
+    // read it without holding the lock, worst case two threads read the same
+    // file at the same time
+    const shared_ptr<const Contents> contents = read(fileId);
+    if (!contents || contents->data().size() > MaxBytes)
+        return contents;
+
+    MutexLocker lock(&sMutex);
+    if (sGenerations.value(fileId) != generation || sClearGeneration != clearGeneration) {
+        // invalidated while we were reading it, what we have may be from
+        // before the change so it's only good for this caller
+        return contents;
+    }
+    const Map<uint32_t, Entry>::iterator it = sFiles.find(fileId);
+    if (it != sFiles.end())
+        erase(it);
+    Entry &entry = sFiles[fileId];
+    entry.fileId = fileId;
+    entry.contents = contents;
+    link(&entry);
+    sBytes += contents->data().size();
+    while (sFiles.size() > MaxFiles || sBytes > MaxBytes)
+        erase(sFiles.find(sLast->fileId));
+    return contents;
+}
+
+void FileCache::invalidate(uint32_t fileId)
+{
+    MutexLocker lock(&sMutex);
+    ++sGenerations[fileId];
+    const Map<uint32_t, Entry>::iterator it = sFiles.find(fileId);
+    if (it != sFiles.end())
+        erase(it);
+}
+
+void FileCache::clear()
+{
+    MutexLocker lock(&sMutex);
+    ++sClearGeneration;
+    sFiles.clear();
+    sFirst = sLast = 0;
+    sBytes = 0;
+}
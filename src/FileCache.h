@@ -0,0 +1,74 @@
+#ifndef FileCache_h
+#define FileCache_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "Map.h"
+#include "Memory.h"
+#include "Mutex.h"
+
+/*
+  Contents of recently used source files together with the offsets their
+  lines start at so Location can turn offsets into line/column pairs and
+  extract context without reading the file again. Entries are shared so a
+  caller can keep using one after it has been evicted or invalidated.
+  Project invalidates files when its FileSystemWatcher sees them change.
+*/
+
+class FileCache
+{
+public:
+    class Contents
+    {
+    public:
+        const ByteArray &data() const { return mData; }
+        int lineCount() const { return mLines.size(); }
+
+        // line and col are 1-based
+        bool convertOffset(uint32_t offset, int &line, int &col) const;
+        // The line offset is on, column is offset's 0-based index in it
+        ByteArray line(uint32_t offset, int *column = 0) const;
+    private:
+        friend class FileCache;
+        int lineIndex(uint32_t offset) const;
+
+        ByteArray mData;
+        List<uint32_t> mLines; // offsets of the first character of each line
+    };
+
+    enum {
+        MaxFiles = 64,
+        MaxBytes = 64 * 1024 * 1024
+    };
+
+    // Null if fileId can't be read
+    static shared_ptr<const Contents> contents(uint32_t fileId);
+    static void invalidate(uint32_t fileId);
+    static void clear();
+private:
+    // Entries are linked from most to least recently used, the map's nodes
+    // don't move so the links stay valid until an entry is erased
+    struct Entry {
+        Entry()
+            : fileId(0), prev(0), next(0)
+        {}
+        uint32_t fileId;
+        shared_ptr<const Contents> contents;
+        Entry *prev, *next;
+    };
+    static shared_ptr<const Contents> read(uint32_t fileId);
+    static void link(Entry *entry);
+    static void unlink(Entry *entry);
+    static void erase(Map<uint32_t, Entry>::iterator it);
+
+    static Mutex sMutex;
+    static Map<uint32_t, Entry> sFiles;
+    static Entry *sFirst, *sLast;
+    // Bumped by invalidate() and clear() so contents() doesn't cache what it
+    // read if the file was invalidated while it was reading it
+    static Map<uint32_t, uint32_t> sGenerations;
+    static uint32_t sClearGeneration;
+    static int64_t sBytes;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "FileIndex.h"
+#include <ctype.h>
+
+FileIndex::FileIndex()
+    : mRemoved(0)
+{
+}
+
+void FileIndex::trigrams(const ByteArray &string, List<uint32_t> &out)
+{
+    out.clear();
+    const int size = string.size();
+    if (size < 3)
+        return;
+    const unsigned char *str = reinterpret_cast<const unsigned char*>(string.constData());
+    uint32_t trigram = (tolower(str[0]) << 8) | tolower(str[1]);
+    for (int i=2; i<size; ++i) {
+        trigram = ((trigram << 8) | tolower(str[i])) & 0xffffff;
+        out.append(trigram);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+bool FileIndex::insert(const ByteArray &dir, const ByteArray &fileName)
+{
+    const std::pair<IdMap::iterator, bool> inserted = mIds.insert(std::make_pair(dir + fileName, mPaths.size()));
+    if (!inserted.second)
+        return false;
+    // map keys don't move so we can point to them
+    mPaths.append(&inserted.first->first);
+    List<uint32_t> keys;
+    trigrams(inserted.first->first, keys);
+    for (int i=0; i<keys.size(); ++i)
+        mPostings[keys.at(i)].append(inserted.first->second);
+    return true;
+}
+
+bool FileIndex::remove(const ByteArray &dir, const ByteArray &fileName)
+{
+    const IdMap::iterator it = mIds.find(dir + fileName);
+    if (it == mIds.end())
+        return false;
+    mPaths[it->second] = 0;
+    mIds.erase(it);
+    if (++mRemoved > 1024 && mRemoved > mIds.size())
+        compact();
+    return true;
+}
+
+void FileIndex::clear()
+{
+    mPaths.clear();
+    mPostings.clear();
+    mIds.clear();
+    mRemoved = 0;
+}
+
+void FileIndex::compact()
+{
+    IdMap ids;
+    ids.swap(mIds);
+    clear();
+    for (IdMap::const_iterator it = ids.begin(); it != ids.end(); ++it)
+        insert(it->first, ByteArray());
+}
+
+// Sorts like FilesMap, by directory and then by file name
+static inline bool compareFiles(const ByteArray *l, const ByteArray *r)
+{
+    const int lDir = l->lastIndexOf('/') + 1, rDir = r->lastIndexOf('/') + 1;
+    const int cmp = strncmp(l->constData(), r->constData(), std::min(lDir, rDir));
+    if (cmp)
+        return cmp < 0;
+    if (lDir != rDir)
+        return lDir < rDir;
+    return strcmp(l->constData() + lDir, r->constData() + rDir) < 0;
+}
+
+List<const ByteArray *> FileIndex::candidates(const ByteArray &string) const
+{
+    List<const ByteArray *> ret;
+    List<uint32_t> keys;
+    trigrams(string, keys);
+    if (keys.isEmpty()) {
+        ret.reserve(mIds.size());
+        for (IdMap::const_iterator it = mIds.begin(); it != mIds.end(); ++it)
+            ret.append(&it->first);
+    } else {
+        List<const List<int> *> postings;
+        for (int i=0; i<keys.size(); ++i) {
+            const Map<uint32_t, List<int> >::const_iterator it = mPostings.find(keys.at(i));
+            if (it == mPostings.end())
+                return ret;
+            postings.append(&it->second);
+        }
+        int smallest = 0;
+        for (int i=1; i<postings.size(); ++i) {
+            if (postings.at(i)->size() < postings.at(smallest)->size())
+                smallest = i;
+        }
+        // posting lists are sorted by id so we can binary search the others
+        const List<int> &ids = *postings.at(smallest);
+        for (int i=0; i<ids.size(); ++i) {
+            const int id = ids.at(i);
+            const ByteArray *path = mPaths.at(id);
+            if (!path)
+                continue;
+            bool ok = true;
+            for (int j=0; ok && j<postings.size(); ++j) {
+                if (j != smallest)
+                    ok = std::binary_search(postings.at(j)->begin(), postings.at(j)->end(), id);
+            }
+            if (ok)
+                ret.append(path);
+        }
+    }
+    std::sort(ret.begin(), ret.end(), compareFiles);
+    return ret;
+}
+
+ByteArray FileIndex::literal(const ByteArray &pattern)
+{
+    ByteArray best, current;
+    const char *str = pattern.constData();
+    const int size = pattern.size();
+    int i = 0;
+    while (i < size) {
+        char ch = str[i];
+        if (ch == '\\' && i + 1 < size && (str[i + 1] == '?' || str[i + 1] == '+' || str[i + 1] == '{')) {
+            // quantifiers are handled with the character they apply to
+            if (str[i + 1] == '{') {
+                const int end = pattern.indexOf("\\}", i + 2);
+                if (end == -1)
+                    return ByteArray();
+                i = end + 2;
+            } else {
+                i += 2;
+            }
+            continue;
+        }
+        int length = 1;
+        bool literal = true;
+        switch (ch) {
+        case '\\':
+            if (i + 1 == size)
+                return ByteArray();
+            ch = str[i + 1];
+            length = 2;
+            switch (ch) {
+            case '(':
+            case ')':
+            case '|':
+                // groups and alternatives can make anything optional
+                return ByteArray();
+            default:
+                if (!ispunct(static_cast<unsigned char>(ch)))
+                    literal = false; // \w, \<, back references and friends
+                break;
+            }
+            break;
+        case '[': {
+            // skip the bracket expression, ']' right after '[' or '[^' is part of it
+            int j = i + 1;
+            if (j < size && str[j] == '^')
+                ++j;
+            if (j < size && str[j] == ']')
+                ++j;
+            while (j < size && str[j] != ']') {
+                if (str[j] == '[' && j + 1 < size && (str[j + 1] == ':' || str[j + 1] == '.' || str[j + 1] == '=')) {
+                    const char close = str[j + 1];
+                    j += 2;
+                    while (j + 1 < size && !(str[j] == close && str[j + 1] == ']'))
+                        ++j;
+                    j += 2;
+                } else {
+                    ++j;
+                }
+            }
+            if (j >= size)
+                return ByteArray();
+            length = j + 1 - i;
+            literal = false;
+            break; }
+        case '.':
+        case '^':
+        case '$':
+        case '*':
+            literal = false;
+            break;
+        default:
+            break;
+        }
+        i += length;
+
+        // a quantifier after this character can make it optional
+        bool optional = false, repeated = false;
+        if (i < size && str[i] == '*') {
+            optional = true;
+        } else if (i + 1 < size && str[i] == '\\') {
+            if (str[i + 1] == '?' || str[i + 1] == '{') {
+                optional = true;
+            } else if (str[i + 1] == '+') {
+                repeated = true;
+            }
+        }
+
+        if (literal && !optional)
+            current.append(ch);
+        if (!literal || optional || repeated) {
+            if (current.size() > best.size())
+                best = current;
+            current.clear();
+        }
+    }
+    if (current.size() > best.size())
+        best = current;
+    return best;
+}
@@ -0,0 +1,48 @@
+#ifndef FileIndex_h
+#define FileIndex_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "Map.h"
+
+/*
+  Trigram index over the project's files, kept next to FilesMap by
+  FileManager. Paths are stored relative to the project root and every path
+  is added to the posting list of each (case folded) trigram it contains so
+  FindFileJob only has to verify the paths that contain all of the
+  pattern's trigrams instead of building and matching every path in the
+  project.
+*/
+
+class FileIndex
+{
+public:
+    FileIndex();
+
+    // dir is relative to the project root and ends with a '/' unless it's
+    // the root itself
+    bool insert(const ByteArray &dir, const ByteArray &fileName);
+    bool remove(const ByteArray &dir, const ByteArray &fileName);
+    void clear();
+    int size() const { return mIds.size(); }
+    bool isEmpty() const { return mIds.isEmpty(); }
+
+    // The paths that might contain string, ignoring case, in the same order
+    // as FilesMap. Strings shorter than a trigram match every path.
+    List<const ByteArray *> candidates(const ByteArray &string) const;
+
+    // The longest string every match of the basic regular expression
+    // pattern has to contain, empty if there isn't one we can tell
+    static ByteArray literal(const ByteArray &pattern);
+private:
+    typedef Map<ByteArray, int> IdMap;
+    static void trigrams(const ByteArray &string, List<uint32_t> &out);
+    void compact();
+
+    List<const ByteArray *> mPaths; // keys of mIds, 0 for removed paths
+    Map<uint32_t, List<int> > mPostings;
+    IdMap mIds;
+    int mRemoved;
+};
+
+#endif
@@ -30,6 +30,8 @@ void FileManager::onRecurseJobFinished(const Set<Path> &paths)
     assert(project);
     Scope<FilesMap&> scope = project->lockFilesForWrite();
     FilesMap &map = scope.data();
+    FileIndex &index = project->fileIndex();
+    const int rootSize = project->path().size();
     mWatcher.clear();
     for (Set<Path>::const_iterator it = paths.begin(); it != paths.end(); ++it) {
         const Path parent = it->parentDir();
@@ -40,7 +42,9 @@ void FileManager::onRecurseJobFinished(const Set<Path> &paths)
         Set<ByteArray> &dir = map[parent];
         if (dir.isEmpty())
             mWatcher.watch(parent);
-        dir.insert(it->fileName());
+        const ByteArray fileName = it->fileName();
+        dir.insert(fileName);
+        index.insert(parent.mid(rootSize), fileName);
     }
 }
 
@@ -70,7 +74,9 @@ void FileManager::onFileAdded(const Path &path)
         Set<ByteArray> &dir = map[parent];
         if (dir.isEmpty())
             mWatcher.watch(parent);
-        dir.insert(path.fileName());
+        const ByteArray fileName = path.fileName();
+        dir.insert(fileName);
+        project->fileIndex().insert(parent.mid(project->path().size()), fileName);
     } else {
         error() << "Got empty parent here" << path;
     }
@@ -87,7 +93,9 @@ void FileManager::onFileRemoved(const Path &path)
     }
     const Path parent = path.parentDir();
     Set<ByteArray> &dir = map[parent];
-    if (dir.remove(path.fileName()) && dir.isEmpty()) {
+    const ByteArray fileName = path.fileName();
+    project->fileIndex().remove(parent.mid(project->path().size()), fileName);
+    if (dir.remove(fileName) && dir.isEmpty()) {
         mWatcher.unwatch(parent);
         map.remove(parent);
     }
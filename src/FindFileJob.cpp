@@ -5,7 +5,8 @@
 #include "FileManager.h"
 
 FindFileJob::FindFileJob(const QueryMessage &query, const shared_ptr<Project> &project)
-    : Job(query, WriteBuffered, project)
+    : Job(query, WriteBuffered, project), mMode(MatchAll), mCaseSensitivity(ByteArray::CaseSensitive),
+      mPreferExact(false), mFoundExact(false)
 {
     const ByteArray q = query.query();
     if (!q.isEmpty()) {
@@ -17,6 +18,20 @@ FindFileJob::FindFileJob(const QueryMessage &query, const shared_ptr<Project> &p
     }
 }
 
+// With --absolute-path the paths we match start with the project root so a
+// match could start in the root itself, the index only knows about the
+// part after it.
+static inline bool overlapsRoot(const Path &root, const ByteArray &literal, ByteArray::CaseSensitivity cs)
+{
+    if (root.contains(literal, cs))
+        return true;
+    for (int i=1; i<literal.size(); ++i) {
+        if (root.endsWith(literal.left(i), cs))
+            return true;
+    }
+    return false;
+}
+
 void FindFileJob::execute()
 {
     shared_ptr<Project> proj = project();
@@ -25,82 +40,100 @@ void FindFileJob::execute()
     }
     const Path srcRoot = proj->path();
 
-    enum Mode {
-        All,
-        RegExp,
-        Pattern
-    } mode = All;
-    ByteArray::CaseSensitivity cs = ByteArray::CaseSensitive;
+    mMode = MatchAll;
+    mCaseSensitivity = ByteArray::CaseSensitive;
+    ByteArray literal;
     if (mRegExp.isValid()) {
-        mode = RegExp;
+        mMode = MatchRegExp;
+        literal = FileIndex::literal(mRegExp.pattern());
     } else if (!mPattern.isEmpty()) {
-        mode = Pattern;
+        mMode = MatchPattern;
+        literal = mPattern;
     }
     if (queryFlags() & QueryMessage::MatchCaseInsensitive)
-        cs = ByteArray::CaseInsensitive;
+        mCaseSensitivity = ByteArray::CaseInsensitive;
+    mPreferExact = queryFlags() & QueryMessage::FindFilePreferExact;
+    mFoundExact = false;
+    mMatches.clear();
 
     ByteArray out;
     out.reserve(PATH_MAX);
-    if (queryFlags() & QueryMessage::AbsolutePath) {
+    const bool absolute = queryFlags() & QueryMessage::AbsolutePath;
+    if (absolute) {
         out.append(srcRoot);
         assert(srcRoot.endsWith('/'));
     }
     Scope<const FilesMap&> scope = proj->lockFilesForRead();
-    const Map<Path, Set<ByteArray> > &dirs = scope.data();
-    Map<Path, Set<ByteArray> >::const_iterator dirit = dirs.begin();
-    bool foundExact = false;
-    const int patternSize = mPattern.size();
-    List<ByteArray> matches;
-    const bool preferExact = queryFlags() & QueryMessage::FindFilePreferExact;
-    while (dirit != dirs.end()) {
-        const Path &dir = dirit->first;
-        out.append(dir.constData() + srcRoot.size(), dir.size() - srcRoot.size());
+    if (literal.size() >= 3 && (!absolute || !overlapsRoot(srcRoot, literal, mCaseSensitivity))) {
+        // only the paths that contain all of the literal's trigrams can match
+        const List<const ByteArray *> candidates = proj->fileIndex().candidates(literal);
+        const int rootSize = out.size();
+        for (List<const ByteArray *>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+            out.append(**it);
+            if (!visit(out))
+                return;
+            out.truncate(rootSize);
+        }
+    } else {
+        const Map<Path, Set<ByteArray> > &dirs = scope.data();
+        Map<Path, Set<ByteArray> >::const_iterator dirit = dirs.begin();
+        while (dirit != dirs.end()) {
+            const Path &dir = dirit->first;
+            out.append(dir.constData() + srcRoot.size(), dir.size() - srcRoot.size());
 
-        const Set<ByteArray> &files = dirit->second;
-        for (Set<ByteArray>::const_iterator it = files.begin(); it != files.end(); ++it) {
-            const ByteArray &key = *it;
-            out.append(key);
-            bool ok;
-            switch (mode) {
-            case All:
-                ok = true;
-                break;
-            case RegExp:
-                ok = mRegExp.indexIn(out) != -1;
-                break;
-            case Pattern:
-                if (!preferExact) {
-                    ok = out.contains(mPattern, cs);
-                } else {
-                    const int outSize = out.size();
-                    const bool exact = (outSize > patternSize && out.endsWith(mPattern) && out.at(outSize - (patternSize + 1)) == '/');
-                    if (exact) {
-                        ok = true;
-                        if (!foundExact) {
-                            matches.clear();
-                            foundExact = true;
-                        }
-                    } else {
-                        ok = !foundExact && out.contains(mPattern, cs);
-                    }
-                }
-                break;
-            }
-            if (ok) {
-                if (preferExact && !foundExact) {
-                    matches.append(out);
-                } else {
-                    if (!write(out))
-                        return;
-                }
+            const Set<ByteArray> &files = dirit->second;
+            for (Set<ByteArray>::const_iterator it = files.begin(); it != files.end(); ++it) {
+                const ByteArray &key = *it;
+                out.append(key);
+                if (!visit(out))
+                    return;
+                out.chop(key.size());
             }
-            out.chop(key.size());
+            out.chop(dir.size() - srcRoot.size());
+            ++dirit;
         }
-        out.chop(dir.size() - srcRoot.size());
-        ++dirit;
     }
-    for (List<ByteArray>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+    for (List<ByteArray>::const_iterator it = mMatches.begin(); it != mMatches.end(); ++it) {
         if (!write(*it))
             break;
     }
 }
+
+bool FindFileJob::visit(const ByteArray &out)
+{
+    bool ok = false;
+    switch (mMode) {
+    case MatchAll:
+        ok = true;
+        break;
+    case MatchRegExp:
+        ok = mRegExp.indexIn(out) != -1;
+        break;
+    case MatchPattern:
+        if (!mPreferExact) {
+            ok = out.contains(mPattern, mCaseSensitivity);
+        } else {
+            const int outSize = out.size();
+            const int patternSize = mPattern.size();
+            const bool exact = (outSize > patternSize && out.endsWith(mPattern) && out.at(outSize - (patternSize + 1)) == '/');
+            if (exact) {
+                ok = true;
+                if (!mFoundExact) {
+                    mMatches.clear();
+                    mFoundExact = true;
+                }
+            } else {
+                ok = !mFoundExact && out.contains(mPattern, mCaseSensitivity);
+            }
+        }
+        break;
+    }
+    if (ok) {
+        if (mPreferExact && !mFoundExact) {
+            mMatches.append(out);
+        } else {
+            return write(out);
+        }
+    }
+    return true;
+}
@@ -15,8 +15,18 @@ public:
 protected:
     virtual void execute();
 private:
+    bool visit(const ByteArray &out);
+
     ByteArray mPattern;
     RegExp mRegExp;
+    enum Mode {
+        MatchAll,
+        MatchRegExp,
+        MatchPattern
+    } mMode;
+    ByteArray::CaseSensitivity mCaseSensitivity;
+    bool mPreferExact, mFoundExact;
+    List<ByteArray> mMatches;
 };
 
 #endif
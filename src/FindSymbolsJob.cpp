@@ -18,11 +18,12 @@ void FindSymbolsJob::execute()
     Map<Location, bool> out;
     shared_ptr<Project> proj = project();
     if (proj) {
+        proj->loadName(Database::SymbolNames, string);
         Scope<const SymbolNameMap&> scope = proj->lockSymbolNamesForRead();
         if (scope.isNull())
             return;
         const SymbolNameMap &map = scope.data();
-        const SymbolNameMap::const_iterator it = map.find(string);
+        const SymbolNameMap::const_iterator it = map.find(InternedString::view(string));
         if (it != map.end()) {
             const Set<Location> &locations = it->second;
             for (Set<Location>::const_iterator i = locations.begin(); i != locations.end(); ++i) {
@@ -32,14 +33,14 @@ void FindSymbolsJob::execute()
     }
 
     if (out.size()) {
-        Scope<const SymbolMap&> scope = proj->lockSymbolsForRead();
-        const SymbolMap *map = &scope.data();
+        Scope<const SymbolStore&> scope = proj->lockSymbolsForRead();
+        const SymbolStore *map = &scope.data();
         List<RTags::SortedCursor> sorted;
         sorted.reserve(out.size());
         for (Map<Location, bool>::const_iterator it = out.begin(); it != out.end(); ++it) {
             RTags::SortedCursor node(it->first);
             if (it->second && map) {
-                const SymbolMap::const_iterator found = map->find(it->first);
+                const SymbolStore::const_iterator found = map->find(it->first);
                 if (found != map->end()) {
                     node.isDefinition = found->second.isDefinition();
                     node.kind = found->second.kind;
@@ -53,10 +54,10 @@ void FindSymbolsJob::execute()
         } else {
             std::sort(sorted.begin(), sorted.end());
         }
-        const uint32_t keyFlags = QueryMessage::keyFlags(queryFlags());
-        const int count = sorted.size();
-        for (int i=0; i<count; ++i) {
-            write(sorted.at(i).location.key(keyFlags));
-        }
+        List<Location> locations;
+        locations.reserve(sorted.size());
+        for (List<RTags::SortedCursor>::const_iterator it = sorted.begin(); it != sorted.end(); ++it)
+            locations.append(it->location);
+        write(locations);
     }
 }
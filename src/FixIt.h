@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "ByteArray.h"
+#include "Serializer.h"
 
 struct FixIt
 {
@@ -23,4 +24,16 @@ struct FixIt
     ByteArray text;
 };
 
+template <> inline Serializer &operator<<(Serializer &s, const FixIt &t)
+{
+    s << t.start << t.end << t.text;
+    return s;
+}
+
+template <> inline Deserializer &operator>>(Deserializer &s, FixIt &t)
+{
+    s >> t.start >> t.end >> t.text;
+    return s;
+}
+
 #endif
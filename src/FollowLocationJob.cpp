@@ -10,12 +10,12 @@ FollowLocationJob::FollowLocationJob(const Location &loc, const QueryMessage &qu
 
 void FollowLocationJob::execute()
 {
-    Scope<const SymbolMap&> scope = project()->lockSymbolsForRead();
+    Scope<const SymbolStore&> scope = project()->lockSymbolsForRead();
     if (scope.isNull())
         return;
 
-    const SymbolMap &map = scope.data();
-    const SymbolMap::const_iterator it = RTags::findCursorInfo(map, location);
+    const SymbolStore &map = scope.data();
+    const SymbolStore::const_iterator it = RTags::findCursorInfo(map, location);
     if (it == map.end())
         return;
 
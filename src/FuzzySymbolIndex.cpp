@@ -0,0 +1,176 @@
+#include "FuzzySymbolIndex.h"
+#include <ctype.h>
+
+FuzzySymbolIndex::FuzzySymbolIndex()
+    : mRemoved(0)
+{
+}
+
+int FuzzySymbolIndex::bucket(char ch)
+{
+    const unsigned char c = static_cast<unsigned char>(ch);
+    if (c >= 'a' && c <= 'z')
+        return c - 'a';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= '0' && c <= '9')
+        return 26 + (c - '0');
+    if (c == '_')
+        return 36;
+    return 37;
+}
+
+uint64_t FuzzySymbolIndex::mask(const ByteArray &string)
+{
+    uint64_t ret = 0;
+    const char *str = string.constData();
+    const int size = string.size();
+    for (int i=0; i<size; ++i)
+        ret |= (1ull << bucket(str[i]));
+    return ret;
+}
+
+bool FuzzySymbolIndex::insert(const InternedString &name)
+{
+    if (name.string().isEmpty())
+        return false;
+    int &id = mIds[name];
+    if (id)
+        return false;
+    // ids are stored off by one so 0 can mean "not added yet"
+    id = mEntries.size() + 1;
+    Entry entry;
+    entry.name = name;
+    entry.mask = mask(name.string());
+    mEntries.append(entry);
+    for (int i=0; i<Buckets; ++i) {
+        if (entry.mask & (1ull << i))
+            mPostings[i].append(id - 1);
+    }
+    return true;
+}
+
+bool FuzzySymbolIndex::remove(const InternedString &name)
+{
+    const Map<InternedString, int>::iterator it = mIds.find(name);
+    if (it == mIds.end())
+        return false;
+    Entry &entry = mEntries[it->second - 1];
+    entry.mask = 0;
+    entry.name = InternedString();
+    mIds.erase(it);
+    if (++mRemoved > 1024 && mRemoved > mIds.size())
+        compact();
+    return true;
+}
+
+void FuzzySymbolIndex::clear()
+{
+    mEntries.clear();
+    for (int i=0; i<Buckets; ++i)
+        mPostings[i].clear();
+    mIds.clear();
+    mRemoved = 0;
+}
+
+void FuzzySymbolIndex::compact()
+{
+    List<Entry> entries;
+    entries.swap(mEntries);
+    clear();
+    const int count = entries.size();
+    for (int i=0; i<count; ++i) {
+        if (entries.at(i).mask)
+            insert(entries.at(i).name);
+    }
+}
+
+static inline bool isWordStart(const char *str, int idx)
+{
+    if (!idx)
+        return true;
+    const unsigned char prev = static_cast<unsigned char>(str[idx - 1]);
+    const unsigned char cur = static_cast<unsigned char>(str[idx]);
+    if (!isalnum(prev))
+        return isalnum(cur);
+    if (islower(prev) && isupper(cur))
+        return true;
+    return isalpha(prev) && isdigit(cur);
+}
+
+enum {
+    MatchScore = 1,
+    FirstCharBonus = 8,
+    WordStartBonus = 6,
+    ConsecutiveBonus = 4,
+    CaseBonus = 1,
+    GapPenalty = 1,
+    MaxLeadingPenalty = 3,
+    ExactMatchBonus = 16
+};
+
+int FuzzySymbolIndex::score(const ByteArray &name, const ByteArray &query)
+{
+    const char *n = name.constData();
+    const char *q = query.constData();
+    const int nameLength = name.size();
+    const int queryLength = query.size();
+    if (!queryLength || queryLength > nameLength)
+        return -1;
+
+    // best[i] is the best score of matching the query so far with its last
+    // character at n[i], -1 if that isn't possible
+    enum { StackLength = 256 };
+    int stackBuffer[StackLength * 2];
+    List<int> heapBuffer;
+    int *best = stackBuffer, *next = stackBuffer + StackLength;
+    if (nameLength > StackLength) {
+        heapBuffer.resize(nameLength * 2);
+        best = &heapBuffer[0];
+        next = best + nameLength;
+    }
+    for (int j=0; j<queryLength; ++j) {
+        const char qc = q[j];
+        const int lower = tolower(static_cast<unsigned char>(qc));
+        // best score of any match of the previous character that isn't
+        // directly before i
+        int bestGap = -1;
+        bool any = false;
+        for (int i=j; i<nameLength; ++i) {
+            if (j && i - 2 >= j - 1 && best[i - 2] > bestGap)
+                bestGap = best[i - 2];
+            next[i] = -1;
+            if (tolower(static_cast<unsigned char>(n[i])) != lower)
+                continue;
+            int bonus = MatchScore;
+            if (!i) {
+                bonus += FirstCharBonus;
+            } else if (isWordStart(n, i)) {
+                bonus += WordStartBonus;
+            }
+            if (n[i] == qc)
+                bonus += CaseBonus;
+            int score = -1;
+            if (!j) {
+                score = std::max(0, bonus - std::min<int>(i, MaxLeadingPenalty));
+            } else {
+                if (best[i - 1] != -1)
+                    score = best[i - 1] + bonus + ConsecutiveBonus;
+                if (bestGap != -1)
+                    score = std::max(score, std::max(0, bestGap + bonus - GapPenalty));
+            }
+            next[i] = score;
+            if (score != -1)
+                any = true;
+        }
+        if (!any)
+            return -1;
+        std::swap(best, next);
+    }
+    int ret = -1;
+    for (int i=queryLength - 1; i<nameLength; ++i)
+        ret = std::max(ret, best[i]);
+    if (queryLength == nameLength)
+        ret += ExactMatchBonus;
+    return ret;
+}
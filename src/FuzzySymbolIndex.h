@@ -0,0 +1,118 @@
+#ifndef FuzzySymbolIndex_h
+#define FuzzySymbolIndex_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "Map.h"
+#include "StringPool.h"
+#include <algorithm>
+
+/*
+  Index of the project's symbol names for subsequence ("fuzzy") matching,
+  kept next to SymbolNameMap and SymbolNameTrie. Every name gets a bit mask of
+  the (case folded) characters it contains and is added to one posting list
+  per character. A query only looks at the names in the posting list of its
+  rarest character, skips the ones whose mask lacks any of the query's
+  characters and scores the rest. Removed names are tombstoned and the index
+  is compacted once they outnumber the live ones.
+*/
+
+class FuzzySymbolIndex
+{
+public:
+    FuzzySymbolIndex();
+
+    struct Match {
+        InternedString name;
+        int score;
+    };
+
+    bool insert(const InternedString &name);
+    bool remove(const InternedString &name);
+    void clear();
+    int size() const { return mIds.size(); }
+    bool isEmpty() const { return mIds.isEmpty(); }
+
+    // Score of query as a case insensitive subsequence of name, higher is
+    // better. Matches at the start of words and camel humps and runs of
+    // consecutive characters score higher. Returns -1 if query doesn't match.
+    static int score(const ByteArray &name, const ByteArray &query);
+
+    // Up to max matches, best first, -1 means all of them. filter needs
+    // bool accept(const InternedString &) and bool isAborted().
+    template <typename Filter> List<Match> find(const ByteArray &query, int max, Filter &filter) const;
+private:
+    enum { Buckets = 38 };
+    static int bucket(char ch);
+    static uint64_t mask(const ByteArray &string);
+    void compact();
+
+    struct Entry {
+        InternedString name;
+        uint64_t mask; // 0 for removed names
+    };
+    static bool isBetter(const Match &l, const Match &r);
+    // orders the heap so its first element is the worst match kept
+    static bool heapCompare(const Match &l, const Match &r) { return isBetter(l, r); }
+
+    List<Entry> mEntries;
+    List<int> mPostings[Buckets];
+    Map<InternedString, int> mIds;
+    int mRemoved;
+};
+
+inline bool FuzzySymbolIndex::isBetter(const Match &l, const Match &r)
+{
+    if (l.score != r.score)
+        return l.score > r.score;
+    const ByteArray &lName = l.name.string(), &rName = r.name.string();
+    if (lName.size() != rName.size())
+        return lName.size() < rName.size();
+    return lName < rName;
+}
+
+template <typename Filter>
+inline List<FuzzySymbolIndex::Match> FuzzySymbolIndex::find(const ByteArray &query, int max, Filter &filter) const
+{
+    List<Match> matches;
+    if (query.isEmpty() || !max)
+        return matches;
+
+    const uint64_t queryMask = mask(query);
+    const List<int> *postings = 0;
+    for (int i=0; i<Buckets; ++i) {
+        if (queryMask & (1ull << i) && (!postings || mPostings[i].size() < postings->size()))
+            postings = &mPostings[i];
+    }
+    assert(postings);
+
+    const int count = postings->size();
+    for (int i=0; i<count; ++i) {
+        if (!(i % 1024) && filter.isAborted())
+            return List<Match>();
+        const Entry &entry = mEntries.at(postings->at(i));
+        if ((entry.mask & queryMask) != queryMask)
+            continue;
+        Match match;
+        match.name = entry.name;
+        match.score = score(entry.name.string(), query);
+        if (match.score == -1)
+            continue;
+        const bool full = max != -1 && matches.size() == max;
+        if (full && !isBetter(match, matches.first()))
+            continue;
+        if (!filter.accept(entry.name))
+            continue;
+        if (full) {
+            std::pop_heap(matches.begin(), matches.end(), heapCompare);
+            matches.last() = match;
+        } else {
+            matches.append(match);
+        }
+        std::push_heap(matches.begin(), matches.end(), heapCompare);
+    }
+    std::sort_heap(matches.begin(), matches.end(), heapCompare);
+    return matches;
+}
+
+#endif
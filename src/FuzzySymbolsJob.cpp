@@ -0,0 +1,78 @@
+#include "FuzzySymbolsJob.h"
+#include "Server.h"
+#include "Log.h"
+#include "RTags.h"
+
+enum {
+    DefaultFlags = Job::WriteUnfiltered|Job::WriteBuffered,
+    ElispFlags = DefaultFlags|Job::QuoteOutput
+};
+
+FuzzySymbolsJob::FuzzySymbolsJob(const QueryMessage &query, const shared_ptr<Project> &proj)
+    : Job(query, query.flags() & QueryMessage::ElispList ? ElispFlags : DefaultFlags, proj),
+      string(query.query()), max(query.max())
+{
+}
+
+class FuzzySymbolsFilter
+{
+public:
+    FuzzySymbolsFilter(FuzzySymbolsJob *job, const Project *project)
+        : mJob(job), mProject(project), mHasFilter(job->hasFilter()),
+          mSkipParentheses(job->queryFlags() & QueryMessage::SkipParentheses)
+    {}
+
+    bool isAborted() const { return mJob->isAborted(); }
+
+    bool accept(const InternedString &name) const
+    {
+        if (mSkipParentheses && name.string().contains('('))
+            return false;
+        if (!mHasFilter)
+            return true;
+        Set<uint32_t> files;
+        mProject->symbolNameFiles(name, files);
+        for (Set<uint32_t>::const_iterator i = files.begin(); i != files.end(); ++i) {
+            if (mJob->filter(Location::path(*i)))
+                return true;
+        }
+        return false;
+    }
+private:
+    FuzzySymbolsJob *mJob;
+    const Project *mProject;
+    const bool mHasFilter, mSkipParentheses;
+};
+
+void FuzzySymbolsJob::execute()
+{
+    const unsigned queryFlags = Job::queryFlags();
+    const bool elispList = queryFlags & QueryMessage::ElispList;
+
+    if (elispList)
+        write("(list", IgnoreMax|DontQuote);
+    shared_ptr<Project> proj = project();
+    if (proj && !string.isEmpty()) {
+        List<FuzzySymbolIndex::Match> matches;
+        proj->loadSymbolNameTrie();
+        {
+            Scope<const SymbolNameMap&> scope = proj->lockSymbolNamesForRead();
+            if (scope.isNull())
+                return;
+            FuzzySymbolsFilter filter(this, proj.get());
+            matches = proj->fuzzySymbolIndex().find(string, max, filter);
+        }
+        if (isAborted())
+            return;
+        // best match first unless we're asked to reverse it
+        const bool reverse = queryFlags & QueryMessage::ReverseSort;
+        const int count = matches.size();
+        for (int i=0; i<count; ++i) {
+            const FuzzySymbolIndex::Match &match = matches.at(reverse ? count - i - 1 : i);
+            if (!write(match.name.string()))
+                break;
+        }
+    }
+    if (elispList)
+        write(")", IgnoreMax|DontQuote);
+}
@@ -0,0 +1,19 @@
+#ifndef FuzzySymbolsJob_h
+#define FuzzySymbolsJob_h
+
+#include "ByteArray.h"
+#include "QueryMessage.h"
+#include "Job.h"
+
+class FuzzySymbolsJob : public Job
+{
+public:
+    FuzzySymbolsJob(const QueryMessage &query, const shared_ptr<Project> &proj);
+protected:
+    virtual void execute();
+private:
+    const ByteArray string;
+    const int max;
+};
+
+#endif
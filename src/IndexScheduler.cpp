@@ -0,0 +1,149 @@
+#include "IndexScheduler.h"
+#include <algorithm>
+#include <assert.h>
+
+IndexScheduler::IndexScheduler()
+    : mSequence(0)
+{
+}
+
+void IndexScheduler::add(uint32_t fileId, int priority)
+{
+    remove(fileId);
+    Entry &entry = mEntries[fileId];
+    entry.key.priority = priority;
+    entry.key.unowned = 0;
+    entry.key.sequence = mSequence++;
+    entry.key.fileId = fileId;
+    mUnresolved.insert(fileId);
+}
+
+void IndexScheduler::unregister(const Entry &entry)
+{
+    const uint32_t fileId = entry.key.fileId;
+    if (mUnresolved.remove(fileId))
+        return;
+    mOrder.erase(entry.key);
+    for (int i=0; i<entry.headers.size(); ++i) {
+        const Map<uint32_t, List<uint32_t> >::iterator it = mIncluders.find(entry.headers.at(i));
+        assert(it != mIncluders.end());
+        List<uint32_t> &includers = it->second;
+        includers.erase(std::find(includers.begin(), includers.end(), fileId));
+        if (includers.isEmpty())
+            mIncluders.erase(it);
+    }
+}
+
+bool IndexScheduler::remove(uint32_t fileId)
+{
+    const Map<uint32_t, Entry>::iterator it = mEntries.find(fileId);
+    if (it == mEntries.end())
+        return false;
+    unregister(it->second);
+    mEntries.erase(it);
+    return true;
+}
+
+void IndexScheduler::clear()
+{
+    mEntries.clear();
+    mOrder.clear();
+    mIncluders.clear();
+    mOwnership.clear();
+    mUnresolved.clear();
+}
+
+void IndexScheduler::addInclude(uint32_t file, uint32_t header)
+{
+    mIncludes[file].append(header);
+}
+
+const List<uint32_t> &IndexScheduler::includes(uint32_t file) const
+{
+    static const List<uint32_t> none;
+    const Map<uint32_t, List<uint32_t> >::const_iterator it = mIncludes.find(file);
+    return it == mIncludes.end() ? none : it->second;
+}
+
+void IndexScheduler::resolve(const Set<uint32_t> &visited)
+{
+    // visited already has the changes we haven't applied, they mustn't be
+    // counted twice for the new files
+    applyOwnership();
+    for (Set<uint32_t>::const_iterator it = mUnresolved.begin(); it != mUnresolved.end(); ++it) {
+        Entry &entry = mEntries[*it];
+        const List<uint32_t> &headers = includes(*it);
+        for (int i=0; i<headers.size(); ++i) {
+            const uint32_t header = headers.at(i);
+            if (header == *it)
+                continue;
+            entry.headers.append(header);
+            mIncluders[header].append(*it);
+            if (!visited.contains(header))
+                ++entry.key.unowned;
+        }
+        mOrder.insert(entry.key);
+    }
+    mUnresolved.clear();
+}
+
+uint32_t IndexScheduler::take()
+{
+    assert(!needsHeaders());
+    applyOwnership();
+    if (mOrder.isEmpty())
+        return 0;
+    const uint32_t fileId = mOrder.begin()->fileId;
+    remove(fileId);
+    return fileId;
+}
+
+uint32_t IndexScheduler::take(Filter filter, void *userData)
+{
+    assert(!needsHeaders());
+    applyOwnership();
+    for (Set<Key>::const_iterator it = mOrder.begin(); it != mOrder.end(); ++it) {
+        const uint32_t fileId = it->fileId;
+        if (filter(fileId, userData)) {
+            remove(fileId);
+            return fileId;
+        }
+    }
+    return 0;
+}
+
+void IndexScheduler::applyOwnership()
+{
+    if (mOwnership.isEmpty())
+        return;
+    // sum up the changes per file first so each one is only moved once
+    Map<uint32_t, int> deltas;
+    for (Map<uint32_t, int>::const_iterator it = mOwnership.begin(); it != mOwnership.end(); ++it) {
+        if (!it->second)
+            continue;
+        const Map<uint32_t, List<uint32_t> >::const_iterator includers = mIncluders.find(it->first);
+        if (includers == mIncluders.end())
+            continue;
+        for (int i=0; i<includers->second.size(); ++i)
+            deltas[includers->second.at(i)] -= it->second;
+    }
+    mOwnership.clear();
+    for (Map<uint32_t, int>::const_iterator it = deltas.begin(); it != deltas.end(); ++it) {
+        if (!it->second)
+            continue;
+        Key &key = mEntries[it->first].key;
+        mOrder.erase(key);
+        key.unowned += it->second;
+        mOrder.insert(key);
+    }
+}
+
+void IndexScheduler::onVisited(uint32_t header)
+{
+    ++mOwnership[header];
+}
+
+void IndexScheduler::onUnvisited(uint32_t header)
+{
+    --mOwnership[header];
+}
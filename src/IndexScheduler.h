@@ -0,0 +1,89 @@
+#ifndef IndexScheduler_h
+#define IndexScheduler_h
+
+#include "List.h"
+#include "Map.h"
+#include "RTags.h"
+#include "Set.h"
+
+/*
+  Decides which of a project's queued translation units is handed to the
+  thread pool next. The first job that visits a header owns it and every
+  other job skips it, so among the units with the highest priority the one
+  with the fewest headers that aren't owned yet goes first. Initially that's
+  the smallest unit, after that it's the units sharing most of their headers
+  with the ones already indexed, which keeps units using the same headers
+  together. Units whose dependencies aren't known yet go in the order they
+  were added.
+
+  The headers of each file are kept up to date with addInclude() as the
+  project's dependencies grow, so resolving new files only looks at their
+  own headers. Ownership changes are queued and applied in one go the next
+  time a file is taken, so visiting a header stays cheap however many queued
+  files include it.
+
+  Not thread safe, Project protects it with its mutex.
+*/
+
+class IndexScheduler
+{
+public:
+    IndexScheduler();
+
+    void add(uint32_t fileId, int priority);
+    bool remove(uint32_t fileId);
+    void clear();
+    bool isEmpty() const { return mEntries.isEmpty(); }
+    int size() const { return mEntries.size(); }
+
+    // file includes header, the same pair can't be added twice
+    void addInclude(uint32_t file, uint32_t header);
+    // The headers file includes, file itself included
+    const List<uint32_t> &includes(uint32_t file) const;
+
+    // Files added since the last call to resolve() need their headers before
+    // anything can be taken
+    bool needsHeaders() const { return !mUnresolved.isEmpty(); }
+    // visited are the headers that are already owned by a job
+    void resolve(const Set<uint32_t> &visited);
+    uint32_t take();
+    // Takes the first file filter accepts, 0 if there's none
+    typedef bool (*Filter)(uint32_t fileId, void *userData);
+    uint32_t take(Filter filter, void *userData);
+
+    void onVisited(uint32_t header);
+    void onUnvisited(uint32_t header);
+private:
+    struct Key {
+        int priority;
+        int unowned;
+        uint64_t sequence;
+        uint32_t fileId;
+
+        bool operator<(const Key &other) const
+        {
+            if (priority != other.priority)
+                return static_cast<unsigned>(priority) > static_cast<unsigned>(other.priority);
+            if (unowned != other.unowned)
+                return unowned < other.unowned;
+            return sequence < other.sequence;
+        }
+    };
+    struct Entry {
+        Key key;
+        List<uint32_t> headers;
+    };
+
+    void applyOwnership();
+    void unregister(const Entry &entry);
+
+    Map<uint32_t, Entry> mEntries;
+    Set<Key> mOrder;
+    Map<uint32_t, List<uint32_t> > mIncluders; // header -> resolved files including it
+    Map<uint32_t, List<uint32_t> > mIncludes; // file -> headers it includes
+    Map<uint32_t, int> mOwnership; // header -> visits - unvisits not applied yet
+    Set<uint32_t> mUnresolved;
+    uint64_t mSequence;
+};
+
+#endif
@@ -4,6 +4,8 @@
 #include "Server.h"
 #include "EventLoop.h"
 #include "RTagsClang.h"
+#include "IndexerWorker.h"
+#include "PreambleCache.h"
 
 struct DumpUserData {
     int indentLevel;
@@ -22,19 +24,53 @@ struct VerboseVisitorUserData {
     IndexerJob *job;
 };
 
+// a tree node is the value plus color, parent, left and right
+template <typename T>
+static inline int64_t nodeSize()
+{
+    return sizeof(T) + (4 * sizeof(void*));
+}
+
+template <typename Sets>
+static inline int64_t setsMemoryUsage(const Sets &map)
+{
+    int64_t ret = map.size() * nodeSize<typename Sets::value_type>();
+    for (typename Sets::const_iterator it = map.begin(); it != map.end(); ++it)
+        ret += it->second.size() * nodeSize<typename Sets::mapped_type::value_type>();
+    return ret;
+}
+
+int64_t IndexData::memoryUsage() const
+{
+    int64_t ret = setsMemoryUsage(references) + setsMemoryUsage(symbolNames)
+                  + setsMemoryUsage(dependencies) + setsMemoryUsage(fixIts);
+    ret += symbols.size() * nodeSize<ArenaSymbolMap::value_type>();
+    for (ArenaSymbolMap::const_iterator it = symbols.begin(); it != symbols.end(); ++it)
+        ret += it->second.heapSize();
+    for (UsrIndex::const_iterator it = usrs.begin(); it != usrs.end(); ++it)
+        ret += sizeof(UsrIndex::Entry) + (it->locations.size() * nodeSize<Location>());
+    for (DiagnosticsMap::const_iterator it = diagnostics.begin(); it != diagnostics.end(); ++it) {
+        ret += nodeSize<DiagnosticsMap::value_type>();
+        for (int i=0; i<it->second.size(); ++i)
+            ret += it->second.at(i).size();
+    }
+    return ret;
+}
+
 IndexerJob::IndexerJob(const shared_ptr<Project> &project, unsigned flags, const Path &p, const List<ByteArray> &arguments,
                        CXIndex index, CXTranslationUnit unit)
     : Job(0, project),
       mFlags(flags), mPath(p), mFileId(Location::insertFile(p)),
       mArgs(arguments), mUnit(unit), mIndex(index), mDump(false), mParseTime(0),
-      mStarted(false)
+      mPeakMemory(0), mStarted(false), mPreambleFileId(0)
 {
 }
 
 IndexerJob::IndexerJob(const QueryMessage &msg, const shared_ptr<Project> &project,
                        const Path &input, const List<ByteArray> &arguments)
     : Job(msg, WriteUnfiltered|WriteBuffered, project), mFlags(0), mPath(input), mFileId(Location::insertFile(input)),
-      mArgs(arguments), mUnit(0), mIndex(0), mDump(true), mParseTime(0), mStarted(false)
+      mArgs(arguments), mUnit(0), mIndex(0), mDump(true), mParseTime(0), mPeakMemory(0), mStarted(false),
+      mPreambleFileId(0)
 {
 }
 
@@ -45,11 +81,13 @@ void IndexerJob::inclusionVisitor(CXFile includedFile,
 {
     IndexerJob *job = static_cast<IndexerJob*>(userData);
     const Location l(includedFile, 0);
+    if (job->mPreambleFileId && l.fileId() == job->mPreambleFileId)
+        return;
 
     const Path path = l.path();
-    job->mData->symbolNames[path].insert(l);
+    job->mData->symbolName(path).insert(l);
     const char *fn = path.fileName();
-    job->mData->symbolNames[ByteArray(fn, strlen(fn))].insert(l);
+    job->mData->symbolName(ByteArray(fn, strlen(fn))).insert(l);
 
     const uint32_t fileId = l.fileId();
     if (!includeLen) {
@@ -59,16 +97,30 @@ void IndexerJob::inclusionVisitor(CXFile includedFile,
             CXFile originatingFile;
             clang_getSpellingLocation(includeStack[i], &originatingFile, 0, 0, 0);
             Location loc(originatingFile, 0);
-            const uint32_t f = loc.fileId();
+            uint32_t f = loc.fileId();
+            // the pch's includes are really the main file's
+            if (f && f == job->mPreambleFileId)
+                f = job->mFileId;
             if (f)
                 job->mData->dependencies[fileId].insert(f);
         }
     }
 }
 
-static inline void addToSymbolNames(const ByteArray &arg, bool hasTemplates, const Location &location, SymbolNameMap &symbolNames)
+void IndexerJob::preambleInclusionVisitor(CXFile includedFile,
+                                          CXSourceLocation *,
+                                          unsigned includeLen,
+                                          CXClientData userData)
+{
+    if (includeLen) {
+        const Location l(includedFile, 0);
+        static_cast<Set<uint32_t>*>(userData)->insert(l.fileId());
+    }
+}
+
+static inline void addToSymbolNames(const ByteArray &arg, bool hasTemplates, const Location &location, IndexData &data)
 {
-    symbolNames[arg].insert(location);
+    data.symbolName(arg).insert(location);
     if (hasTemplates) {
         ByteArray copy = arg;
         const int lt = arg.indexOf('<');
@@ -83,76 +135,103 @@ static inline void addToSymbolNames(const ByteArray &arg, bool hasTemplates, con
             copy.remove(lt, gt - lt + 1);
         }
 
-        symbolNames[copy].insert(location);
+        data.symbolName(copy).insert(location);
     }
 }
 
 static const CXCursor nullCursor = clang_getNullCursor();
 
-ByteArray IndexerJob::addNamePermutations(const CXCursor &cursor, const Location &location)
+static inline void addNamePermutation(const ByteArray &qparam, const ByteArray &qnoparam, CXCursorKind kind,
+                                      const Location &location, IndexData &data)
 {
-    int retLength = -1;
-    ByteArray qparam, qnoparam;
+    bool hasTemplates = false;
+    switch (kind) {
+    case CXCursor_ClassTemplate:
+    case CXCursor_Constructor:
+    case CXCursor_Destructor:
+        hasTemplates = qnoparam.contains('<');
+        break;
+    default:
+        break;
+    }
 
-    CXCursor cur = cursor;
-    CXCursorKind kind;
+    addToSymbolNames(qparam, hasTemplates, location, data);
+    if (!qnoparam.isEmpty())
+        addToSymbolNames(qnoparam, hasTemplates, location, data);
+}
 
-    bool first = true;
-    while (true) {
-        if (clang_equalCursors(cur, nullCursor))
-            break;
-        kind = clang_getCursorKind(cur);
+ByteArray IndexerJob::addNamePermutations(const CXCursor &cursor, const Location &location)
+{
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    CXStringScope displayName(clang_getCursorDisplayName(cursor));
+    const char *name = displayName.data();
+    if (!name || !strlen(name))
+        return ByteArray();
+
+    const ByteArray qparam(name);
+    ByteArray qnoparam;
+    const int sp = qparam.indexOf('(');
+    if (sp != -1)
+        qnoparam = qparam.left(sp);
+    addNamePermutation(qparam, qnoparam, kind, location, *mData);
+    if (!RTags::needsQualifiers(kind))
+        return qparam;
+
+    const List<NameScope> &scopes = nameScopes(clang_getCursorSemanticParent(cursor));
+    for (int i=0; i<scopes.size(); ++i) {
+        const NameScope &scope = scopes.at(i);
+        addNamePermutation(scope.prefix + qparam, qnoparam.isEmpty() ? ByteArray() : scope.prefix + qnoparam,
+                           scope.kind, location, *mData);
+    }
 
-        if (first) {
-            first = false;
-        } else if (!RTags::needsQualifiers(kind)) {
-            break;
-        }
+    if (kind == CXCursor_VarDecl || kind == CXCursor_ParmDecl || scopes.isEmpty())
+        return qparam;
+    return scopes.last().prefix + qparam;
+}
 
-        CXStringScope displayName(clang_getCursorDisplayName(cur));
-        const char *name = displayName.data();
-        if (!name || !strlen(name)) {
-            break;
-        }
-        const ByteArray qname(name);
-        if (qparam.isEmpty()) {
-            qparam = qname;
-            if (kind == CXCursor_VarDecl || kind == CXCursor_ParmDecl) {
-                retLength = qparam.size();
-            }
-            const int sp = qparam.indexOf('(');
-            if (sp != -1)
-                qnoparam = qparam.left(sp);
-        } else {
-            qparam.prepend(qname + "::");
-            if (!qnoparam.isEmpty())
-                qnoparam.prepend(qname + "::");
-        }
+// Siblings share their parents so the scopes are built once per
+// declaration. The cache is keyed by the cursor rather than its location
+// since e.g. template specializations and classes that come from the same
+// macro share one. The returned list is only valid until the next call.
+const List<IndexerJob::NameScope> &IndexerJob::nameScopes(const CXCursor &cursor)
+{
+    static const List<NameScope> none;
+    if (clang_equalCursors(cursor, nullCursor))
+        return none;
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    if (!RTags::needsQualifiers(kind))
+        return none;
 
-        assert(!qparam.isEmpty());
-        bool hasTemplates = false;
-        switch (kind) {
-        case CXCursor_ClassTemplate:
-        case CXCursor_Constructor:
-        case CXCursor_Destructor:
-            hasTemplates = qnoparam.contains('<');
-            break;
-        default:
-            break;
+    const unsigned hash = clang_hashCursor(cursor);
+    {
+        const List<CachedNameScopes> &cached = mNameScopes[hash];
+        for (int i=0; i<cached.size(); ++i) {
+            if (clang_equalCursors(cached.at(i).cursor, cursor))
+                return cached.at(i).scopes;
         }
+    }
 
-        addToSymbolNames(qparam, hasTemplates, location, mData->symbolNames);
-        if (!qnoparam.isEmpty()) {
-            assert(!qnoparam.isEmpty());
-            addToSymbolNames(qnoparam, hasTemplates, location, mData->symbolNames);
+    List<NameScope> scopes;
+    CXStringScope displayName(clang_getCursorDisplayName(cursor));
+    const char *name = displayName.data();
+    if (name && strlen(name)) {
+        const ByteArray prefix = ByteArray(name) + "::";
+        // a copy, looking up the parents may add to our bucket
+        const List<NameScope> parents = nameScopes(clang_getCursorSemanticParent(cursor));
+        scopes.reserve(parents.size() + 1);
+        const NameScope scope = { prefix, kind };
+        scopes.append(scope);
+        for (int i=0; i<parents.size(); ++i) {
+            const NameScope parent = { parents.at(i).prefix + prefix, parents.at(i).kind };
+            scopes.append(parent);
         }
-
-        if (!RTags::needsQualifiers(kind))
-            break;
-        cur = clang_getCursorSemanticParent(cur);
     }
 
-    return retLength == -1 ? qparam : qparam.right(retLength);
+    List<CachedNameScopes> &cached = mNameScopes[hash];
+    cached.append(CachedNameScopes());
+    cached.last().cursor = cursor;
+    cached.last().scopes.swap(scopes);
+    return cached.last().scopes;
 }
 
 static const CXSourceLocation nullLocation = clang_getNullLocation();
@@ -185,23 +264,32 @@ Location IndexerJob::createLocation(const CXSourceLocation &location, bool *bloc
             if (!fileId)
                 fileId = Location::insertFile(Path::resolved(fileName));
             ret = Location(fileId, start);
-            if (blocked) {
-                PathState &state = mPaths[fileId];
-                if (state == Unset) {
-                    shared_ptr<Project> p = project();
-                    shared_ptr<IndexerJob> job = static_pointer_cast<IndexerJob>(shared_from_this());
-                    state = p && p->visitFile(fileId, job) ? Index : DontIndex;
-                }
-                if (state != Index) {
-                    *blocked = true;
-                    return Location();
-                }
+            if (blocked && !shouldIndex(fileId)) {
+                *blocked = true;
+                return Location();
             }
         }
     }
     return ret;
 }
 
+bool IndexerJob::shouldIndex(uint32_t fileId)
+{
+    PathState &state = mPaths[fileId];
+    if (state == Unset) {
+        bool visit;
+        if (IndexerWorker::isWorker()) {
+            visit = IndexerWorker::visitFile(fileId);
+        } else {
+            shared_ptr<Project> p = project();
+            shared_ptr<IndexerJob> job = static_pointer_cast<IndexerJob>(shared_from_this());
+            visit = p && p->visitFile(fileId, job);
+        }
+        state = visit ? Index : DontIndex;
+    }
+    return state == Index;
+}
+
 static inline CXCursor findDestructorForDelete(const CXCursor &deleteStatement)
 {
     const CXCursor child = RTags::findFirstChild(deleteStatement);
@@ -258,12 +346,9 @@ static inline CXCursor findDestructorForDelete(const CXCursor &deleteStatement)
 CXChildVisitResult IndexerJob::indexVisitor(CXCursor cursor, CXCursor parent, CXClientData data)
 {
     IndexerJob *job = static_cast<IndexerJob*>(data);
-    {
-        MutexLocker lock(&job->mMutex);
-        if (job->mAborted)
-            return CXChildVisit_Break;
-    }
-    
+    if (job->isAborted())
+        return CXChildVisit_Break;
+
     const CXCursorKind kind = clang_getCursorKind(cursor);
     const RTags::CursorType type = RTags::cursorType(kind);
     if (type == RTags::Other)
@@ -316,13 +401,111 @@ CXChildVisitResult IndexerJob::indexVisitor(CXCursor cursor, CXCursor parent, CX
     return CXChildVisit_Recurse;
 }
 
+// The macros are children of the translation unit itself so there's no
+// need to recurse
+CXChildVisitResult IndexerJob::preprocessingVisitor(CXCursor cursor, CXCursor parent, CXClientData data)
+{
+    switch (clang_getCursorKind(cursor)) {
+    case CXCursor_MacroDefinition:
+    case CXCursor_MacroExpansion:
+        if (indexVisitor(cursor, parent, data) == CXChildVisit_Break)
+            return CXChildVisit_Break;
+        break;
+    default:
+        break;
+    }
+    return CXChildVisit_Continue;
+}
+
+// Walks a function body for what the callbacks don't report, the targets of
+// gotos and the destructors that delete expressions call. Only statements,
+// expressions and local variables (for their initializers) can contain those
+CXChildVisitResult IndexerJob::bodyVisitor(CXCursor cursor, CXCursor parent, CXClientData data)
+{
+    if (static_cast<IndexerJob*>(data)->isAborted())
+        return CXChildVisit_Break;
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    switch (kind) {
+    case CXCursor_LabelRef:
+    case CXCursor_CXXDeleteExpr:
+        return indexVisitor(cursor, parent, data);
+    case CXCursor_VarDecl:
+        return CXChildVisit_Recurse;
+    default:
+        break;
+    }
+    return clang_isStatement(kind) || clang_isExpression(kind) ? CXChildVisit_Recurse : CXChildVisit_Continue;
+}
+
+int IndexerJob::abortQuery(CXClientData data, void *)
+{
+    return static_cast<IndexerJob*>(data)->isAborted();
+}
+
+CXIdxClientFile IndexerJob::indexIncludedFile(CXClientData data, const CXIdxIncludedFileInfo *info)
+{
+    IndexerJob *job = static_cast<IndexerJob*>(data);
+    bool blocked = false;
+    const Location loc = job->createLocation(clang_indexLoc_getCXSourceLocation(info->hashLoc), &blocked);
+    if (!blocked && !loc.isNull() && info->file)
+        job->handleInclude(loc, info->file, info->filename);
+    return 0;
+}
+
+// The callbacks get the USRs and referenced cursors handed to them, the
+// rest is handled the same way indexVisitor does it
+void IndexerJob::indexDeclaration(CXClientData data, const CXIdxDeclInfo *info)
+{
+    // implicit ones aren't in the AST that indexVisitor walks
+    if (info->isImplicit)
+        return;
+    const CXCursorKind kind = clang_getCursorKind(info->cursor);
+    if (RTags::cursorType(kind) != RTags::Cursor)
+        return;
+    IndexerJob *job = static_cast<IndexerJob*>(data);
+    bool blocked = false;
+    const Location loc = job->createLocation(clang_indexLoc_getCXSourceLocation(info->loc), &blocked);
+    if (blocked || loc.isNull())
+        return;
+    const char *usr = info->entityInfo->USR;
+    job->handleCursor(info->cursor, kind, loc, usr ? usr : "");
+
+    if (info->isDefinition) {
+        switch (kind) {
+        case CXCursor_FunctionDecl:
+        case CXCursor_CXXMethod:
+        case CXCursor_Constructor:
+        case CXCursor_Destructor:
+        case CXCursor_ConversionFunction:
+        case CXCursor_FunctionTemplate:
+            clang_visitChildren(info->cursor, bodyVisitor, job);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void IndexerJob::indexEntityReference(CXClientData data, const CXIdxEntityRefInfo *info)
+{
+    IndexerJob *job = static_cast<IndexerJob*>(data);
+    bool blocked = false;
+    const Location loc = job->createLocation(clang_indexLoc_getCXSourceLocation(info->loc), &blocked);
+    if (blocked || loc.isNull())
+        return;
+    const char *usr = info->referencedEntity->USR;
+    job->handleReference(info->cursor, clang_getCursorKind(info->cursor), loc, info->referencedEntity->cursor,
+                         info->parentEntity ? info->parentEntity->cursor : nullCursor, usr ? usr : "");
+}
+
 static inline bool isImplicit(const CXCursor &cursor)
 {
     return clang_equalLocations(clang_getCursorLocation(cursor),
                                 clang_getCursorLocation(clang_getCursorSemanticParent(cursor)));
 }
 
-void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, const Location &location, const CXCursor &ref, const CXCursor &parent)
+void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, const Location &location, const CXCursor &ref, const CXCursor &parent,
+                                 const char *refUsr)
 {
     const CXCursorKind refKind = clang_getCursorKind(ref);
     if (clang_isInvalid(refKind))
@@ -370,7 +553,7 @@ void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, cons
         return;
 
     CursorInfo &refInfo = mData->symbols[refLoc];
-    if (!refInfo.symbolLength && !handleCursor(ref, refKind, refLoc))
+    if (!refInfo.symbolLength && !handleCursor(ref, refKind, refLoc, refUsr))
         return;
 
     refInfo.references.insert(location);
@@ -403,7 +586,7 @@ void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, cons
         info.definition = false;
         info.kind = kind;
         info.symbolLength = isOperator ? end - start : refInfo.symbolLength;
-        info.symbolName = refInfo.symbolName;
+        info.setSymbolNameId(refInfo.symbolNameId);
         info.type = clang_getCursorType(cursor).kind;
         if (kind == CXCursor_TypeRef) {
             switch (clang_getCursorKind(parent)) {
@@ -412,18 +595,18 @@ void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, cons
             case CXCursor_VarDecl:
             case CXCursor_ParmDecl:
             case CXCursor_FieldDecl: {
-                SymbolMap::iterator it = mData->symbols.find(createLocation(parent, 0));
+                ArenaSymbolMap::iterator it = mData->symbols.find(createLocation(parent, 0));
                 if (it != mData->symbols.end()) {
                     CursorInfo &ci = it->second;
                     switch (ci.type) {
                     case CXType_Pointer:
-                        ci.symbolName.prepend(info.symbolName + " *");
+                        ci.setSymbolName(info.symbolName() + " *" + ci.symbolName());
                         break;
                     case CXType_LValueReference:
-                        ci.symbolName.prepend(info.symbolName + " &");
+                        ci.setSymbolName(info.symbolName() + " &" + ci.symbolName());
                         break;
                     default:
-                        ci.symbolName.prepend(info.symbolName + " ");
+                        ci.setSymbolName(info.symbolName() + " " + ci.symbolName());
                         break;
                     }
                 }
@@ -434,7 +617,7 @@ void IndexerJob::handleReference(const CXCursor &cursor, CXCursorKind kind, cons
 
         }
     }
-    Set<Location> &val = mData->references[location];
+    ArenaLocationSet &val = mData->reference(location);
     val.insert(refLoc);
 }
 
@@ -471,24 +654,28 @@ void IndexerJob::handleInclude(const CXCursor &cursor, CXCursorKind kind, const
     assert(kind == CXCursor_InclusionDirective);
     (void)kind;
     CXFile includedFile = clang_getIncludedFile(cursor);
-    if (includedFile) {
-        const Location refLoc(includedFile, 0);
-        if (!refLoc.isNull()) {
-            {
-                ByteArray include = "#include ";
-                const Path path = refLoc.path();
-                mData->symbolNames[(include + path)].insert(location);
-                mData->symbolNames[(include + path.fileName())].insert(location);
-            }
-            CursorInfo &info = mData->symbols[location];
-            info.targets.insert(refLoc);
-            info.kind = cursor.kind;
-            info.definition = false;
-            info.symbolName = "#include " + RTags::eatString(clang_getCursorDisplayName(cursor));
-            info.symbolLength = info.symbolName.size() + 2;
-            // this fails for things like:
-            // # include    <foobar.h>
+    if (includedFile)
+        handleInclude(location, includedFile, RTags::eatString(clang_getCursorDisplayName(cursor)));
+}
+
+void IndexerJob::handleInclude(const Location &location, CXFile includedFile, const ByteArray &name)
+{
+    const Location refLoc(includedFile, 0);
+    if (!refLoc.isNull()) {
+        {
+            ByteArray include = "#include ";
+            const Path path = refLoc.path();
+            mData->symbolName(include + path).insert(location);
+            mData->symbolName(include + path.fileName()).insert(location);
         }
+        CursorInfo &info = mData->symbols[location];
+        info.targets.insert(refLoc);
+        info.kind = CXCursor_InclusionDirective;
+        info.definition = false;
+        info.setSymbolName("#include " + name);
+        info.symbolLength = info.symbolName().size() + 2;
+        // this fails for things like:
+        // # include    <foobar.h>
     }
 }
 
@@ -538,7 +725,7 @@ static inline bool addType(ByteArray &symbolName, CXTypeKind kind)
     return true;
 }
 
-bool IndexerJob::handleCursor(const CXCursor &cursor, CXCursorKind kind, const Location &location)
+bool IndexerJob::handleCursor(const CXCursor &cursor, CXCursorKind kind, const Location &location, const char *usr)
 {
     CursorInfo &info = mData->symbols[location];
     if (!info.symbolLength || !RTags::isCursor(info.kind)) {
@@ -560,7 +747,7 @@ bool IndexerJob::handleCursor(const CXCursor &cursor, CXCursorKind kind, const L
                 return false;
             }
         } else {
-            info.symbolName = addNamePermutations(cursor, location);
+            ByteArray symbolName = addNamePermutations(cursor, location);
 
             switch (kind) {
             case CXCursor_FunctionDecl:
@@ -568,11 +755,12 @@ bool IndexerJob::handleCursor(const CXCursor &cursor, CXCursorKind kind, const L
             case CXCursor_VarDecl:
             case CXCursor_ParmDecl:
             case CXCursor_FieldDecl:
-                addType(info.symbolName, info.type);
+                addType(symbolName, info.type);
                 break;
             default:
                 break;
             }
+            info.setSymbolName(symbolName);
         }
 
         CXSourceRange range = clang_getCursorExtent(cursor);
@@ -588,9 +776,16 @@ bool IndexerJob::handleCursor(const CXCursor &cursor, CXCursorKind kind, const L
             info.definition = clang_isCursorDefinition(cursor);
         }
         info.kind = kind;
-        const ByteArray usr = RTags::eatString(clang_getCursorUSR(cursor));
-        if (!usr.isEmpty())
-            mData->usrMap[usr].insert(location);
+        if (usr) {
+            if (*usr) {
+                const ByteArray str(usr, strlen(usr));
+                mData->usrs.insert(str, UsrIndex::hash(str)).insert(location);
+            }
+        } else {
+            const ByteArray str = RTags::eatString(clang_getCursorUSR(cursor));
+            if (!str.isEmpty())
+                mData->usrs.insert(str, UsrIndex::hash(str)).insert(location);
+        }
 
         switch (info.kind) {
         case CXCursor_Constructor:
@@ -641,7 +836,8 @@ bool IndexerJob::parse()
         return !isAborted();
     }
 
-    mClangLine = Server::instance()->clangPath();
+    // there's no server in an indexer worker
+    mClangLine = Server::instance() ? ByteArray(Server::instance()->clangPath()) : ByteArray("clang");
     mClangLine += ' ';
 
     int idx = 0;
@@ -662,6 +858,12 @@ bool IndexerJob::parse()
     mClangLine += mPath;
 
     time_t now = time(0);
+    const bool preambles = IndexerWorker::isWorker() ? IndexerWorker::sharesPreambles() : PreambleCache::isEnabled();
+    if (preambles && !mDump && parseWithPreamble(clangArgs, idx)) {
+        mParseTime = now;
+        return !isAborted();
+    }
+
     mUnit = clang_parseTranslationUnit(mIndex, mPath.constData(),
                                        clangArgs.data(), idx, 0, 0,
                                        CXTranslationUnit_Incomplete | CXTranslationUnit_DetailedPreprocessingRecord);
@@ -693,6 +895,153 @@ bool IndexerJob::parse()
     return !isAborted();
 }
 
+bool IndexerJob::parseWithPreamble(List<const char*> clangArgs, int count)
+{
+    char *buf;
+    const int size = mPath.readAll(buf);
+    if (size <= 0)
+        return false;
+    ByteArray contents(buf, size);
+    delete[] buf;
+
+    ByteArray includes;
+    const int prefix = PreambleCache::prefix(contents, includes);
+    if (!prefix)
+        return false;
+
+    // quoted includes are looked up relative to the file
+    ByteArray key = ByteArray::join(mArgs, '\n');
+    key += "\n\n";
+    if (includes.contains('"')) {
+        key += mPath.parentDir();
+        key += '\n';
+    }
+    key += includes;
+
+    // workers go through rdm, the cache and the visited files are its
+    const bool worker = IndexerWorker::isWorker();
+    Path pch;
+    Set<uint32_t> headers;
+    const PreambleCache::State state = (worker
+                                        ? IndexerWorker::acquirePreamble(key, pch, headers)
+                                        : PreambleCache::acquire(key, pch, headers));
+    switch (state) {
+    case PreambleCache::Unavailable:
+        return false;
+    case PreambleCache::Build: {
+        const bool built = buildPreamble(pch, includes, clangArgs, count, headers);
+        if (!(worker
+              ? IndexerWorker::finishPreamble(key, pch, built, headers)
+              : PreambleCache::finish(key, pch, built, headers))) {
+            return false;
+        }
+        break; }
+    case PreambleCache::Ready:
+        break;
+    }
+
+    // headers that haven't been indexed yet are left to a normal parse so
+    // they get indexed the way they always are
+    if (worker) {
+        if (!IndexerWorker::isVisited(headers))
+            return false;
+    } else {
+        shared_ptr<Project> p = project();
+        if (!p || !p->isVisited(headers))
+            return false;
+    }
+
+    // the includes come from the pch, blanking them keeps offsets and lines intact
+    char *data = contents.data();
+    for (int i=0; i<prefix; ++i) {
+        if (data[i] != '\n')
+            data[i] = ' ';
+    }
+    clangArgs.resize(count);
+    clangArgs.append("-include-pch");
+    clangArgs.append(pch.constData());
+    CXUnsavedFile unsaved = { mPath.constData(), contents.constData(), static_cast<unsigned long>(contents.size()) };
+    mUnit = clang_parseTranslationUnit(mIndex, mPath.constData(),
+                                       clangArgs.data(), clangArgs.size(), &unsaved, 1,
+                                       CXTranslationUnit_Incomplete | CXTranslationUnit_DetailedPreprocessingRecord);
+    if (!mUnit) {
+        warning() << "Failed to parse" << mPath << "with" << pch;
+        if (worker) {
+            IndexerWorker::removePreamble(key);
+        } else {
+            PreambleCache::remove(key);
+        }
+        return false;
+    }
+    const Path header = pch + ".h";
+    mPreambleFileId = Location::insertFile(header);
+    // clang doesn't report the inclusions that come from the pch
+    for (Set<uint32_t>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+        mData->dependencies[*it].insert(mFileId);
+    warning() << "loading unit " << mClangLine << "with" << pch;
+    return true;
+}
+
+bool IndexerJob::buildPreamble(const Path &pch, const ByteArray &includes, List<const char*> clangArgs, int count,
+                               Set<uint32_t> &headers)
+{
+    const Path header = pch + ".h";
+    FILE *f = fopen(header.constData(), "w");
+    if (!f) {
+        error("Can't open file %s", header.constData());
+        return false;
+    }
+    const bool ok = fwrite(includes.constData(), includes.size(), 1, f) == 1;
+    fclose(f);
+    if (!ok)
+        return false;
+
+    const char *extension = mPath.extension();
+    const char *language = "c++-header";
+    if (extension) {
+        if (!strcmp(extension, "c")) {
+            language = "c-header";
+        } else if (!strcmp(extension, "m")) {
+            language = "objective-c-header";
+        } else if (!strcmp(extension, "mm")) {
+            language = "objective-c++-header";
+        }
+    }
+    const Path dir = mPath.parentDir();
+    clangArgs.resize(count);
+    clangArgs.append("-x");
+    clangArgs.append(language);
+    clangArgs.append("-iquote");
+    clangArgs.append(dir.constData());
+
+    StopWatch timer;
+    CXTranslationUnit unit = clang_parseTranslationUnit(mIndex, header.constData(),
+                                                        clangArgs.data(), clangArgs.size(), 0, 0,
+                                                        CXTranslationUnit_Incomplete);
+    if (!unit) {
+        error() << "Failed to build preamble for" << mPath;
+        return false;
+    }
+    clang_getInclusions(unit, preambleInclusionVisitor, &headers);
+    // a pch with errors would hide them from every unit using it
+    bool saved = true;
+    const unsigned diagnosticCount = clang_getNumDiagnostics(unit);
+    for (unsigned i=0; saved && i<diagnosticCount; ++i) {
+        CXDiagnostic diagnostic = clang_getDiagnostic(unit, i);
+        saved = clang_getDiagnosticSeverity(diagnostic) < CXDiagnostic_Error;
+        clang_disposeDiagnostic(diagnostic);
+    }
+    if (saved)
+        saved = clang_saveTranslationUnit(unit, pch.constData(), clang_defaultSaveOptions(unit)) == CXSaveError_None;
+    clang_disposeTranslationUnit(unit);
+    if (!saved) {
+        error() << "Failed to save preamble for" << mPath << "to" << pch;
+        return false;
+    }
+    warning() << "built preamble" << pch << "for" << mPath << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
 bool IndexerJob::diagnose(int *errorCount)
 {
     if (errorCount)
@@ -781,7 +1130,25 @@ bool IndexerJob::visit()
     if (isAborted())
         return false;
 
-    clang_visitChildren(clang_getTranslationUnitCursor(mUnit), indexVisitor, this);
+    if (mFlags & IndexCallbacks) {
+        CXIndexAction action = clang_IndexAction_create(mIndex);
+        IndexerCallbacks callbacks;
+        memset(&callbacks, 0, sizeof(IndexerCallbacks));
+        callbacks.abortQuery = abortQuery;
+        callbacks.ppIncludedFile = indexIncludedFile;
+        callbacks.indexDeclaration = indexDeclaration;
+        callbacks.indexEntityReference = indexEntityReference;
+        clang_indexTranslationUnit(action, this, &callbacks, sizeof(IndexerCallbacks),
+                                   CXIndexOpt_IndexFunctionLocalSymbols, mUnit);
+        clang_IndexAction_dispose(action);
+        // the callbacks never report macros, labels and deletes are picked
+        // up by indexDeclaration
+        if (!isAborted())
+            clang_visitChildren(clang_getTranslationUnitCursor(mUnit), preprocessingVisitor, this);
+    } else {
+        clang_visitChildren(clang_getTranslationUnitCursor(mUnit), indexVisitor, this);
+    }
+    mNameScopes.clear();
     if (isAborted())
         return false;
     if (testLog(VerboseDebug)) {
@@ -823,7 +1190,9 @@ void IndexerJob::execute()
             mStarted = true;
         }
         int errorCount = 0;
-        if (parse()) {
+        if (IndexerWorker::isEnabled()) {
+            IndexerWorker::index(this);
+        } else if (parse()) {
             if (!mUnit) {
                 mData->message = ByteArray::format<1024>("%s error in %sms. (%d deps)%s",
                                                          mPath.toTilde().constData(),
@@ -834,13 +1203,22 @@ void IndexerJob::execute()
                 ByteArray status = mUnit ? "success" : "error";
                 if (errorCount)
                     status += ByteArray::format<32>(", %d errors", errorCount);
-                mData->message = ByteArray::format<1024>("%s (%s) in %sms. (%d syms, %d symNames, %d refs, %d deps)%s",
+                mData->message = ByteArray::format<1024>("%s (%s) in %sms. (%d syms, %d symNames, %d refs, %d deps, %dkb arena in %d blocks)%s",
                                                          mPath.toTilde().constData(), status.constData(),
                                                          ByteArray::number(mTimer.elapsed()).constData(),
                                                          mData->symbols.size(), mData->symbolNames.size(), mData->references.size(), mData->dependencies.size(),
+                                                         int(mData->arena.allocated() / 1024), mData->arena.blockCount(),
                                                          mFlags & Dirty ? " (dirty)" : "");
             }
         }
+        if (mUnit)
+            mPeakMemory = RTags::memoryUsage(mUnit);
+        if (mPreambleFileId && mUnit) {
+            // reparsing would need the pch and the blanked out contents, keep
+            // it out of the unit cache
+            clang_disposeTranslationUnit(mUnit);
+            mUnit = 0;
+        }
         shared_ptr<Project> p = project();
         if (p) {
             shared_ptr<IndexerJob> job = static_pointer_cast<IndexerJob>(shared_from_this());
@@ -934,10 +1312,11 @@ CXChildVisitResult IndexerJob::dumpVisitor(CXCursor cursor, CXCursor, CXClientDa
 }
 bool IndexerJob::abortIfStarted()
 {
+    // mMutex orders this with execute() setting mStarted
     MutexLocker lock(&mMutex);
     if (mStarted)
-        mAborted = true;
-    return mAborted;
+        abort();
+    return isAborted();
 }
 
 CXTranslationUnit IndexerJob::takeTranslationUnit()
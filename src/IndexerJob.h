@@ -6,17 +6,45 @@
 #include "Str.h"
 #include "ThreadPool.h"
 #include "Mutex.h"
+#include "UsrIndex.h"
 #include <clang-c/Index.h>
 
 struct IndexData {
-    ReferenceMap references;
-    SymbolMap symbols;
-    SymbolNameMap symbolNames;
+    // symbols, references and symbolNames are allocated from arena so they
+    // go away in one go, it has to be declared first to outlive them
+    Arena arena;
+    ArenaReferenceMap references;
+    ArenaSymbolMap symbols;
+    ArenaSymbolNameMap symbolNames;
     DependencyMap dependencies;
     ByteArray message;
-    UsrMap usrMap;
+    UsrIndex usrs;
     FixItMap fixIts;
     DiagnosticsMap diagnostics;
+
+    IndexData()
+        : references(&arena), symbols(&arena), symbolNames(&arena)
+    {}
+
+    // Like references[location] and symbolNames[name] but the new sets
+    // allocate from arena too
+    ArenaLocationSet &reference(const Location &location) { return locations(references, location); }
+    ArenaLocationSet &symbolName(const InternedString &name) { return locations(symbolNames, name); }
+
+    // Roughly what the maps hold
+    int64_t memoryUsage() const;
+private:
+    IndexData(const IndexData &);
+    IndexData &operator=(const IndexData &);
+
+    template <typename Container, typename Key>
+    ArenaLocationSet &locations(Container &map, const Key &key)
+    {
+        typename Container::iterator it = map.lower_bound(key);
+        if (it == map.end() || key < it->first)
+            it = map.insert(it, std::make_pair(key, ArenaLocationSet(&arena)));
+        return it->second;
+    }
 };
 
 class IndexerJob : public Job
@@ -26,7 +54,8 @@ public:
         Makefile = 0x01,
         Dirty = 0x02,
         Priorities = Dirty|Makefile,
-        IgnorePrintfFixits = 0x10
+        IgnorePrintfFixits = 0x10,
+        IndexCallbacks = 0x20 // index with clang_indexTranslationUnit instead of visiting the AST
     };
     IndexerJob(const shared_ptr<Project> &indexer, unsigned flags,
                const Path &input, const List<ByteArray> &args,
@@ -43,8 +72,15 @@ public:
     bool abortIfStarted();
     List<ByteArray> arguments() const { return mArgs; }
     time_t parseTime() const { return mParseTime; }
+    uint64_t peakMemory() const { return mPeakMemory; }
 private:
+    friend class IndexerWorker;
+
     bool parse();
+    bool shouldIndex(uint32_t fileId);
+    bool parseWithPreamble(List<const char*> clangArgs, int count);
+    bool buildPreamble(const Path &pch, const ByteArray &includes, List<const char*> clangArgs, int count,
+                       Set<uint32_t> &headers);
     bool visit();
     bool diagnose(int *errorCount);
 
@@ -57,17 +93,36 @@ private:
     }
     static Location createLocation(const CXCursor &cursor);
     ByteArray addNamePermutations(const CXCursor &cursor, const Location &location);
+    // What the names of a declaration's children are qualified with, its
+    // own name first and then its parents' one by one
+    struct NameScope {
+        ByteArray prefix; // "Parent::Child::"
+        CXCursorKind kind; // of the outermost one
+    };
+    const List<NameScope> &nameScopes(const CXCursor &cursor);
     static CXChildVisitResult indexVisitor(CXCursor cursor, CXCursor parent, CXClientData client_data);
+    // Feed indexVisitor what clang_indexTranslationUnit doesn't report
+    static CXChildVisitResult preprocessingVisitor(CXCursor cursor, CXCursor parent, CXClientData client_data);
+    static CXChildVisitResult bodyVisitor(CXCursor cursor, CXCursor parent, CXClientData client_data);
     static CXChildVisitResult verboseVisitor(CXCursor cursor, CXCursor, CXClientData userData);
     static CXChildVisitResult dumpVisitor(CXCursor cursor, CXCursor, CXClientData userData);
 
     static void inclusionVisitor(CXFile included_file, CXSourceLocation *include_stack,
                                  unsigned include_len, CXClientData client_data);
+    static void preambleInclusionVisitor(CXFile included_file, CXSourceLocation *include_stack,
+                                         unsigned include_len, CXClientData client_data);
 
-    bool handleCursor(const CXCursor &cursor, CXCursorKind kind, const Location &location);
+    static int abortQuery(CXClientData client_data, void *);
+    static CXIdxClientFile indexIncludedFile(CXClientData client_data, const CXIdxIncludedFileInfo *info);
+    static void indexDeclaration(CXClientData client_data, const CXIdxDeclInfo *info);
+    static void indexEntityReference(CXClientData client_data, const CXIdxEntityRefInfo *info);
+
+    // usr is looked up if it's 0
+    bool handleCursor(const CXCursor &cursor, CXCursorKind kind, const Location &location, const char *usr = 0);
     void handleReference(const CXCursor &cursor, CXCursorKind kind, const Location &loc,
-                         const CXCursor &reference, const CXCursor &parent);
+                         const CXCursor &reference, const CXCursor &parent, const char *referenceUsr = 0);
     void handleInclude(const CXCursor &cursor, CXCursorKind kind, const Location &location);
+    void handleInclude(const Location &location, CXFile includedFile, const ByteArray &name);
     Location findByUSR(const CXCursor &cursor, CXCursorKind kind, const Location &loc) const;
     void addOverriddenCursors(const CXCursor& cursor, const Location& location, List<CursorInfo*>& infos);
 
@@ -88,6 +143,13 @@ private:
     CXIndex mIndex;
 
     Map<ByteArray, uint32_t> mFileIds;
+    // by clang_hashCursor, entries that collide are told apart with
+    // clang_equalCursors
+    struct CachedNameScopes {
+        CXCursor cursor;
+        List<NameScope> scopes;
+    };
+    Map<unsigned, List<CachedNameScopes> > mNameScopes;
 
     ByteArray mClangLine;
 
@@ -97,7 +159,9 @@ private:
     bool mDump;
 
     time_t mParseTime;
+    uint64_t mPeakMemory; // what the unit used
     bool mStarted;
+    uint32_t mPreambleFileId; // the header the pch mUnit was parsed with was built from
 };
 
 #endif
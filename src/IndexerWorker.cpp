@@ -0,0 +1,400 @@
+#include "IndexerWorker.h"
+#include "IndexerJob.h"
+#include "MemoryMonitor.h"
+#include "MutexLocker.h"
+#include "PathRegistry.h"
+#include "Project.h"
+#include "RTags.h"
+#include "Serializer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+Path IndexerWorker::sCommand;
+int IndexerWorker::sMaxJobs = 0;
+uint64_t IndexerWorker::sMaxMemory = 0;
+Mutex IndexerWorker::sMutex;
+List<IndexerWorker::Process*> IndexerWorker::sIdle;
+FILE *IndexerWorker::sParentIn = 0;
+FILE *IndexerWorker::sParentOut = 0;
+bool IndexerWorker::sPreambles = false;
+
+template <> inline Serializer &operator<<(Serializer &s, const IndexData &t)
+{
+    s << t.references << t.symbols << t.symbolNames << t.dependencies
+      << t.message << t.usrs << t.fixIts << t.diagnostics;
+    return s;
+}
+
+// Reads a map of locations written by operator<<, with the sets in t's arena
+template <typename Key, typename Container>
+static inline void readLocations(Deserializer &s, IndexData &t, Container &map,
+                                 ArenaLocationSet &(IndexData::*locations)(const Key &))
+{
+    int size;
+    s >> size;
+    map.clear();
+    Key key;
+    for (int i=0; i<size; ++i) {
+        s >> key;
+        s >> (t.*locations)(key);
+    }
+}
+
+template <> inline Deserializer &operator>>(Deserializer &s, IndexData &t)
+{
+    readLocations(s, t, t.references, &IndexData::reference);
+    s >> t.symbols;
+    readLocations(s, t, t.symbolNames, &IndexData::symbolName);
+    s >> t.dependencies >> t.message >> t.usrs >> t.fixIts >> t.diagnostics;
+    return s;
+}
+
+void IndexerWorker::init(const Path &command, int maxJobs, uint64_t maxMemory)
+{
+    // writing to a worker that just crashed shouldn't take us down with it
+    signal(SIGPIPE, SIG_IGN);
+    sCommand = command;
+    sMaxJobs = maxJobs;
+    sMaxMemory = maxMemory;
+}
+
+void IndexerWorker::cleanup()
+{
+    List<Process*> idle;
+    {
+        MutexLocker lock(&sMutex);
+        std::swap(idle, sIdle);
+    }
+    for (int i=0; i<idle.size(); ++i)
+        finish(idle.at(i));
+}
+
+bool IndexerWorker::writeMessage(FILE *f, char type, const ByteArray &payload)
+{
+    const int size = payload.size();
+    return (fwrite(&type, sizeof(type), 1, f) == 1
+            && fwrite(&size, sizeof(size), 1, f) == 1
+            && (!size || fwrite(payload.constData(), size, 1, f) == 1)
+            && !fflush(f));
+}
+
+bool IndexerWorker::readMessage(FILE *f, char &type, ByteArray &payload)
+{
+    int size;
+    if (fread(&type, sizeof(type), 1, f) != 1 || fread(&size, sizeof(size), 1, f) != 1 || size < 0)
+        return false;
+    payload = ByteArray(size, '\0');
+    return !size || fread(payload.data(), size, 1, f) == 1;
+}
+
+IndexerWorker::Process *IndexerWorker::spawn()
+{
+    // the lock keeps other workers from inheriting these before they're
+    // close-on-exec, a worker only sees EOF if it's the only one with its pipe
+    MutexLocker lock(&sMutex);
+    int in[2], out[2];
+    if (::pipe(in) == -1)
+        return 0;
+    if (::pipe(out) == -1) {
+        ::close(in[0]);
+        ::close(in[1]);
+        return 0;
+    }
+    for (int i=0; i<2; ++i) {
+        ::fcntl(in[i], F_SETFD, FD_CLOEXEC);
+        ::fcntl(out[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    const pid_t pid = ::fork();
+    if (!pid) {
+        ::dup2(in[0], STDIN_FILENO);
+        ::dup2(out[1], STDOUT_FILENO);
+        ::execl(sCommand.constData(), sCommand.constData(), "--indexer-worker", static_cast<char*>(0));
+        ::_exit(1);
+    }
+    ::close(in[0]);
+    ::close(out[1]);
+    if (pid == -1) {
+        error() << "Can't fork indexer worker" << strerror(errno);
+        ::close(in[1]);
+        ::close(out[0]);
+        return 0;
+    }
+    Process *process = new Process;
+    process->pid = pid;
+    process->in = fdopen(in[1], "w");
+    process->out = fdopen(out[0], "r");
+    process->jobs = 0;
+    return process;
+}
+
+int IndexerWorker::finish(Process *process)
+{
+    // closing its stdin makes it exit
+    fclose(process->in);
+    fclose(process->out);
+    int status = 0;
+    pid_t ret;
+    eintrwrap(ret, ::waitpid(process->pid, &status, 0));
+    delete process;
+    return status;
+}
+
+IndexerWorker::Process *IndexerWorker::acquire()
+{
+    {
+        MutexLocker lock(&sMutex);
+        if (!sIdle.isEmpty()) {
+            Process *process = sIdle.back();
+            sIdle.pop_back();
+            return process;
+        }
+    }
+    return spawn();
+}
+
+void IndexerWorker::release(Process *process, uint64_t memory)
+{
+    if (++process->jobs >= sMaxJobs || memory > sMaxMemory) {
+        warning() << "Recycling indexer worker" << process->pid << "after" << process->jobs << "jobs using"
+                  << memory / (1024 * 1024) << "mb";
+        finish(process);
+        return;
+    }
+    MutexLocker lock(&sMutex);
+    sIdle.append(process);
+}
+
+void IndexerWorker::index(IndexerJob *job)
+{
+    IndexData &data = *job->mData;
+    Process *process = acquire();
+    ByteArray payload;
+    {
+        Serializer out(payload);
+        out << job->mPath << job->mArgs << job->mFlags << PreambleCache::isEnabled();
+    }
+    // the pch the worker is building, if it doesn't finish no one else
+    // would ever get to build it
+    ByteArray buildKey;
+    Path buildPch;
+    bool ok = process && writeMessage(process->in, Job, payload);
+    while (ok) {
+        char type;
+        ok = readMessage(process->out, type, payload);
+        if (!ok)
+            break;
+        if (job->isAborted()) {
+            // the worker asks us about every file it sees, no need to wait
+            // for the rest of a unit no one wants
+            ::kill(process->pid, SIGKILL);
+            finish(process);
+            if (!buildKey.isEmpty()) {
+                PreambleCache::remove(buildKey);
+                Path::rm(buildPch);
+            }
+            return;
+        }
+        Deserializer in(payload.constData(), payload.size());
+        ByteArray reply;
+        Serializer out(reply);
+        switch (type) {
+        case FileId: {
+            Path path;
+            in >> path;
+            out << Location::insertFile(path);
+            ok = writeMessage(process->in, FileId, reply);
+            break; }
+        case VisitFile: {
+            uint32_t fileId;
+            in >> fileId;
+            out << job->shouldIndex(fileId);
+            ok = writeMessage(process->in, VisitFile, reply);
+            break; }
+        case AcquirePreamble: {
+            ByteArray key;
+            in >> key;
+            Path pch;
+            Set<uint32_t> headers;
+            const PreambleCache::State state = PreambleCache::acquire(key, pch, headers);
+            if (state == PreambleCache::Build) {
+                buildKey = key;
+                buildPch = pch;
+            }
+            out << static_cast<int>(state) << pch << headers;
+            ok = writeMessage(process->in, AcquirePreamble, reply);
+            break; }
+        case FinishPreamble: {
+            ByteArray key;
+            Path pch;
+            bool built;
+            Set<uint32_t> headers;
+            in >> key >> pch >> built >> headers;
+            if (key == buildKey)
+                buildKey.clear();
+            out << PreambleCache::finish(key, pch, built, headers);
+            ok = writeMessage(process->in, FinishPreamble, reply);
+            break; }
+        case RemovePreamble: {
+            ByteArray key;
+            in >> key;
+            PreambleCache::remove(key);
+            ok = writeMessage(process->in, RemovePreamble, reply);
+            break; }
+        case Visited: {
+            Set<uint32_t> fileIds;
+            in >> fileIds;
+            shared_ptr<Project> project = job->project();
+            out << (project && project->isVisited(fileIds));
+            ok = writeMessage(process->in, Visited, reply);
+            break; }
+        case Done: {
+            uint64_t memory;
+            in >> data >> job->mParseTime >> job->mPeakMemory >> memory;
+            release(process, memory);
+            return; }
+        default:
+            error() << "Unexpected message" << type << "from indexer worker" << process->pid;
+            ok = false;
+            break;
+        }
+    }
+
+    ByteArray reason = "couldn't start indexer worker";
+    if (process) {
+        const int status = finish(process);
+        if (WIFSIGNALED(status)) {
+            reason = ByteArray::format<64>("indexer worker crashed with signal %d", WTERMSIG(status));
+        } else {
+            reason = ByteArray::format<64>("indexer worker exited with %d", WEXITSTATUS(status));
+        }
+    }
+    if (!buildKey.isEmpty()) // it may well be what took the worker down
+        PreambleCache::finish(buildKey, buildPch, false, Set<uint32_t>());
+    data.dependencies[job->mFileId].insert(job->mFileId);
+    data.message = ByteArray::format<1024>("%s error in %sms. (%s)%s",
+                                           job->mPath.toTilde().constData(),
+                                           ByteArray::number(job->mTimer.elapsed()).constData(),
+                                           reason.constData(),
+                                           job->mFlags & IndexerJob::Dirty ? " (dirty)" : "");
+}
+
+int IndexerWorker::exec()
+{
+    // messages go over the original stdout, anything else that's printed
+    // ends up on stderr
+    const int fd = ::dup(STDOUT_FILENO);
+    ::dup2(STDERR_FILENO, STDOUT_FILENO);
+    sParentOut = fd == -1 ? 0 : fdopen(fd, "w");
+    if (!sParentOut)
+        return 1;
+    sParentIn = stdin;
+    PathRegistry::setResolver(resolveFileId);
+
+    for (;;) {
+        char type;
+        ByteArray payload;
+        if (!readMessage(sParentIn, type, payload))
+            return 0; // rdm is done with us
+        if (type != Job)
+            return 1;
+        Path path;
+        List<ByteArray> args;
+        unsigned flags;
+        Deserializer in(payload.constData(), payload.size());
+        in >> path >> args >> flags >> sPreambles;
+
+        shared_ptr<IndexerJob> job(new IndexerJob(shared_ptr<Project>(), flags, path, args));
+        job->execute();
+
+        payload.clear();
+        Serializer out(payload);
+        out << *job->mData << job->mParseTime << job->mPeakMemory << MemoryMonitor::usage();
+        if (!writeMessage(sParentOut, Done, payload))
+            return 1;
+    }
+}
+
+bool IndexerWorker::request(char type, const ByteArray &payload, ByteArray &reply)
+{
+    char replyType;
+    return (writeMessage(sParentOut, type, payload)
+            && readMessage(sParentIn, replyType, reply)
+            && replyType == type);
+}
+
+uint32_t IndexerWorker::resolveFileId(const Path &path)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << path;
+    uint32_t fileId = 0;
+    if (request(FileId, payload, reply)) {
+        Deserializer in(reply.constData(), reply.size());
+        in >> fileId;
+    }
+    return fileId;
+}
+
+bool IndexerWorker::visitFile(uint32_t fileId)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << fileId;
+    bool ret = false;
+    if (request(VisitFile, payload, reply)) {
+        Deserializer in(reply.constData(), reply.size());
+        in >> ret;
+    }
+    return ret;
+}
+
+PreambleCache::State IndexerWorker::acquirePreamble(const ByteArray &key, Path &pch, Set<uint32_t> &headers)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << key;
+    int state = PreambleCache::Unavailable;
+    if (request(AcquirePreamble, payload, reply)) {
+        Deserializer in(reply.constData(), reply.size());
+        in >> state >> pch >> headers;
+    }
+    return static_cast<PreambleCache::State>(state);
+}
+
+bool IndexerWorker::finishPreamble(const ByteArray &key, const Path &pch, bool ok, const Set<uint32_t> &headers)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << key << pch << ok << headers;
+    bool ret = false;
+    if (request(FinishPreamble, payload, reply)) {
+        Deserializer in(reply.constData(), reply.size());
+        in >> ret;
+    }
+    return ret;
+}
+
+void IndexerWorker::removePreamble(const ByteArray &key)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << key;
+    request(RemovePreamble, payload, reply);
+}
+
+bool IndexerWorker::isVisited(const Set<uint32_t> &fileIds)
+{
+    ByteArray payload, reply;
+    Serializer out(payload);
+    out << fileIds;
+    bool ret = false;
+    if (request(Visited, payload, reply)) {
+        Deserializer in(reply.constData(), reply.size());
+        in >> ret;
+    }
+    return ret;
+}
@@ -0,0 +1,90 @@
+#ifndef IndexerWorker_h
+#define IndexerWorker_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "Mutex.h"
+#include "Path.h"
+#include "PreambleCache.h"
+#include "Set.h"
+#include <stdio.h>
+#include <sys/types.h>
+
+class IndexerJob;
+
+/*
+  Runs IndexerJobs in separate rdm processes (rdm --indexer-worker) so a
+  crash or a runaway allocation in libclang only takes down the worker and
+  the memory clang holds on to goes away with it.
+
+  A job's source file and arguments are sent to an idle worker which parses
+  and visits the unit the same way rdm would and sends the IndexData back.
+  While it runs the worker asks rdm for the ids of the files it sees and
+  whether it should index them so ids and header ownership stay rdm's.
+  With --preamble-cache the PreambleCache stays rdm's too, workers ask it
+  for the pchs of their units, build the ones it hands them and check that
+  the headers in a pch have been visited the same way.
+  Workers are replaced after maxJobs jobs or once they use more than
+  maxMemory bytes.
+
+  Messages in both directions are a type, a length and a serialized payload.
+*/
+
+class IndexerWorker
+{
+public:
+    static void init(const Path &command, int maxJobs, uint64_t maxMemory);
+    static bool isEnabled() { return !sCommand.isEmpty(); }
+    static void cleanup();
+
+    // rdm side, fills in job's data
+    static void index(IndexerJob *job);
+
+    // worker side
+    static int exec();
+    static bool isWorker() { return sParentIn; }
+    static bool visitFile(uint32_t fileId);
+    static bool sharesPreambles() { return sPreambles; }
+    static PreambleCache::State acquirePreamble(const ByteArray &key, Path &pch, Set<uint32_t> &headers);
+    static bool finishPreamble(const ByteArray &key, const Path &pch, bool ok, const Set<uint32_t> &headers);
+    static void removePreamble(const ByteArray &key);
+    static bool isVisited(const Set<uint32_t> &fileIds);
+private:
+    struct Process {
+        pid_t pid;
+        FILE *in, *out;
+        int jobs;
+    };
+
+    enum MessageType {
+        Job = 'J',
+        FileId = 'F',
+        VisitFile = 'V',
+        AcquirePreamble = 'A',
+        FinishPreamble = 'B',
+        RemovePreamble = 'R',
+        Visited = 'S',
+        Done = 'D'
+    };
+
+    static Process *acquire();
+    static void release(Process *process, uint64_t memory);
+    static Process *spawn();
+    static int finish(Process *process);
+    static uint32_t resolveFileId(const Path &path);
+
+    static bool writeMessage(FILE *f, char type, const ByteArray &payload);
+    static bool readMessage(FILE *f, char &type, ByteArray &payload);
+    static bool request(char type, const ByteArray &payload, ByteArray &reply);
+
+    static Path sCommand;
+    static int sMaxJobs;
+    static uint64_t sMaxMemory;
+    static Mutex sMutex;
+    static List<Process*> sIdle;
+
+    static FILE *sParentIn, *sParentOut;
+    static bool sPreambles;
+};
+
+#endif
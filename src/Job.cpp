@@ -10,7 +10,7 @@
 // static int active = 0;
 
 Job::Job(const QueryMessage &query, unsigned jobFlags, const shared_ptr<Project> &proj)
-    : mAborted(false), mId(-1), mJobFlags(jobFlags), mQueryFlags(query.flags()), mProject(proj),
+    : mAborted(0), mId(-1), mJobFlags(jobFlags), mQueryFlags(query.flags()), mProject(proj),
       mPathFilters(0), mPathFiltersRegExp(0), mMax(query.max()), mConnection(0)
 {
     const List<ByteArray> &pathFilters = query.pathFilters();
@@ -29,7 +29,7 @@ Job::Job(const QueryMessage &query, unsigned jobFlags, const shared_ptr<Project>
 }
 
 Job::Job(unsigned jobFlags, const shared_ptr<Project> &proj)
-    : mAborted(false), mId(-1), mJobFlags(jobFlags), mQueryFlags(0), mProject(proj), mPathFilters(0),
+    : mAborted(0), mId(-1), mJobFlags(jobFlags), mQueryFlags(0), mProject(proj), mPathFilters(0),
       mPathFiltersRegExp(0), mMax(-1), mConnection(0)
 {
 }
@@ -115,6 +115,30 @@ bool Job::write(const Location &location, unsigned flags)
     return true;
 }
 
+bool Job::write(const List<Location> &locations, unsigned flags)
+{
+    // Rendered a batch at a time so a job that gets aborted, e.g. because
+    // the client went away, doesn't render all of them for nothing
+    enum { BatchSize = 256 };
+    const unsigned kf = keyFlags();
+    List<Location> batch;
+    ByteArray keys;
+    for (int i=0; i<locations.size(); i += BatchSize) {
+        batch.assign(locations.begin() + i, locations.begin() + std::min<int>(i + BatchSize, locations.size()));
+        keys.clear();
+        Location::appendKeys(batch, kf, keys);
+        const char *data = keys.constData();
+        const char *end = data + keys.size();
+        while (data < end) {
+            const char *eol = static_cast<const char*>(memchr(data, '\n', end - data));
+            if (!write(ByteArray(data, eol - data), flags))
+                return false;
+            data = eol + 1;
+        }
+    }
+    return true;
+}
+
 bool Job::write(const CursorInfo &ci, unsigned ciflags)
 {
     if (ci.isNull())
@@ -39,6 +39,7 @@ public:
     bool write(const ByteArray &out, unsigned flags = NoWriteFlags);
     bool write(const CursorInfo &info, unsigned flags = NoWriteFlags);
     bool write(const Location &location, unsigned flags = NoWriteFlags);
+    bool write(const List<Location> &locations, unsigned flags = NoWriteFlags);
 
     template <int StaticBufSize> bool write(unsigned flags, const char *format, ...);
     template <int StaticBufSize> bool write(const char *format, ...);
@@ -53,11 +54,13 @@ public:
     virtual void run();
     virtual void execute() = 0;
     void run(Connection *connection);
-    bool isAborted() const { MutexLocker lock(&mMutex); return mAborted; }
-    void abort() { MutexLocker lock(&mMutex); mAborted = true; }
+    // No locking, visitors check this for every cursor. A running job sees
+    // abort() the next time it checks
+    bool isAborted() const { return mAborted; }
+    void abort() { __sync_lock_test_and_set(&mAborted, 1); }
 protected:
     mutable Mutex mMutex;
-    bool mAborted;
+    volatile int mAborted; // only ever goes from 0 to 1
 private:
     bool writeRaw(const ByteArray &out, unsigned flags);
     int mId;
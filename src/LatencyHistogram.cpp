@@ -0,0 +1,53 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::add(int ms)
+{
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && ms >= limit(bucket))
+        ++bucket;
+    __sync_add_and_fetch(&mBuckets[bucket], 1);
+    int max = mMax;
+    while (ms > max && !__sync_bool_compare_and_swap(&mMax, max, ms))
+        max = mMax;
+}
+
+void LatencyHistogram::clear()
+{
+    for (int i=0; i<BucketCount; ++i)
+        mBuckets[i] = 0;
+    mMax = 0;
+}
+
+int LatencyHistogram::count() const
+{
+    int ret = 0;
+    for (int i=0; i<BucketCount; ++i)
+        ret += mBuckets[i];
+    return ret;
+}
+
+int LatencyHistogram::percentile(int percent) const
+{
+    const int total = count();
+    if (!total)
+        return 0;
+    const int64_t wanted = (static_cast<int64_t>(total) * percent + 99) / 100;
+    int64_t seen = 0;
+    for (int i=0; i<BucketCount - 1; ++i) {
+        seen += mBuckets[i];
+        if (seen >= wanted)
+            return limit(i);
+    }
+    return mMax;
+}
+
+ByteArray LatencyHistogram::toString() const
+{
+    return ByteArray::format<128>("%d waits, 50%% under %dms, 99%% under %dms, max %dms",
+                                  count(), percentile(50), percentile(99), max());
+}
@@ -0,0 +1,36 @@
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include "ByteArray.h"
+
+/*
+  Counts durations in power of two millisecond buckets, under 1ms, under
+  2ms and so on up to a second and a bucket for everything longer. Adding
+  is lock free so it can sit on hot paths.
+*/
+
+class LatencyHistogram
+{
+public:
+    enum { BucketCount = 12 };
+
+    LatencyHistogram();
+
+    void add(int ms);
+    void clear();
+
+    int count() const;
+    int count(int bucket) const { return mBuckets[bucket]; }
+    int max() const { return mMax; }
+    // The upper bound of bucket, -1 for the last one
+    static int limit(int bucket) { return bucket == BucketCount - 1 ? -1 : 1 << bucket; }
+    // The upper bound of the bucket the percentile falls in
+    int percentile(int percent) const;
+
+    ByteArray toString() const;
+private:
+    volatile int mBuckets[BucketCount];
+    volatile int mMax;
+};
+
+#endif
@@ -5,7 +5,7 @@
 #include <algorithm>
 #include <assert.h>
 
-template <typename T> class Set;
+template <typename T, typename Alloc = std::allocator<T> > class Set;
 
 template <typename T>
 class List : public std::vector<T>
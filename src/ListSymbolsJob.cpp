@@ -11,66 +11,88 @@ enum {
 
 ListSymbolsJob::ListSymbolsJob(const QueryMessage &query, const shared_ptr<Project> &proj)
     : Job(query, query.flags() & QueryMessage::ElispList ? ElispFlags : DefaultFlags, proj),
-      string(query.query())
+      string(query.query()), max(query.max())
 {
 }
 
-void ListSymbolsJob::execute()
+class ListSymbolsVisitor
 {
+public:
+    ListSymbolsVisitor(ListSymbolsJob *job, const Project *project, int max)
+        : mJob(job), mProject(project), mMax(max), mCount(0), mVisited(0),
+          mHasFilter(job->hasFilter()),
+          mSkipParentheses(job->queryFlags() & QueryMessage::SkipParentheses),
+          mElispList(job->queryFlags() & QueryMessage::ElispList)
+    {}
+
+    bool operator()(const InternedString &name)
+    {
+        if (!(++mVisited % 10) && mJob->isAborted())
+            return false;
+        const ByteArray &entry = name.string();
+        if (mSkipParentheses && entry.contains('('))
+            return true;
+        if (mHasFilter) {
+            Set<uint32_t> files;
+            mProject->symbolNameFiles(name, files);
+            bool ok = false;
+            for (Set<uint32_t>::const_iterator i = files.begin(); i != files.end(); ++i) {
+                if (mJob->filter(Location::path(*i))) {
+                    ok = true;
+                    break;
+                }
+            }
+            if (!ok)
+                return true;
+        }
+        if (mElispList) {
+            mJob->write(entry);
+        } else {
+            out.append(entry);
+        }
+        return mMax == -1 || ++mCount < mMax;
+    }
+
     List<ByteArray> out;
-    const bool hasFilter = Job::hasFilter();
+private:
+    ListSymbolsJob *mJob;
+    const Project *mProject;
+    const int mMax;
+    int mCount, mVisited;
+    const bool mHasFilter, mSkipParentheses, mElispList;
+};
+
+void ListSymbolsJob::execute()
+{
     const unsigned queryFlags = Job::queryFlags();
-    const bool skipParentheses = queryFlags & QueryMessage::SkipParentheses;
     const bool elispList = queryFlags & QueryMessage::ElispList;
 
     if (elispList)
         write("(list", IgnoreMax|DontQuote);
     shared_ptr<Project> proj = project();
+    List<ByteArray> out;
     if (proj) {
+        proj->loadSymbolNameTrie();
         Scope<const SymbolNameMap&> scope = proj->lockSymbolNamesForRead();
         if (scope.isNull())
             return;
-        const SymbolNameMap &map = scope.data();
-        SymbolNameMap::const_iterator it = string.isEmpty() ? map.begin() : map.lower_bound(string);
-        int count = 0;
-        while (it != map.end()) {
-            const ByteArray &entry = it->first;
-            if (!string.isEmpty() && !entry.startsWith(string))
-                break;
-            if (!skipParentheses || !entry.contains('(')) {
-                bool ok = true;
-                if (hasFilter) {
-                    ok = false;
-                    const Set<Location> &locations = it->second;
-                    for (Set<Location>::const_iterator i = locations.begin(); i != locations.end(); ++i) {
-                        if (filter(i->path())) {
-                            ok = true;
-                            break;
-                        }
-                    }
-                }
-                if (ok) {
-                    if (elispList) {
-                        write(entry);
-                    } else {
-                        out.append(entry);
-                    }
-                }
-            }
-            ++it;
-            if (!(++count % 10) && isAborted())
-                return;
-        }
+        // The trie visits names in sorted order so we can stop as soon as
+        // we have max of them
+        unsigned flags = SymbolNameTrie::NoFlag;
+        if (queryFlags & QueryMessage::MatchCaseInsensitive)
+            flags |= SymbolNameTrie::CaseInsensitive;
+        if (queryFlags & QueryMessage::ReverseSort)
+            flags |= SymbolNameTrie::Reverse;
+        ListSymbolsVisitor visitor(this, proj.get(), max);
+        proj->symbolNameTrie().visit(string, flags, visitor);
+        if (isAborted())
+            return;
+        out.swap(visitor.out);
     }
 
     if (elispList) {
         write(")", IgnoreMax|DontQuote);
     } else {
-        if (queryFlags & QueryMessage::ReverseSort) {
-            std::sort(out.begin(), out.end(), std::greater<ByteArray>());
-        } else {
-            std::sort(out.begin(), out.end());
-        }
         const int count = out.size();
         for (int i=0; i<count; ++i) {
             write(out.at(i));
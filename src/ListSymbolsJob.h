@@ -14,6 +14,7 @@ protected:
     virtual void execute();
 private:
     const ByteArray string;
+    const int max;
 };
 
 #endif
@@ -1,106 +1,79 @@
 #include "Location.h"
+#include "FileCache.h"
 #include "Server.h"
 #include "RTags.h"
-Map<Path, uint32_t> Location::sPathsToIds;
-Map<uint32_t, Path> Location::sIdsToPaths;
-uint32_t Location::sLastId = 0;
-ReadWriteLock Location::sLock;
 
-ByteArray Location::key(unsigned flags) const
+// contents is only needed for ShowContext and ShowLineNumbers
+static inline void appendKey(ByteArray &out, const Path &path, uint32_t offset, unsigned flags,
+                             const FileCache::Contents *contents)
 {
-    if (isNull())
-        return ByteArray();
-    int extra = 0;
-    const int off = offset();
-    int line = 0, col = 0;
+    out.append(path);
+    char buf[32];
+    int line, col;
     if (flags & Location::Padded) {
-        extra = 7;
-    } else if (flags & Location::ShowLineNumbers && convertOffset(line, col)) {
-        extra = RTags::digits(line) + RTags::digits(col) + 3;
+        out.append(buf, snprintf(buf, sizeof(buf), ",%06d", offset));
+    } else if (flags & Location::ShowLineNumbers && contents && contents->convertOffset(offset, line, col)) {
+        out.append(buf, snprintf(buf, sizeof(buf), ":%d:%d:", line, col));
     } else {
-        flags &= ~Location::ShowLineNumbers;
-        extra = RTags::digits(off) + 1;
+        out.append(buf, snprintf(buf, sizeof(buf), ",%d", offset));
     }
-    ByteArray ctx;
     if (flags & Location::ShowContext) {
-        ctx += '\t';
-        ctx += context();
-        extra += ctx.size();
+        out.append('\t');
+        if (contents)
+            out.append(contents->line(offset));
     }
+}
 
-    const Path p = path();
-
-    ByteArray ret(p.size() + extra, '0');
-
-    if (flags & Location::Padded) {
-        snprintf(ret.data(), ret.size() + extra + 1, "%s,%06d%s", p.constData(),
-                 off, ctx.constData());
-    } else if (flags & Location::ShowLineNumbers) {
-        snprintf(ret.data(), ret.size() + extra + 1, "%s:%d:%d:%s", p.constData(),
-                 line, col, ctx.constData());
-    } else {
-        snprintf(ret.data(), ret.size() + extra + 1, "%s,%d%s", p.constData(),
-                 off, ctx.constData());
-    }
+ByteArray Location::key(unsigned flags) const
+{
+    if (isNull())
+        return ByteArray();
+    shared_ptr<const FileCache::Contents> contents;
+    if (flags & (ShowContext|ShowLineNumbers))
+        contents = FileCache::contents(fileId());
+    ByteArray ret;
+    appendKey(ret, path(), offset(), flags, contents.get());
     return ret;
 }
 
-ByteArray Location::context(int *column) const
+void Location::appendKeys(const List<Location> &locations, unsigned flags, ByteArray &out, const char *indent)
 {
-    const uint32_t off = offset();
-    uint32_t o = off;
-    Path p = path();
-    FILE *f = fopen(p.constData(), "r");
-    if (f && !fseek(f, off, SEEK_SET)) {
-        while (o > 0) {
-            const char ch = fgetc(f);
-            if (ch == '\n' && o != off)
-                break;
-            if (fseek(f, --o, SEEK_SET) == -1) {
-                fclose(f);
-                return ByteArray();
-            }
+    const int indentLength = strlen(indent);
+    const int count = locations.size();
+    uint32_t fileId = 0;
+    Path path;
+    shared_ptr<const FileCache::Contents> contents;
+    out.reserve(out.size() + (count * (indentLength + (flags & ShowContext ? 160 : 80))));
+    for (int i=0; i<count; ++i) {
+        const Location &location = locations.at(i);
+        if (location.isNull())
+            continue;
+        if (location.fileId() != fileId) {
+            fileId = location.fileId();
+            path = Location::path(fileId);
+            if (flags & (ShowContext|ShowLineNumbers))
+                contents = FileCache::contents(fileId);
         }
-        char buf[1024] = { '\0' };
-        const int len = RTags::readLine(f, buf, 1023);
-        fclose(f);
-        if (column)
-            *column = (off - o - 1);
-        return ByteArray(buf, len);
+        out.append(indent, indentLength);
+        appendKey(out, path, location.offset(), flags, contents.get());
+        out.append('\n');
     }
-    if (f)
-        fclose(f);
-    return ByteArray();
+}
+
+ByteArray Location::context(int *column) const
+{
+    const shared_ptr<const FileCache::Contents> contents = FileCache::contents(fileId());
+    if (!contents)
+        return ByteArray();
+    return contents->line(offset(), column);
 }
 
 bool Location::convertOffset(int &line, int &col) const
 {
-    const uint32_t off = offset();
-    Path p = path();
-    FILE *f = fopen(p.constData(), "r");
-    if (!f) {
+    const shared_ptr<const FileCache::Contents> contents = FileCache::contents(fileId());
+    if (!contents) {
         line = col = -1;
         return false;
     }
-    line = 1;
-    int last = 0;
-    uint32_t idx = 0;
-    while (true) {
-        const int lineLen = RTags::readLine(f);
-        if (lineLen == -1) {
-            col = line = -1;
-            fclose(f);
-            return false;
-        }
-        idx += lineLen + 1;
-        // printf("lineStart %d offset %d last %d lineLen %d\n", idx, offset, last, lineLen);
-        if (idx > off) {
-            col = off - last + 1;
-            break;
-        }
-        last = idx;
-        ++line;
-    }
-    fclose(f);
-    return true;
+    return contents->convertOffset(offset(), line, col);
 }
@@ -2,12 +2,11 @@
 #define Location_h
 
 #include "ByteArray.h"
+#include "List.h"
 #include "Log.h"
 #include "Path.h"
-#include "ReadLocker.h"
-#include "ReadWriteLock.h"
+#include "PathRegistry.h"
 #include "Serializer.h"
-#include "WriteLocker.h"
 #include <assert.h>
 #include <clang-c/Index.h>
 #include <stdio.h>
@@ -55,45 +54,25 @@ public:
 
     static inline uint32_t fileId(const Path &path)
     {
-        ReadLocker lock(&sLock);
-        return sPathsToIds.value(path);
+        return PathRegistry::fileId(path);
     }
-    static inline Path path(uint32_t id)
+    static inline const Path &path(uint32_t id)
     {
-        ReadLocker lock(&sLock);
-        return sIdsToPaths.value(id);
+        return PathRegistry::path(id);
     }
 
     static inline uint32_t insertFile(const Path &path)
     {
-        uint32_t ret;
-        {
-            WriteLocker lock(&sLock);
-            uint32_t &id = sPathsToIds[path];
-            if (!id) {
-                id = ++sLastId;
-                sIdsToPaths[id] = path;
-            }
-            ret = id;
-        }
-
-        return ret;
+        return PathRegistry::insert(path);
     }
 
     inline uint32_t fileId() const { return uint32_t(mData); }
     inline uint32_t offset() const { return uint32_t(mData >> 32); }
 
-    inline Path path() const
-    {
-        if (mCachedPath.isEmpty()) {
-            ReadLocker lock(&sLock);
-            mCachedPath = sIdsToPaths.value(fileId());
-        }
-        return mCachedPath;
-    }
+    inline const Path &path() const { return PathRegistry::path(fileId()); }
     inline bool isNull() const { return !mData; }
     inline bool isValid() const { return mData; }
-    inline void clear() { mData = 0; mCachedPath.clear(); }
+    inline void clear() { mData = 0; }
     inline bool operator==(const ByteArray &str) const
     {
         const Location fromPath = Location::fromPathAndOffset(str);
@@ -150,6 +129,10 @@ public:
     };
 
     ByteArray key(unsigned flags = NoFlag) const;
+    // Appends the keys of locations to out, each on its own line after
+    // indent. Consecutive locations in the same file share one path lookup
+    // and one FileCache lookup.
+    static void appendKeys(const List<Location> &locations, unsigned flags, ByteArray &out, const char *indent = "");
     bool toKey(char buf[8]) const
     {
         if (isNull()) {
@@ -218,30 +201,16 @@ public:
     }
     static Map<uint32_t, Path> idsToPaths()
     {
-        ReadLocker lock(&sLock);
-        return sIdsToPaths;
+        return PathRegistry::idsToPaths();
     }
     static Map<Path, uint32_t> pathsToIds()
     {
-        ReadLocker lock(&sLock);
-        return sPathsToIds;
+        return PathRegistry::pathsToIds();
     }
     static void init(const Map<Path, uint32_t> &pathsToIds)
     {
-        WriteLocker lock(&sLock);
-        sPathsToIds = pathsToIds;
-        sLastId = sPathsToIds.size();
-        for (Map<Path, uint32_t>::const_iterator it = sPathsToIds.begin(); it != sPathsToIds.end(); ++it) {
-            assert(it->second <= it->second);
-            sIdsToPaths[it->second] = it->first;
-        }
+        PathRegistry::init(pathsToIds);
     }
-private:
-    static Map<Path, uint32_t> sPathsToIds;
-    static Map<uint32_t, Path> sIdsToPaths;
-    static uint32_t sLastId;
-    static ReadWriteLock sLock;
-    mutable Path mCachedPath;
 };
 
 template <> inline int fixedSize(const Location &)
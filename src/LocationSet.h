@@ -0,0 +1,296 @@
+#ifndef LocationSet_h
+#define LocationSet_h
+
+#include "Location.h"
+#include "Log.h"
+#include "Serializer.h"
+#include "Set.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  A sorted set of Locations stored as their raw 64-bit data. Up to
+  InlineCount locations are kept inside the object itself so the common case
+  of a cursor with one or two targets/references doesn't allocate at all.
+  Larger sets move to a single heap array. Iteration order is the same as
+  Set<Location>'s. Iterators dereference to Locations by value.
+*/
+
+class LocationSet
+{
+public:
+    enum { InlineCount = 2 };
+
+    class const_iterator
+    {
+    public:
+        const_iterator(const uint64_t *data = 0)
+            : mData(data)
+        {}
+
+        Location operator*() const { return Location(*mData); }
+        // operator-> has to return something that has an operator-> itself
+        class Pointer
+        {
+        public:
+            Pointer(uint64_t data) : mLocation(data) {}
+            const Location *operator->() const { return &mLocation; }
+        private:
+            Location mLocation;
+        };
+        Pointer operator->() const { return Pointer(*mData); }
+
+        const_iterator &operator++() { ++mData; return *this; }
+        const_iterator operator++(int) { return const_iterator(mData++); }
+        const_iterator &operator--() { --mData; return *this; }
+        const_iterator operator--(int) { return const_iterator(mData--); }
+
+        bool operator==(const const_iterator &other) const { return mData == other.mData; }
+        bool operator!=(const const_iterator &other) const { return mData != other.mData; }
+    private:
+        const uint64_t *mData;
+    };
+
+    LocationSet()
+        : mSize(0), mCapacity(InlineCount)
+    {}
+
+    LocationSet(const LocationSet &other)
+        : mSize(0), mCapacity(InlineCount)
+    {
+        assign(other);
+    }
+
+    LocationSet(const Set<Location> &locations)
+        : mSize(0), mCapacity(InlineCount)
+    {
+        reserve(locations.size());
+        for (Set<Location>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+            data()[mSize++] = it->mData;
+        }
+    }
+
+    ~LocationSet()
+    {
+        if (isHeap())
+            free(mHeap);
+    }
+
+    LocationSet &operator=(const LocationSet &other)
+    {
+        if (this != &other)
+            assign(other);
+        return *this;
+    }
+
+    const_iterator begin() const { return const_iterator(data()); }
+    const_iterator end() const { return const_iterator(data() + mSize); }
+
+    int size() const { return mSize; }
+    bool isEmpty() const { return !mSize; }
+
+    void clear()
+    {
+        if (isHeap())
+            free(mHeap);
+        mSize = 0;
+        mCapacity = InlineCount;
+    }
+
+    bool contains(const Location &location) const
+    {
+        const int idx = lowerBound(location);
+        return idx < mSize && data()[idx] == location.mData;
+    }
+
+    bool insert(const Location &location)
+    {
+        const int idx = lowerBound(location);
+        uint64_t *d = data();
+        if (idx < mSize && d[idx] == location.mData)
+            return false;
+        if (mSize == mCapacity) {
+            reserve(mCapacity * 2);
+            d = data();
+        }
+        memmove(d + idx + 1, d + idx, (mSize - idx) * sizeof(uint64_t));
+        d[idx] = location.mData;
+        ++mSize;
+        return true;
+    }
+
+    bool remove(const Location &location)
+    {
+        const int idx = lowerBound(location);
+        uint64_t *d = data();
+        if (idx == mSize || d[idx] != location.mData)
+            return false;
+        memmove(d + idx, d + idx + 1, (mSize - idx - 1) * sizeof(uint64_t));
+        --mSize;
+        return true;
+    }
+
+    // Removes all locations in any of fileIds, returns the number removed
+    int removeFiles(const Set<uint32_t> &fileIds)
+    {
+        uint64_t *d = data();
+        int out = 0;
+        for (int i=0; i<mSize; ++i) {
+            if (!fileIds.contains(static_cast<uint32_t>(d[i])))
+                d[out++] = d[i];
+        }
+        const int removed = mSize - out;
+        mSize = out;
+        return removed;
+    }
+
+    LocationSet &unite(const LocationSet &other, int *count = 0)
+    {
+        int added = 0;
+        if (mSize && other.mSize) {
+            // merge into a new array rather than inserting one by one
+            LocationSet merged;
+            merged.reserve(mSize + other.mSize);
+            const uint64_t *a = data(), *b = other.data();
+            const uint64_t *aEnd = a + mSize, *bEnd = b + other.mSize;
+            uint64_t *out = merged.data();
+            while (a != aEnd || b != bEnd) {
+                if (b == bEnd || (a != aEnd && lessThan(*a, *b))) {
+                    *out++ = *a++;
+                } else {
+                    if (a != aEnd && *a == *b) {
+                        ++a;
+                    } else {
+                        ++added;
+                    }
+                    *out++ = *b++;
+                }
+            }
+            if (added) {
+                merged.mSize = out - merged.data();
+                swap(merged);
+            }
+        } else if (other.mSize) {
+            added = other.mSize;
+            assign(other);
+        }
+        if (count)
+            *count = added;
+        return *this;
+    }
+
+    void swap(LocationSet &other)
+    {
+        char tmp[sizeof(LocationSet)];
+        memcpy(tmp, this, sizeof(LocationSet));
+        memcpy(static_cast<void*>(this), &other, sizeof(LocationSet));
+        memcpy(static_cast<void*>(&other), tmp, sizeof(LocationSet));
+    }
+
+    Set<Location> toSet() const
+    {
+        Set<Location> ret;
+        for (int i=0; i<mSize; ++i) {
+            ret.insert(ret.end(), Location(data()[i]));
+        }
+        return ret;
+    }
+
+    List<Location> toList() const
+    {
+        List<Location> ret;
+        ret.reserve(mSize);
+        for (int i=0; i<mSize; ++i) {
+            ret.append(Location(data()[i]));
+        }
+        return ret;
+    }
+
+    // Bytes allocated outside of the object itself
+    int heapSize() const { return isHeap() ? mCapacity * sizeof(uint64_t) : 0; }
+private:
+    // Same order as Location::operator< without constructing Locations
+    static bool lessThan(uint64_t l, uint64_t r)
+    {
+        const uint32_t lFileId = static_cast<uint32_t>(l), rFileId = static_cast<uint32_t>(r);
+        if (lFileId != rFileId)
+            return lFileId > rFileId;
+        return (l >> 32) < (r >> 32);
+    }
+
+    bool isHeap() const { return mCapacity > InlineCount; }
+    uint64_t *data() { return isHeap() ? mHeap : mInline; }
+    const uint64_t *data() const { return isHeap() ? mHeap : mInline; }
+
+    int lowerBound(const Location &location) const
+    {
+        const uint64_t *d = data();
+        int lower = 0, upper = mSize;
+        while (lower < upper) {
+            const int mid = lower + ((upper - lower) / 2);
+            if (lessThan(d[mid], location.mData)) {
+                lower = mid + 1;
+            } else {
+                upper = mid;
+            }
+        }
+        return lower;
+    }
+
+    void reserve(int count)
+    {
+        if (count <= mCapacity)
+            return;
+        uint64_t *heap = static_cast<uint64_t*>(malloc(count * sizeof(uint64_t)));
+        memcpy(heap, data(), mSize * sizeof(uint64_t));
+        if (isHeap())
+            free(mHeap);
+        mHeap = heap;
+        mCapacity = count;
+    }
+
+    void assign(const LocationSet &other)
+    {
+        mSize = 0;
+        reserve(other.mSize);
+        memcpy(data(), other.data(), other.mSize * sizeof(uint64_t));
+        mSize = other.mSize;
+    }
+
+    union {
+        uint64_t mInline[InlineCount];
+        uint64_t *mHeap;
+    };
+    int mSize, mCapacity;
+};
+
+template <> inline Serializer &operator<<(Serializer &s, const LocationSet &locations)
+{
+    const int size = locations.size();
+    s << size;
+    for (LocationSet::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        s << *it;
+    }
+    return s;
+}
+
+template <> inline Deserializer &operator>>(Deserializer &s, LocationSet &locations)
+{
+    locations.clear();
+    int size;
+    s >> size;
+    Location location;
+    for (int i=0; i<size; ++i) {
+        s >> location;
+        locations.insert(location);
+    }
+    return s;
+}
+
+inline Log operator<<(Log log, const LocationSet &locations)
+{
+    log << locations.toSet();
+    return log;
+}
+
+#endif
@@ -202,14 +202,14 @@ inline Log operator<<(Log stream, const List<T> &list)
     return stream;
 }
 
-template <typename T>
-inline Log operator<<(Log stream, const Set<T> &list)
+template <typename T, typename Alloc>
+inline Log operator<<(Log stream, const Set<T, Alloc> &list)
 {
     stream << "Set<";
     bool old = stream.setSpacing(false);
     stream << typeName<T>() << ">(";
     bool first = true;
-    for (typename Set<T>::const_iterator it = list.begin(); it != list.end(); ++it) {
+    for (typename Set<T, Alloc>::const_iterator it = list.begin(); it != list.end(); ++it) {
         if (first) {
             stream.disableNextSpacing();
             first = false;
@@ -226,14 +226,14 @@ inline Log operator<<(Log stream, const Set<T> &list)
     return stream;
 }
 
-template <typename Key, typename Value>
-inline Log operator<<(Log stream, const Map<Key, Value> &map)
+template <typename Key, typename Value, typename Alloc>
+inline Log operator<<(Log stream, const Map<Key, Value, Alloc> &map)
 {
     stream << "Map<";
     bool old = stream.setSpacing(false);
     stream << typeName<Key>() << ", " << typeName<Value>() << ">(";
     bool first = true;
-    for (typename Map<Key, Value>::const_iterator it = map.begin(); it != map.end(); ++it) {
+    for (typename Map<Key, Value, Alloc>::const_iterator it = map.begin(); it != map.end(); ++it) {
         if (first) {
             stream.disableNextSpacing();
             first = false;
@@ -0,0 +1,54 @@
+#include "MappedFile.h"
+#include "Log.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+MappedFile::MappedFile()
+    : mData(0), mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const Path &path)
+{
+    close();
+    const int fd = ::open(path.constData(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !st.st_size) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (data == MAP_FAILED) {
+        error("Can't map %s (%s)", path.constData(), strerror(errno));
+        return false;
+    }
+    mPath = path;
+    mData = reinterpret_cast<const char*>(data);
+    mSize = st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData) {
+        munmap(const_cast<char*>(mData), mSize);
+        mData = 0;
+        mSize = 0;
+        mPath.clear();
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include "Path.h"
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const Path &path);
+    void close();
+
+    bool isOpen() const { return mData; }
+    Path path() const { return mPath; }
+    const char *data() const { return mData; }
+    size_t size() const { return mSize; }
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    Path mPath;
+    const char *mData;
+    size_t mSize;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "MemoryBudget.h"
+#include "MemoryMonitor.h"
+#include "MutexLocker.h"
+
+Mutex MemoryBudget::sMutex;
+uint64_t MemoryBudget::sBudget = 0;
+Map<uint32_t, uint64_t> MemoryBudget::sEstimates;
+uint64_t MemoryBudget::sEstimatesTotal = 0;
+Map<const IndexerJob*, MemoryBudget::Running> MemoryBudget::sRunning;
+
+void MemoryBudget::init(uint64_t budget)
+{
+    sBudget = budget;
+}
+
+uint64_t MemoryBudget::estimate(uint32_t fileId)
+{
+    MutexLocker lock(&sMutex);
+    return estimateLocked(fileId);
+}
+
+// Called with sMutex held
+uint64_t MemoryBudget::estimateLocked(uint32_t fileId)
+{
+    const uint64_t ret = sEstimates.value(fileId);
+    if (ret)
+        return ret;
+    return sEstimates.isEmpty() ? DefaultEstimate : sEstimatesTotal / sEstimates.size();
+}
+
+uint64_t MemoryBudget::available()
+{
+    MutexLocker lock(&sMutex);
+    if (sRunning.isEmpty())
+        return static_cast<uint64_t>(-1);
+    const uint64_t usage = MemoryMonitor::usage();
+    uint64_t projected = usage;
+    for (Map<const IndexerJob*, Running>::const_iterator it = sRunning.begin(); it != sRunning.end(); ++it) {
+        const Running &running = it->second;
+        const uint64_t grown = usage > running.usage ? usage - running.usage : 0;
+        if (running.estimate > grown)
+            projected += running.estimate - grown;
+    }
+    return projected < sBudget ? sBudget - projected : 0;
+}
+
+void MemoryBudget::start(const IndexerJob *job, uint32_t fileId)
+{
+    MutexLocker lock(&sMutex);
+    Running &running = sRunning[job];
+    running.estimate = estimateLocked(fileId);
+    running.usage = MemoryMonitor::usage();
+}
+
+void MemoryBudget::finish(const IndexerJob *job, uint32_t fileId, uint64_t peak)
+{
+    MutexLocker lock(&sMutex);
+    if (!sRunning.remove(job) || !peak)
+        return;
+    // average it with the previous runs, one unit that needed a lot less
+    // because it was reparsed shouldn't make the next one look cheap
+    uint64_t &estimate = sEstimates[fileId];
+    sEstimatesTotal -= estimate;
+    estimate = estimate ? (estimate + peak) / 2 : peak;
+    sEstimatesTotal += estimate;
+}
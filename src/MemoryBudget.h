@@ -0,0 +1,51 @@
+#ifndef MemoryBudget_h
+#define MemoryBudget_h
+
+#include "Map.h"
+#include "Mutex.h"
+#include <stdint.h>
+
+class IndexerJob;
+
+/*
+  Keeps rdm's memory use under a budget by deciding whether another indexer
+  job can start. A job is estimated to need as much memory as its
+  translation unit used the last times the file was indexed, files that
+  haven't been indexed yet get the average. Running jobs are charged the
+  part of their estimate that hasn't shown up in the memory rdm uses yet.
+
+  A job that doesn't fit waits, smaller ones can start in the meantime. With
+  nothing running every job fits, so big units still get indexed.
+*/
+
+class MemoryBudget
+{
+public:
+    enum { DefaultEstimate = 128 * 1024 * 1024 };
+
+    static void init(uint64_t budget);
+    static bool isEnabled() { return sBudget; }
+
+    static uint64_t estimate(uint32_t fileId);
+    // What's left of the budget for another job, jobs whose estimate is
+    // larger don't fit. Everything fits with nothing running.
+    static uint64_t available();
+    static void start(const IndexerJob *job, uint32_t fileId);
+    // peak is what the job's unit used, 0 if it didn't get that far
+    static void finish(const IndexerJob *job, uint32_t fileId, uint64_t peak);
+private:
+    struct Running {
+        uint64_t estimate;
+        uint64_t usage; // what rdm used when it started
+    };
+
+    static uint64_t estimateLocked(uint32_t fileId);
+
+    static Mutex sMutex;
+    static uint64_t sBudget;
+    static Map<uint32_t, uint64_t> sEstimates;
+    static uint64_t sEstimatesTotal;
+    static Map<const IndexerJob*, Running> sRunning;
+};
+
+#endif
@@ -2,13 +2,14 @@
 #include "ByteArray.h"
 #include "List.h"
 #include "Log.h"
+#include "Mutex.h"
+#include "MutexLocker.h"
+#include "StopWatch.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #ifdef OS_Darwin
-# include "Mutex.h"
-# include "MutexLocker.h"
 # include <pthread.h>
 # include <mach/mach_traps.h>
 # include <mach/mach_init.h>
@@ -39,7 +40,7 @@ static void visitLine(FILE* stream, LineVisitor visitor, void* userData)
 
 static bool lineVisitor(char* line, void* userData)
 {
-    int* total = static_cast<int*>(userData);
+    uint64_t* total = static_cast<uint64_t*>(userData);
     if (!strncmp("Private_Clean:", line, 14))
         *total += (atoll(line + 14) * 1024);
     else if (!strncmp("Private_Dirty:", line, 14))
@@ -49,17 +50,29 @@ static bool lineVisitor(char* line, void* userData)
 
 static inline uint64_t usageLinux()
 {
-    const pid_t pid = getpid();
-    FILE* file = fopen(("/proc/" + ByteArray::number(pid) + "/smaps").constData(), "r");
+    // smaps_rollup is the sum of smaps, a dozen lines instead of a dozen
+    // per mapping
+    static bool rollup = true;
+    if (rollup) {
+        if (FILE* file = fopen("/proc/self/smaps_rollup", "r")) {
+            uint64_t total = 0;
+            visitLine(file, lineVisitor, &total);
+            fclose(file);
+            return total;
+        }
+        rollup = false;
+    }
+
+    // kernels before 4.14, resident pages that aren't file backed
+    FILE* file = fopen("/proc/self/statm", "r");
     if (!file)
         return 0;
-
-    int total = 0;
-    visitLine(file, lineVisitor, &total);
-
+    unsigned long long size, resident, shared;
+    const int read = fscanf(file, "%llu %llu %llu", &size, &resident, &shared);
     fclose(file);
-
-    return total;
+    if (read != 3 || resident < shared)
+        return 0;
+    return (resident - shared) * sysconf(_SC_PAGESIZE);
 }
 #elif defined(OS_FreeBSD)
 static inline uint64_t usageFreeBSD()
@@ -117,7 +130,34 @@ static inline uint64_t usageOSX()
 }
 #endif
 
+volatile int64_t MemoryMonitor::sCounters[CounterCount];
+static Mutex sUsageMutex;
+static uint64_t sUsage = 0;
+static int sSampled = 0;
+
 uint64_t MemoryMonitor::usage()
+{
+    MutexLocker lock(&sUsageMutex);
+    const int now = StopWatch::current();
+    if (!sSampled || now < sSampled || now - sSampled >= SampleInterval) {
+        sUsage = read();
+        sSampled = now;
+    }
+    return sUsage;
+}
+
+const char *MemoryMonitor::counterName(Counter counter)
+{
+    switch (counter) {
+    case Symbols: return "symbols";
+    case CachedUnits: return "cached units";
+    case PendingData: return "pending index data";
+    case CounterCount: break;
+    }
+    return 0;
+}
+
+uint64_t MemoryMonitor::read()
 {
 #if defined(OS_Linux)
     return usageLinux();
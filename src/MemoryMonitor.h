@@ -6,10 +6,27 @@
 class MemoryMonitor
 {
 public:
+    enum { SampleInterval = 500 }; // ms
+    // What the process uses, read at most once per SampleInterval
     static uint64_t usage();
 
+    // Bytes held by the biggest consumers, kept up to date by their owners
+    // so they're free to read
+    enum Counter {
+        Symbols,
+        CachedUnits,
+        PendingData,
+        CounterCount
+    };
+    static void add(Counter counter, int64_t bytes) { __sync_add_and_fetch(&sCounters[counter], bytes); }
+    static int64_t count(Counter counter) { return __sync_add_and_fetch(&sCounters[counter], 0); }
+    static const char *counterName(Counter counter);
+
 private:
     MemoryMonitor();
+    static uint64_t read();
+
+    static volatile int64_t sCounters[CounterCount];
 };
 
 #endif
@@ -0,0 +1,209 @@
+#include "PathRegistry.h"
+#include "MutexLocker.h"
+#include <string.h>
+
+const Path *volatile *volatile PathRegistry::sChunks[PathRegistry::MaxChunks];
+PathRegistry::Table *volatile PathRegistry::sTable = 0;
+uint32_t PathRegistry::sLastId = 0;
+PathRegistry::Resolver PathRegistry::sResolver = 0;
+Mutex PathRegistry::sMutex;
+
+// Orders the loads after reading a published pointer after the load of the
+// pointer itself. x86 doesn't reorder loads so it's enough to stop the
+// compiler from doing it.
+static inline void acquire()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile("" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
+uint64_t PathRegistry::hash(const Path &path)
+{
+    // FNV-1a
+    uint64_t ret = 14695981039346656037ull;
+    const unsigned char *data = reinterpret_cast<const unsigned char*>(path.constData());
+    const int size = path.size();
+    for (int i=0; i<size; ++i) {
+        ret ^= data[i];
+        ret *= 1099511628211ull;
+    }
+    return ret;
+}
+
+const PathRegistry::Slot *PathRegistry::find(const Table *table, const Path &path, uint64_t hash)
+{
+    uint32_t idx = static_cast<uint32_t>(hash) & table->mask;
+    while (true) {
+        const Slot &slot = table->slots[idx];
+        const Path *p = slot.path;
+        if (!p)
+            return 0;
+        acquire();
+        if (slot.hash == hash && *p == path)
+            return &slot;
+        idx = (idx + 1) & table->mask;
+    }
+}
+
+uint32_t PathRegistry::fileId(const Path &path)
+{
+    const Table *table = sTable;
+    if (!table)
+        return 0;
+    acquire();
+    const Slot *slot = find(table, path, hash(path));
+    return slot ? slot->id : 0;
+}
+
+const Path &PathRegistry::path(uint32_t fileId)
+{
+    static const Path empty;
+    if (!fileId || (fileId >> ChunkBits) >= MaxChunks)
+        return empty;
+    const Path *volatile *chunk = sChunks[fileId >> ChunkBits];
+    if (!chunk)
+        return empty;
+    acquire();
+    const Path *ret = chunk[fileId & (ChunkSize - 1)];
+    if (!ret)
+        return empty;
+    acquire();
+    return *ret;
+}
+
+int PathRegistry::count()
+{
+    MutexLocker lock(&sMutex);
+    return sTable ? sTable->count : 0;
+}
+
+// Called with sMutex held
+void PathRegistry::setPath(uint32_t id, const Path *path)
+{
+    const uint32_t chunkIdx = id >> ChunkBits;
+    assert(chunkIdx < MaxChunks);
+    if (!sChunks[chunkIdx]) {
+        const Path *volatile *chunk = new const Path *volatile[ChunkSize];
+        for (int i=0; i<ChunkSize; ++i)
+            chunk[i] = 0;
+        __sync_synchronize();
+        sChunks[chunkIdx] = chunk;
+    }
+    __sync_synchronize();
+    sChunks[chunkIdx][id & (ChunkSize - 1)] = path;
+}
+
+// Called with sMutex held, table isn't visible to readers yet or path isn't
+// in it
+void PathRegistry::insertSlot(Table *table, const Path *path, uint32_t id, uint64_t hash)
+{
+    uint32_t idx = static_cast<uint32_t>(hash) & table->mask;
+    while (table->slots[idx].path)
+        idx = (idx + 1) & table->mask;
+    Slot &slot = table->slots[idx];
+    slot.hash = hash;
+    slot.id = id;
+    __sync_synchronize();
+    slot.path = path;
+    ++table->count;
+}
+
+// Called with sMutex held
+void PathRegistry::add(const Path *path, uint32_t id)
+{
+    const uint64_t h = hash(*path);
+    Table *table = sTable;
+    if (!table || (table->count + 1) * 2 > static_cast<int>(table->mask + 1)) {
+        // grow into a new table and publish it once it's complete
+        Table *grown = new Table;
+        const uint32_t size = table ? (table->mask + 1) * 2 : 1024;
+        grown->mask = size - 1;
+        grown->count = 0;
+        grown->previous = table;
+        grown->slots = new Slot[size];
+        memset(grown->slots, 0, sizeof(Slot) * size);
+        if (table) {
+            for (uint32_t i=0; i<=table->mask; ++i) {
+                const Slot &slot = table->slots[i];
+                if (slot.path)
+                    insertSlot(grown, slot.path, slot.id, slot.hash);
+            }
+        }
+        __sync_synchronize();
+        sTable = grown;
+        table = grown;
+    }
+    insertSlot(table, path, id, h);
+}
+
+uint32_t PathRegistry::insert(const Path &path)
+{
+    if (const uint32_t id = fileId(path))
+        return id;
+    MutexLocker lock(&sMutex);
+    if (sTable) {
+        if (const Slot *slot = find(sTable, path, hash(path)))
+            return slot->id;
+    }
+    const uint32_t id = sResolver ? sResolver(path) : ++sLastId;
+    if (!id)
+        return 0;
+    const Path *p = new Path(path);
+    setPath(id, p);
+    add(p, id);
+    return id;
+}
+
+void PathRegistry::setResolver(Resolver resolver)
+{
+    MutexLocker lock(&sMutex);
+    sResolver = resolver;
+}
+
+Map<uint32_t, Path> PathRegistry::idsToPaths()
+{
+    Map<uint32_t, Path> ret;
+    MutexLocker lock(&sMutex);
+    if (sTable) {
+        for (uint32_t i=0; i<=sTable->mask; ++i) {
+            const Slot &slot = sTable->slots[i];
+            if (slot.path)
+                ret[slot.id] = *slot.path;
+        }
+    }
+    return ret;
+}
+
+Map<Path, uint32_t> PathRegistry::pathsToIds()
+{
+    Map<Path, uint32_t> ret;
+    MutexLocker lock(&sMutex);
+    if (sTable) {
+        for (uint32_t i=0; i<=sTable->mask; ++i) {
+            const Slot &slot = sTable->slots[i];
+            if (slot.path)
+                ret[*slot.path] = slot.id;
+        }
+    }
+    return ret;
+}
+
+void PathRegistry::init(const Map<Path, uint32_t> &pathsToIds)
+{
+    MutexLocker lock(&sMutex);
+    for (Map<Path, uint32_t>::const_iterator it = pathsToIds.begin(); it != pathsToIds.end(); ++it) {
+        const uint32_t id = it->second;
+        if (!id || (sTable && find(sTable, it->first, hash(it->first))) || !path(id).isEmpty()) {
+            error() << "Ignoring conflicting file id" << id << "for" << it->first;
+            continue;
+        }
+        const Path *p = new Path(it->first);
+        setPath(id, p);
+        add(p, id);
+        if (id > sLastId)
+            sLastId = id;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef PathRegistry_h
+#define PathRegistry_h
+
+#include "Map.h"
+#include "Mutex.h"
+#include "Path.h"
+
+/*
+  The fileId <-> path mapping behind Location. Lookups in either direction
+  don't take any locks, only adding paths is serialized:
+
+  - ids map to paths through an append-only array of chunks, a chunk and a
+    path are fully written before they're published.
+  - paths map to ids through an open addressing hash table. Slots are
+    published the same way and a table that needs to grow is copied and the
+    copy published, the old one stays allocated since readers might still
+    be probing it.
+
+  Paths are never removed so references to them stay valid forever.
+*/
+
+class PathRegistry
+{
+public:
+    static uint32_t fileId(const Path &path);
+    static const Path &path(uint32_t fileId);
+    static uint32_t insert(const Path &path);
+    static int count();
+
+    // Asked for the id of every path that's inserted instead of assigning
+    // one, indexer worker processes use rdm's ids this way
+    typedef uint32_t (*Resolver)(const Path &path);
+    static void setResolver(Resolver resolver);
+
+    static Map<uint32_t, Path> idsToPaths();
+    static Map<Path, uint32_t> pathsToIds();
+    // Adds pathsToIds with their ids, used when restoring saved ids
+    static void init(const Map<Path, uint32_t> &pathsToIds);
+private:
+    enum {
+        ChunkBits = 12,
+        ChunkSize = 1 << ChunkBits,
+        MaxChunks = 1 << 14
+    };
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t id;
+        const Path *volatile path; // written last
+    };
+    struct Table {
+        uint32_t mask;
+        int count;
+        Slot *slots;
+        Table *previous; // retired, readers might still be using it
+    };
+
+    static uint64_t hash(const Path &path);
+    static const Slot *find(const Table *table, const Path &path, uint64_t hash);
+    static void add(const Path *path, uint32_t id);
+    static void insertSlot(Table *table, const Path *path, uint32_t id, uint64_t hash);
+    static void setPath(uint32_t id, const Path *path);
+
+    static const Path *volatile *volatile sChunks[MaxChunks];
+    static Table *volatile sTable;
+    static uint32_t sLastId;
+    static Resolver sResolver;
+    static Mutex sMutex;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "PreambleCache.h"
+#include "MutexLocker.h"
+#include "RTags.h"
+#include <ctype.h>
+#include <string.h>
+
+Mutex PreambleCache::sMutex;
+Path PreambleCache::sDir;
+Map<ByteArray, PreambleCache::Entry> PreambleCache::sEntries;
+uint64_t PreambleCache::sCounter = 0;
+int PreambleCache::sNextId = 0;
+
+void PreambleCache::init(const Path &dir)
+{
+    // pchs from a previous run can't be trusted
+    RTags::removeDirectory(dir);
+    if (!Path::mkdir(dir)) {
+        error("Can't create directory [%s]", dir.constData());
+        return;
+    }
+    sDir = dir;
+}
+
+int PreambleCache::prefix(const ByteArray &contents, ByteArray &includes)
+{
+    includes.clear();
+    const char *str = contents.constData();
+    const int size = contents.size();
+    int i = 0, end = 0;
+    while (i < size) {
+        const char ch = str[i];
+        if (isspace(static_cast<unsigned char>(ch))) {
+            ++i;
+        } else if (ch == '/' && i + 1 < size && str[i + 1] == '/') {
+            const char *newLine = static_cast<const char*>(memchr(str + i, '\n', size - i));
+            i = newLine ? newLine - str : size;
+        } else if (ch == '/' && i + 1 < size && str[i + 1] == '*') {
+            const int close = contents.indexOf("*/", i + 2);
+            if (close == -1)
+                break;
+            i = close + 2;
+        } else if (ch == '#') {
+            int j = i + 1;
+            while (j < size && (str[j] == ' ' || str[j] == '\t'))
+                ++j;
+            if (size - j < 8 || strncmp(str + j, "include", 7)
+                || (str[j + 7] != '"' && str[j + 7] != '<' && !isspace(static_cast<unsigned char>(str[j + 7])))) {
+                break;
+            }
+            const char *newLine = static_cast<const char*>(memchr(str + j, '\n', size - j));
+            const int lineEnd = newLine ? newLine - str : size;
+            if (memchr(str + i, '\\', lineEnd - i))
+                break; // continuations and escapes, not worth it
+            includes.append(str + i, lineEnd - i);
+            includes.append('\n');
+            i = end = lineEnd;
+        } else {
+            break;
+        }
+    }
+    return end;
+}
+
+PreambleCache::State PreambleCache::acquire(const ByteArray &key, Path &pch, Set<uint32_t> &headers)
+{
+    MutexLocker lock(&sMutex);
+    if (sDir.isEmpty())
+        return Unavailable;
+    Entry &entry = sEntries[key];
+    entry.lastUsed = ++sCounter;
+    switch (entry.state) {
+    case Ready:
+        pch = entry.pch;
+        headers = entry.headers;
+        return Ready;
+    case Build:
+        // someone else is building it
+        return Unavailable;
+    case Unavailable:
+        break;
+    }
+    if (entry.failed || ++entry.uses < MinUses)
+        return Unavailable;
+    entry.state = Build;
+    entry.pch = sDir + ByteArray::format<32>("%d.pch", ++sNextId);
+    pch = entry.pch;
+    return Build;
+}
+
+bool PreambleCache::finish(const ByteArray &key, const Path &pch, bool ok, const Set<uint32_t> &headers)
+{
+    MutexLocker lock(&sMutex);
+    const Map<ByteArray, Entry>::iterator it = sEntries.find(key);
+    if (it == sEntries.end() || it->second.state != Build || it->second.pch != pch) {
+        // invalidated while it was being built
+        Path::rm(pch);
+        return false;
+    }
+    Entry &entry = it->second;
+    entry.headers = headers;
+    if (!ok) {
+        Path::rm(entry.pch);
+        entry.pch.clear();
+        entry.state = Unavailable;
+        entry.failed = true;
+        return false;
+    }
+    entry.state = Ready;
+
+    int ready = 0;
+    for (Map<ByteArray, Entry>::const_iterator e = sEntries.begin(); e != sEntries.end(); ++e) {
+        if (e->second.state == Ready)
+            ++ready;
+    }
+    while (ready > MaxEntries) {
+        Map<ByteArray, Entry>::iterator oldest = sEntries.end();
+        for (Map<ByteArray, Entry>::iterator e = sEntries.begin(); e != sEntries.end(); ++e) {
+            if (e->second.state == Ready && (oldest == sEntries.end() || e->second.lastUsed < oldest->second.lastUsed))
+                oldest = e;
+        }
+        removeEntry(oldest);
+        --ready;
+    }
+    return true;
+}
+
+// Called with sMutex held
+void PreambleCache::removeEntry(Map<ByteArray, Entry>::iterator it)
+{
+    switch (it->second.state) {
+    case Ready:
+        Path::rm(it->second.pch);
+        break;
+    case Build:
+        // the job building it deletes the pch when it's done
+    case Unavailable:
+        break;
+    }
+    sEntries.erase(it);
+}
+
+void PreambleCache::invalidate(const Set<uint32_t> &fileIds)
+{
+    MutexLocker lock(&sMutex);
+    Map<ByteArray, Entry>::iterator it = sEntries.begin();
+    while (it != sEntries.end()) {
+        const Set<uint32_t> &headers = it->second.headers;
+        bool found = false;
+        for (Set<uint32_t>::const_iterator f = fileIds.begin(); !found && f != fileIds.end(); ++f)
+            found = headers.contains(*f);
+        if (found) {
+            removeEntry(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void PreambleCache::remove(const ByteArray &key)
+{
+    MutexLocker lock(&sMutex);
+    const Map<ByteArray, Entry>::iterator it = sEntries.find(key);
+    if (it != sEntries.end())
+        removeEntry(it);
+}
@@ -0,0 +1,65 @@
+#ifndef PreambleCache_h
+#define PreambleCache_h
+
+#include "ByteArray.h"
+#include "Map.h"
+#include "Mutex.h"
+#include "Path.h"
+#include "Set.h"
+
+/*
+  Precompiled headers for the #include directives translation units start
+  with. Units with the same arguments and the same leading includes share a
+  key. The second job asking for a key builds the pch and the ones after
+  that parse on top of it instead of parsing the headers again. A failed
+  build isn't retried until one of the key's headers changes.
+*/
+
+class PreambleCache
+{
+public:
+    enum {
+        MaxEntries = 32,
+        MinUses = 2
+    };
+
+    static void init(const Path &dir);
+    static bool isEnabled() { return !sDir.isEmpty(); }
+
+    // Returns the length of the leading run of comments, whitespace and
+    // #include directives in contents, includes gets the directives
+    static int prefix(const ByteArray &contents, ByteArray &includes);
+
+    enum State {
+        Unavailable,
+        Build,
+        Ready
+    };
+    // Build means the caller should build pch and call finish() afterwards,
+    // Ready that it can use pch, headers are the files in it
+    static State acquire(const ByteArray &key, Path &pch, Set<uint32_t> &headers);
+    // Returns false if pch can't be used after all, it's been deleted then
+    static bool finish(const ByteArray &key, const Path &pch, bool ok, const Set<uint32_t> &headers);
+    // Drops the pchs that include any of fileIds
+    static void invalidate(const Set<uint32_t> &fileIds);
+    static void remove(const ByteArray &key);
+private:
+    struct Entry {
+        Entry() : uses(0), lastUsed(0), state(Unavailable), failed(false) {}
+        int uses;
+        uint64_t lastUsed;
+        State state;
+        bool failed;
+        Path pch;
+        Set<uint32_t> headers;
+    };
+    static void removeEntry(Map<ByteArray, Entry>::iterator it);
+
+    static Mutex sMutex;
+    static Path sDir;
+    static Map<ByteArray, Entry> sEntries;
+    static uint64_t sCounter;
+    static int sNextId;
+};
+
+#endif
@@ -1,35 +1,73 @@
 #include "Project.h"
+#include "Database.h"
+#include "FileCache.h"
 #include "FileManager.h"
 #include "IndexerJob.h"
 #include "Log.h"
+#include "MemoryBudget.h"
 #include "MemoryMonitor.h"
 #include "Path.h"
+#include "PreambleCache.h"
 #include "RTags.h"
 #include "ReadLocker.h"
 #include "RegExp.h"
 #include "Server.h"
-#include "Server.h"
 #include "ValidateDBJob.h"
 #include "WriteLocker.h"
 #include <math.h>
 
 static void *ModifiedFiles = &ModifiedFiles;
 static void *Finished = &Finished;
-enum { Timeout = 2000 };
+static void *Merge = &Merge;
+enum {
+    Timeout = 2000,
+    MergeSlice = 20000,
+    NameIndexRatio = 16 // rewrite the name index when more than 1/16 of the files have changed
+};
+
+// Posted by openShard() for a file whose shard couldn't be read, shards are
+// read on any thread so the reindexing happens in event()
+class ShardsFailedEvent : public Event
+{
+public:
+    enum { Type = 1 };
+    ShardsFailedEvent(const Set<uint32_t> &f)
+        : Event(Type), files(f)
+    {}
+
+    const Set<uint32_t> files;
+};
 
 Project::Project(const Path &path)
-    : mPath(path), mJobCounter(0), mTimerRunning(false), mLastJobElapsed(0),
-      mFlags(0), mFirstCachedUnit(0), mLastCachedUnit(0), mUnitCacheSize(0)
+    : mPath(path), mSymbolNameTrieLoaded(false), mSavePending(false), mGeneration(0), mUnloadedSections(0),
+      mJobCounter(0), mOverMemoryBudget(false), mTimerRunning(false), mLastJobElapsed(0), mFlags(0), mPendingDataBytes(0),
+      mFirstCachedUnit(0), mLastCachedUnit(0), mUnitCacheSize(0)
 {
     const unsigned options = Server::instance()->options().options;
     if (options & Server::Validate)
         mFlags |= Project::Validate;
     if (options & Server::IgnorePrintfFixits)
         mFlags |= Project::IgnorePrintfFixits;
+    if (options & Server::IndexCallbacks)
+        mFlags |= Project::IndexCallbacks;
     mWatcher.modified().connect(this, &Project::onFileModified);
     mWatcher.removed().connect(this, &Project::onFileModified);
 }
 
+Project::~Project()
+{
+    while (mFirstCachedUnit) {
+        CachedUnit *unit = mFirstCachedUnit;
+        mFirstCachedUnit = unit->next;
+        delete unit;
+    }
+    int64_t symbolBytes = 0;
+    for (Map<uint32_t, int64_t>::const_iterator it = mSymbolBytes.begin(); it != mSymbolBytes.end(); ++it)
+        symbolBytes += it->second;
+    MemoryMonitor::add(MemoryMonitor::Symbols, -symbolBytes);
+    MemoryMonitor::add(MemoryMonitor::PendingData, -mPendingDataBytes);
+}
+
 void Project::init()
 {
     assert(!isValid());
@@ -40,56 +78,63 @@ void Project::init()
 bool Project::restore()
 {
     StopWatch timer;
-    Path path = mPath;
-    RTags::encodePath(path);
-    const Path p = ByteArray::format<128>("%s%s", Server::instance()->options().dataDir.constData(), path.constData());
-    bool restoreError = false;
-    FILE *f = fopen(p.constData(), "r");
-    if (!f)
+    const Path p = databasePath();
+    if (!p.isFile())
         return false;
 
-    Deserializer in(f);
-    int version;
-    in >> version;
-    if (version != Server::DatabaseVersion) {
-        error("Wrong database version. Expected %d, got %d for %s. Removing.", Server::DatabaseVersion, version, p.constData());
-        restoreError = true;
-        goto end;
-    }
+    Set<uint32_t> shards, changedNames, changedUsrs;
+    uint32_t generation;
+    Map<uint32_t, Set<uint32_t> > dirtiedFiles;
+    Map<uint32_t, uint32_t> shardGenerations;
     {
-        int fs;
-        in >> fs;
-        if (fs != RTags::fileSize(f)) {
-            error("%s seems to be corrupted, refusing to restore %s",
-                  p.constData(), mPath.constData());
-            restoreError = true;
-            goto end;
+        Database database;
+        if (!database.open(p)) {
+            error("Refusing to restore %s from %s. Removing.", mPath.constData(), p.constData());
+            Path::rm(p);
+            Path::rm(nameIndexPath());
+            RTags::removeDirectory(shardsPath());
+            return false;
         }
+        Deserializer in(database.projectData(), database.projectDataSize());
+        in >> mDependencies >> mSources >> mVisitedFiles >> shards >> shardGenerations
+           >> generation >> dirtiedFiles >> changedNames >> changedUsrs;
     }
     {
-        {
-            Scope<SymbolMap &> scope = lockSymbolsForWrite();
-            in >> scope.data();
+        // Without the name index every shard has to be read for its names
+        WriteLocker namesLock(&mSymbolNamesLock);
+        WriteLocker usrLock(&mUsrLock);
+        if (!mNameIndex.open(nameIndexPath())) {
+            changedNames = shards;
+            changedUsrs = shards;
         }
-        {
-            Scope<SymbolNameMap &> scope = lockSymbolNamesForWrite();
-            in >> scope.data();
-        }
-        {
-            Scope<UsrMap &> scope = lockUsrForWrite();
-            in >> scope.data();
-        }
-
-    
-        in >> mDependencies >> mSources >> mVisitedFiles;
-
-        DependencyMap reversedDependencies;
-        // these dependencies are in the form of:
+        mSymbolNameShards.unloaded = shards;
+        mSymbolNameShards.changed.swap(changedNames);
+        mUsrShards.unloaded = shards;
+        mUsrShards.changed.swap(changedUsrs);
+    }
+    {
+        // The symbols stay in the shards until someone looks them up
+        WriteLocker lock(&mSymbolsLock);
+        mSymbols.setUnloaded(shards, loadSymbols, this);
+    }
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        mShards = shards;
+        mShardGenerations.swap(shardGenerations);
+        mGeneration = generation;
+        mDirtiedFiles.swap(dirtiedFiles);
+        mUnloadedSections = Database::SymbolNames|Database::Usr;
+    }
+    {
+        // mIndexScheduler keeps the dependencies in the form of:
         // Path.cpp: Path.h, ByteArray.h ...
         // mDependencies are like this:
         // Path.h: Path.cpp, Server.cpp ...
 
         for (DependencyMap::const_iterator it = mDependencies.begin(); it != mDependencies.end(); ++it) {
+            for (Set<uint32_t>::const_iterator s = it->second.begin(); s != it->second.end(); ++s) {
+                mIndexScheduler.addInclude(*s, it->first);
+            }
             const Path dir = Location::path(it->first).parentDir();
             if (dir.isEmpty()) {
                 error() << "File busted" << it->first << Location::path(it->first);
@@ -97,9 +142,6 @@ bool Project::restore()
             }
             if (mWatchedPaths.insert(dir))
                 mWatcher.watch(dir);
-            for (Set<uint32_t>::const_iterator s = it->second.begin(); s != it->second.end(); ++s) {
-                reversedDependencies[*s].insert(it->first);
-            }
         }
 
         SourceInformationMap::iterator it = mSources.begin();
@@ -113,8 +155,8 @@ bool Project::restore()
                 // error() << "parsed" << RTags::timeToString(parsed, RTags::DateTime) << parsed;
                 assert(mDependencies.value(it->first).contains(it->first));
                 assert(mDependencies.contains(it->first));
-                const Set<uint32_t> &deps = reversedDependencies[it->first];
-                for (Set<uint32_t>::const_iterator d = deps.begin(); d != deps.end(); ++d) {
+                const List<uint32_t> &deps = mIndexScheduler.includes(it->first);
+                for (List<uint32_t>::const_iterator d = deps.begin(); d != deps.end(); ++d) {
                     if (!mModifiedFiles.contains(*d) && Location::path(*d).lastModified() > parsed)
                         mModifiedFiles.insert(*d);
                 }
@@ -124,68 +166,346 @@ bool Project::restore()
         if (!mModifiedFiles.isEmpty())
             onFilesModifiedTimeout();
     }
-end:
-    fclose(f);
-    if (restoreError) {
-        Path::rm(p);
+    error() << "Restored project" << mPath << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+Path Project::databasePath() const
+{
+    Path path = mPath;
+    RTags::encodePath(path);
+    return Server::instance()->options().dataDir + path;
+}
+
+Path Project::shardsPath() const
+{
+    return databasePath() + ".shards/";
+}
+
+Path Project::nameIndexPath() const
+{
+    return databasePath() + ".names";
+}
+
+static inline ReadWriteLock *sectionLock(Database::Section section, ReadWriteLock *symbolNames, ReadWriteLock *usr)
+{
+    switch (section) {
+    case Database::SymbolNames:
+        return symbolNames;
+    case Database::Usr:
+        return usr;
+    default:
+        break;
+    }
+    assert(0 && "Invalid section");
+    return 0;
+}
+
+// Reads the shards of the files whose names have changed since mNameIndex
+// was written, lookups can't go through the index for those
+void Project::load(Database::Section section)
+{
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        if (!(mUnloadedSections & section))
+            return;
+    }
+
+    StopWatch timer;
+    WriteLocker writeLock(sectionLock(section, &mSymbolNamesLock, &mUsrLock));
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        if (!(mUnloadedSections & section)) // someone else beat us to it
+            return;
+    }
+    const NameShards &shards = section == Database::SymbolNames ? mSymbolNameShards : mUsrShards;
+    const int count = readNames(section, shards.changed);
+
+    MutexLocker lock(&mDatabaseMutex);
+    mUnloadedSections &= ~section;
+    warning() << "Loaded" << count << "shards for" << mPath << "in" << timer.elapsed() << "ms";
+}
+
+// Opens fileId's shard. One that can't be read is forgotten so nothing tries
+// it again and its file is indexed again.
+bool Project::openShard(uint32_t fileId, Database &database)
+{
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        if (!mShards.contains(fileId))
+            return false;
+    }
+    if (database.open(shardsPath() + ByteArray::number(fileId)))
+        return true;
+    error() << "Failed to load shard for" << Location::path(fileId) << "in" << mPath;
+    Set<uint32_t> failed;
+    failed.insert(fileId);
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        mShards -= failed;
+    }
+    postEvent(new ShardsFailedEvent(failed));
+    return false;
+}
+
+// Called by mSymbols for a file the first time it's looked up, with
+// mSymbolsLock locked for read or write. Drops the locations in files that
+// have been dirtied since the shard was written.
+bool Project::loadSymbols(uint32_t fileId, SymbolStore::FileSymbols &symbols, void *userData)
+{
+    Project *project = static_cast<Project*>(userData);
+    Database database;
+    if (!project->openShard(fileId, database))
         return false;
+    database.read(symbols);
+    uint32_t shardGeneration = 0;
+    {
+        Deserializer in(database.projectData(), database.projectDataSize());
+        in >> shardGeneration;
+    }
+
+    Set<uint32_t> dirtied;
+    uint32_t generation;
+    {
+        MutexLocker lock(&project->mDatabaseMutex);
+        generation = project->mGeneration;
+        const Map<uint32_t, Set<uint32_t> > &dirtiedFiles = project->mDirtiedFiles;
+        for (Map<uint32_t, Set<uint32_t> >::const_iterator it = dirtiedFiles.upper_bound(shardGeneration);
+             it != dirtiedFiles.end(); ++it) {
+            dirtied.unite(it->second);
+        }
+    }
+    bool modified = false;
+    if (!dirtied.isEmpty()) {
+        for (int i=0; i<symbols.size(); ++i) {
+            if (symbols[i].second.dirty(dirtied))
+                modified = true;
+        }
+    }
+    if (modified) {
+        MutexLocker lock(&project->mMutex);
+        project->mDirtyShards.insert(fileId);
     } else {
-        error() << "Restored project" << mPath << "in" << timer.elapsed() << "ms";
+        MutexLocker lock(&project->mDatabaseMutex);
+        project->mShardGenerations[fileId] = generation;
     }
 
+    const int64_t bytes = SymbolStore::memoryUsage(symbols);
+    project->mSymbolBytes[fileId] = bytes;
+    MemoryMonitor::add(MemoryMonitor::Symbols, bytes);
     return true;
 }
 
+// Reads section out of files' shards unless it has been already. Called
+// with the section's lock locked for write, returns the number of shards
+// read.
+int Project::readNames(Database::Section section, const Set<uint32_t> &files)
+{
+    NameShards &shards = section == Database::SymbolNames ? mSymbolNameShards : mUsrShards;
+    Database database;
+    int count = 0;
+    for (Set<uint32_t>::const_iterator it = files.begin(); it != files.end(); ++it) {
+        if (!shards.unloaded.remove(*it) || !openShard(*it, database))
+            continue;
+        ++count;
+        // A shard only has locations in its own file
+        const int names = database.count(section);
+        if (section == Database::SymbolNames) {
+            database.read(Database::SymbolNames, mSymbolNames);
+            Set<InternedString> &fileNames = mFileSymbolNames[*it];
+            for (int i=0; i<names; ++i) {
+                const InternedString name(database.name(section, i));
+                fileNames.insert(name);
+                if (mSymbolNameTrieLoaded) {
+                    mSymbolNameTrie.insert(name);
+                    mFuzzySymbolIndex.insert(name);
+                }
+            }
+        } else {
+            database.read(mUsr);
+            Set<InternedString> &fileUsrs = mFileUsrs[*it];
+            for (int i=0; i<names; ++i)
+                fileUsrs.insert(database.name(section, i));
+        }
+    }
+    return count;
+}
+
+// Like readNames() but takes the section's lock itself, for write only if
+// any of files hasn't been read
+void Project::loadNames(Database::Section section, const Set<uint32_t> &files)
+{
+    ReadWriteLock *lock = sectionLock(section, &mSymbolNamesLock, &mUsrLock);
+    const NameShards &shards = section == Database::SymbolNames ? mSymbolNameShards : mUsrShards;
+    Set<uint32_t> unloaded;
+    {
+        ReadLocker readLock(lock);
+        for (Set<uint32_t>::const_iterator it = files.begin(); it != files.end(); ++it) {
+            if (shards.unloaded.contains(*it))
+                unloaded.insert(*it);
+        }
+    }
+    if (!unloaded.isEmpty()) {
+        WriteLocker writeLock(lock);
+        readNames(section, unloaded);
+    }
+}
+
+// Adds the files mNameIndex has name in and that haven't been read yet.
+// Called with the section's lock held.
+void Project::indexFiles(Database::Section section, const ByteArray &name, Set<uint32_t> &files) const
+{
+    if (!mNameIndex.isOpen())
+        return;
+    const int idx = mNameIndex.find(section, name);
+    if (idx == -1)
+        return;
+    const NameShards &shards = section == Database::SymbolNames ? mSymbolNameShards : mUsrShards;
+    const Set<Location> locations = mNameIndex.locations(section, idx);
+    for (Set<Location>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        const uint32_t fileId = it->fileId();
+        if (shards.unloaded.contains(fileId) && !shards.changed.contains(fileId))
+            files.insert(fileId);
+    }
+}
+
+void Project::loadName(Database::Section section, const ByteArray &name)
+{
+    load(section);
+    Set<uint32_t> files;
+    {
+        ReadLocker lock(sectionLock(section, &mSymbolNamesLock, &mUsrLock));
+        indexFiles(section, name, files);
+    }
+    if (!files.isEmpty())
+        loadNames(section, files);
+}
+
+// The trie has the names of files that haven't been read too, straight from
+// mNameIndex
+void Project::loadSymbolNameTrie()
+{
+    load(Database::SymbolNames);
+    {
+        ReadLocker lock(&mSymbolNamesLock);
+        if (mSymbolNameTrieLoaded)
+            return;
+    }
+    StopWatch timer;
+    WriteLocker lock(&mSymbolNamesLock);
+    if (mSymbolNameTrieLoaded)
+        return;
+    for (SymbolNameMap::const_iterator it = mSymbolNames.begin(); it != mSymbolNames.end(); ++it) {
+        mSymbolNameTrie.insert(it->first);
+        mFuzzySymbolIndex.insert(it->first);
+    }
+    Set<uint32_t> files;
+    const int count = mNameIndex.isOpen() ? mNameIndex.count(Database::SymbolNames) : 0;
+    for (int i=0; i<count; ++i) {
+        const ByteArray name = mNameIndex.name(Database::SymbolNames, i);
+        files.clear();
+        indexFiles(Database::SymbolNames, name, files);
+        if (!files.isEmpty()) {
+            const InternedString interned(name);
+            mSymbolNameTrie.insert(interned);
+            mFuzzySymbolIndex.insert(interned);
+        }
+    }
+    mSymbolNameTrieLoaded = true;
+    warning() << "Loaded symbol names of" << mPath << "in" << timer.elapsed() << "ms";
+}
+
+void Project::loadAll(unsigned sections)
+{
+    if (sections & Database::Symbols) {
+        ReadLocker lock(&mSymbolsLock);
+        mSymbols.loadAll();
+    }
+    if (sections & Database::SymbolNames) {
+        WriteLocker lock(&mSymbolNamesLock);
+        const Set<uint32_t> files = mSymbolNameShards.unloaded;
+        readNames(Database::SymbolNames, files);
+    }
+    if (sections & Database::Usr) {
+        WriteLocker lock(&mUsrLock);
+        const Set<uint32_t> files = mUsrShards.unloaded;
+        readNames(Database::Usr, files);
+    }
+}
+
+void Project::symbolNameFiles(const InternedString &name, Set<uint32_t> &files) const
+{
+    const SymbolNameMap::const_iterator it = mSymbolNames.find(name);
+    if (it != mSymbolNames.end()) {
+        for (Set<Location>::const_iterator l = it->second.begin(); l != it->second.end(); ++l)
+            files.insert(l->fileId());
+    }
+    indexFiles(Database::SymbolNames, name, files);
+}
+
 bool Project::isValid() const
 {
     return fileManager.get();
 }
 
-Scope<const SymbolMap&> Project::lockSymbolsForRead(int maxTime)
+Scope<const SymbolStore&> Project::lockSymbolsForRead(int maxTime, LockType type)
 {
-    Scope<const SymbolMap&> scope;
+    Scope<const SymbolStore&> scope;
+    StopWatch wait;
     if (mSymbolsLock.lockForRead(maxTime))
-        scope.mData.reset(new Scope<const SymbolMap&>::Data(mSymbols, &mSymbolsLock));
+        scope.mData.reset(new Scope<const SymbolStore&>::Data(mSymbols, &mSymbolsLock));
+    if (type == QueryLock)
+        mQueryWait.add(wait.elapsed());
     return scope;
 }
 
-Scope<SymbolMap&> Project::lockSymbolsForWrite()
+Scope<SymbolStore&> Project::lockSymbolsForWrite()
 {
-    Scope<SymbolMap&> scope;
+    Scope<SymbolStore&> scope;
     mSymbolsLock.lockForWrite();
-    scope.mData.reset(new Scope<SymbolMap&>::Data(mSymbols, &mSymbolsLock));
+    scope.mData.reset(new Scope<SymbolStore&>::Data(mSymbols, &mSymbolsLock));
     return scope;
 }
 
-Scope<const SymbolNameMap&> Project::lockSymbolNamesForRead(int maxTime)
+Scope<const SymbolNameMap&> Project::lockSymbolNamesForRead(int maxTime, LockType type)
 {
+    load(Database::SymbolNames);
     Scope<const SymbolNameMap&> scope;
+    StopWatch wait;
     if (mSymbolNamesLock.lockForRead(maxTime))
         scope.mData.reset(new Scope<const SymbolNameMap&>::Data(mSymbolNames, &mSymbolNamesLock));
+    if (type == QueryLock)
+        mQueryWait.add(wait.elapsed());
     return scope;
 }
 
 Scope<SymbolNameMap&> Project::lockSymbolNamesForWrite()
 {
+    load(Database::SymbolNames);
     Scope<SymbolNameMap&> scope;
     mSymbolNamesLock.lockForWrite();
     scope.mData.reset(new Scope<SymbolNameMap&>::Data(mSymbolNames, &mSymbolNamesLock));
     return scope;
 }
 
-Scope<const UsrMap&> Project::lockUsrForRead(int maxTime)
+Scope<const UsrIndex&> Project::lockUsrForRead(int maxTime, LockType type)
 {
-    Scope<const UsrMap&> scope;
+    load(Database::Usr);
+    Scope<const UsrIndex&> scope;
+    StopWatch wait;
     if (mUsrLock.lockForRead(maxTime))
-        scope.mData.reset(new Scope<const UsrMap&>::Data(mUsr, &mUsrLock));
+        scope.mData.reset(new Scope<const UsrIndex&>::Data(mUsr, &mUsrLock));
+    if (type == QueryLock)
+        mQueryWait.add(wait.elapsed());
     return scope;
 }
 
-Scope<UsrMap&> Project::lockUsrForWrite()
+Scope<UsrIndex&> Project::lockUsrForWrite()
 {
-    Scope<UsrMap&> scope;
+    load(Database::Usr);
+    Scope<UsrIndex&> scope;
     mUsrLock.lockForWrite();
-    scope.mData.reset(new Scope<UsrMap&>::Data(mUsr, &mUsrLock));
+    scope.mData.reset(new Scope<UsrIndex&>::Data(mUsr, &mUsrLock));
     return scope;
 
 }
@@ -212,6 +532,12 @@ void Project::unload()
         it->second->abort();
     }
     mJobs.clear();
+    mIndexScheduler.clear();
+    if (MemoryBudget::isEnabled()) {
+        for (Set<shared_ptr<IndexerJob> >::const_iterator it = mStartedJobs.begin(); it != mStartedJobs.end(); ++it)
+            MemoryBudget::finish(it->get(), (*it)->fileId(), 0);
+    }
+    mStartedJobs.clear();
     fileManager.reset();
 }
 
@@ -245,9 +571,14 @@ void Project::onJobFinished(const shared_ptr<IndexerJob> &job)
         if (unit)
             addCachedUnit(job->path(), job->arguments(), job->takeIndex(), unit);
 
+        mStartedJobs.remove(job);
         const uint32_t fileId = job->fileId();
+        if (MemoryBudget::isEnabled()) {
+            MemoryBudget::finish(job.get(), fileId, job->isAborted() ? 0 : job->peakMemory());
+            mOverMemoryBudget = false;
+        }
         if (job->isAborted()) {
-            mVisitedFiles -= mVisitedFilesByJob.take(job);
+            unvisitFiles(mVisitedFilesByJob.take(job));
             --mJobCounter;
             pending = mPendingJobs.take(fileId, &startPending);
             if (mJobs.value(fileId) == job) {
@@ -259,7 +590,12 @@ void Project::onJobFinished(const shared_ptr<IndexerJob> &job)
             mLastJobElapsed = mTimer.elapsed();
 
             shared_ptr<IndexData> data = job->data();
-            mPendingData[fileId] = data;
+            shared_ptr<IndexData> &pending = mPendingData[fileId];
+            const int64_t bytes = data->memoryUsage() - (pending ? pending->memoryUsage() : 0);
+            pending = data;
+            mPendingDataBytes += bytes;
+            MemoryMonitor::add(MemoryMonitor::PendingData, bytes);
+            mMergeTimer.start(shared_from_this(), 0, true, Merge);
 
             const int idx = mJobCounter - mJobs.size();
 
@@ -270,6 +606,7 @@ void Project::onJobFinished(const shared_ptr<IndexerJob> &job)
                   RTags::timeToString(time(0), RTags::Time).constData(),
                   data->message.constData(), int((MemoryMonitor::usage() / (1024 * 1024))));
         }
+        startJobs();
     }
     if (startPending) {
         index(pending.source, pending.jobFlags);
@@ -279,6 +616,7 @@ void Project::onJobFinished(const shared_ptr<IndexerJob> &job)
 bool Project::finish()
 {
     bool done = false;
+    int jobsElapsed = 0;
     {
         MutexLocker lock(&mMutex);
 #ifdef RTAGS_DEBUG
@@ -297,67 +635,354 @@ bool Project::finish()
         if (mJobs.isEmpty()) {
             done = true;
             mTimerRunning = false;
-            mTimer.restart();
-            write();
-            error() << "Jobs took" << ((double)(mLastJobElapsed) / 1000.0) << "secs, writing took"
-                    << ((double)(mTimer.elapsed()) / 1000.0) << " secs, using"
-                    << MemoryMonitor::usage() / (1024.0 * 1024.0) << "mb of memory";
+            jobsElapsed = mLastJobElapsed;
             mJobCounter = 0;
-
         }
     }
 
     if (done) {
+        // merge() takes mMutex itself
+        StopWatch timer;
+        write();
+        error() << "Jobs took" << ((double)(jobsElapsed) / 1000.0) << "secs, writing took"
+                << ((double)(timer.elapsed()) / 1000.0) << " secs, using"
+                << MemoryMonitor::usage() / (1024.0 * 1024.0) << "mb of memory";
+        error() << "Queries waiting for the maps while indexing:" << mQueryWait.toString();
         if (mFlags & Validate) {
             shared_ptr<ValidateDBJob> validateJob(new ValidateDBJob(static_pointer_cast<Project>(shared_from_this()), mPreviousErrors));
             validateJob->errors().connect(this, &Project::onValidateDBJobErrors);
             Server::instance()->startQueryJob(validateJob);
         }
-        save();
+        startSave();
     }
     return done;
 }
 
-bool Project::save()
+class SaveJob : public ThreadPool::Job
 {
-    MutexLocker lock(&mMutex);
-    if (!Server::instance()->saveFileIds())
-        return false;
+public:
+    SaveJob(const shared_ptr<Project> &project)
+        : mProject(project)
+    {}
+protected:
+    virtual void run()
+    {
+        mProject->save();
+    }
+private:
+    shared_ptr<Project> mProject;
+};
+
+void Project::startSave()
+{
+    {
+        // A queued job takes its snapshot when it starts running so there's
+        // no point in queuing more than one.
+        MutexLocker lock(&mMutex);
+        if (mSavePending)
+            return;
+        mSavePending = true;
+    }
+    shared_ptr<SaveJob> job(new SaveJob(static_pointer_cast<Project>(shared_from_this())));
+    Server::instance()->startSaveJob(job);
+}
+
+struct Shard
+{
+    SymbolStore symbols;
+    SymbolNameMap symbolNames;
+    UsrIndex usr;
+
+    bool isEmpty() const { return symbols.isEmpty() && symbolNames.isEmpty() && usr.isEmpty(); }
+};
+typedef Map<uint32_t, Shard> ShardMap;
+
+static inline void splitSymbols(const SymbolStore &symbols, ShardMap &shards)
+{
+    for (ShardMap::iterator shard = shards.begin(); shard != shards.end(); ++shard) {
+        if (const SymbolStore::FileSymbols *fileSymbols = symbols.symbols(shard->first)) {
+            SymbolStore::FileSymbols copy = *fileSymbols;
+            shard->second.symbols.replace(shard->first, copy);
+        }
+    }
+}
+
+// Locations are sorted by fileId first so a file's are next to each other
+static inline void fileLocations(const Set<Location> &locations, uint32_t fileId, Set<Location> &out)
+{
+    Set<Location>::const_iterator it = locations.lower_bound(Location(fileId, 0));
+    while (it != locations.end() && it->fileId() == fileId) {
+        out.insert(out.end(), *it);
+        ++it;
+    }
+}
+
+// Files whose names haven't been read are added to unloaded and copied from
+// their old shard instead
+static inline void splitNames(const SymbolNameMap &names, const Map<uint32_t, Set<InternedString> > &fileNames,
+                              const Set<uint32_t> &notRead, ShardMap &shards, Set<uint32_t> &unloaded)
+{
+    for (ShardMap::iterator shard = shards.begin(); shard != shards.end(); ++shard) {
+        if (notRead.contains(shard->first)) {
+            unloaded.insert(shard->first);
+            continue;
+        }
+        const Map<uint32_t, Set<InternedString> >::const_iterator file = fileNames.find(shard->first);
+        if (file == fileNames.end())
+            continue;
+        for (Set<InternedString>::const_iterator it = file->second.begin(); it != file->second.end(); ++it) {
+            const SymbolNameMap::const_iterator name = names.find(*it);
+            if (name == names.end())
+                continue;
+            Set<Location> locations;
+            fileLocations(name->second, shard->first, locations);
+            if (!locations.isEmpty())
+                shard->second.symbolNames[*it].swap(locations);
+        }
+    }
+}
 
+static inline void splitUsr(const UsrIndex &usr, const Map<uint32_t, Set<InternedString> > &fileUsrs,
+                            const Set<uint32_t> &notRead, ShardMap &shards, Set<uint32_t> &unloaded)
+{
+    for (ShardMap::iterator shard = shards.begin(); shard != shards.end(); ++shard) {
+        if (notRead.contains(shard->first)) {
+            unloaded.insert(shard->first);
+            continue;
+        }
+        const Map<uint32_t, Set<InternedString> >::const_iterator file = fileUsrs.find(shard->first);
+        if (file == fileUsrs.end())
+            continue;
+        for (Set<InternedString>::const_iterator it = file->second.begin(); it != file->second.end(); ++it) {
+            const uint64_t hash = UsrIndex::hash(*it);
+            const Set<Location> *all = usr.find(*it, hash);
+            if (!all)
+                continue;
+            Set<Location> locations;
+            fileLocations(*all, shard->first, locations);
+            if (!locations.isEmpty())
+                shard->second.usr.insert(*it, hash).swap(locations);
+        }
+    }
+}
+
+// Only dirty shards are written. What they need is copied out of the maps,
+// one map at a time and without mMutex so jobs can finish and merge
+// meanwhile, names and usrs that haven't been read straight from the old
+// shard. Anything merged after we've let go of mMutex dirties its shards
+// again and they're written on the next save.
+bool Project::save()
+{
     StopWatch timer;
-    Path srcPath = mPath;
-    RTags::encodePath(srcPath);
-    const Server::Options &options = Server::instance()->options();
-    const Path p = options.dataDir + srcPath;
-    FILE *f = fopen(p.constData(), "w");
-    if (!f) {
-        error("Can't open file %s", p.constData());
+    ShardMap shards;
+    ByteArray projectData;
+    Set<uint32_t> dirty;
+    {
+        MutexLocker lock(&mMutex);
+        mSavePending = false;
+        dirty.swap(mDirtyShards);
+
+        Serializer out(projectData);
+        out << mDependencies << mSources << mVisitedFiles;
+    }
+    for (Set<uint32_t>::const_iterator it = dirty.begin(); it != dirty.end(); ++it) {
+        shards[*it];
+    }
+
+    uint32_t generation;
+    Set<uint32_t> unloadedNames, unloadedUsrs;
+    {
+        ReadLocker lock(&mSymbolsLock);
+        {
+            MutexLocker databaseLock(&mDatabaseMutex);
+            generation = mGeneration;
+        }
+        splitSymbols(mSymbols, shards);
+    }
+    {
+        ReadLocker lock(&mSymbolNamesLock);
+        splitNames(mSymbolNames, mFileSymbolNames, mSymbolNameShards.unloaded, shards, unloadedNames);
+    }
+    {
+        ReadLocker lock(&mUsrLock);
+        splitUsr(mUsr, mFileUsrs, mUsrShards.unloaded, shards, unloadedUsrs);
+    }
+    const int snapshotTime = timer.elapsed();
+
+    Set<uint32_t> failed;
+    const Path dir = shardsPath();
+    if (!Server::instance()->saveFileIds()) {
+        failed = shards.keys().toSet();
+    } else if (!Path::mkdir(dir)) {
+        error("Can't create directory [%s]", dir.constData());
+        failed = shards.keys().toSet();
+    }
+    if (!failed.isEmpty()) {
+        MutexLocker lock(&mMutex);
+        mDirtyShards += failed;
         return false;
     }
-    Serializer out(f);
-    out << static_cast<int>(Server::DatabaseVersion);
-    const int pos = ftell(f);
-    out << static_cast<int>(0);
+
+    ByteArray shardData;
+    {
+        Serializer out(shardData);
+        out << generation;
+    }
+    Set<uint32_t> onDisk;
+    {
+        MutexLocker lock(&mDatabaseMutex);
+        onDisk = mShards;
+    }
+    Set<uint32_t> written;
+    for (ShardMap::iterator it = shards.begin(); it != shards.end(); ++it) {
+        const Path shardPath = dir + ByteArray::number(it->first);
+        Shard &shard = it->second;
+        const bool names = unloadedNames.contains(it->first), usr = unloadedUsrs.contains(it->first);
+        if (names || usr) {
+            Database old;
+            if (openShard(it->first, old)) {
+                if (names)
+                    old.read(Database::SymbolNames, shard.symbolNames);
+                if (usr)
+                    old.read(shard.usr);
+            }
+        }
+        if (shard.isEmpty()) {
+            if (onDisk.remove(it->first))
+                Path::rm(shardPath);
+        } else if (Database::write(shardPath, shard.symbols, shard.symbolNames, shard.usr, shardData)) {
+            onDisk.insert(it->first);
+            written.insert(it->first);
+        } else {
+            onDisk.remove(it->first);
+            failed.insert(it->first);
+        }
+    }
     {
-        Scope<const SymbolMap &> scope = lockSymbolsForRead();
-        out << scope.data();
+        // Generations no shard is older than don't matter to loadSymbols() anymore
+        MutexLocker lock(&mDatabaseMutex);
+        mShards = onDisk;
+        for (Set<uint32_t>::const_iterator it = dirty.begin(); it != dirty.end(); ++it) {
+            if (written.contains(*it)) {
+                mShardGenerations[*it] = generation;
+            } else if (!onDisk.contains(*it)) {
+                mShardGenerations.remove(*it);
+            }
+        }
+        uint32_t oldest = mGeneration;
+        for (Map<uint32_t, uint32_t>::const_iterator it = mShardGenerations.begin(); it != mShardGenerations.end(); ++it)
+            oldest = std::min(oldest, it->second);
+        while (!mDirtiedFiles.isEmpty() && mDirtiedFiles.begin()->first <= oldest)
+            mDirtiedFiles.erase(mDirtiedFiles.begin());
     }
+
+    // Rewrite the name index once enough files have changed that reading
+    // them all on startup would take a while
+    Set<uint32_t> changed;
     {
-        Scope<const SymbolNameMap &> scope = lockSymbolNamesForRead();
-        out << scope.data();
+        ReadLocker namesLock(&mSymbolNamesLock);
+        ReadLocker usrLock(&mUsrLock);
+        changed = mSymbolNameShards.changed;
+        changed += mUsrShards.changed;
     }
+    const bool compacted = changed.size() > onDisk.size() / NameIndexRatio && writeNameIndex();
+
     {
-        Scope<const UsrMap &> scope = lockUsrForRead();
-        out << scope.data();
+        ReadLocker namesLock(&mSymbolNamesLock);
+        ReadLocker usrLock(&mUsrLock);
+        MutexLocker lock(&mDatabaseMutex);
+        Serializer out(projectData);
+        out << onDisk << mShardGenerations << mGeneration << mDirtiedFiles
+            << mSymbolNameShards.changed << mUsrShards.changed;
     }
-    out << mDependencies << mSources << mVisitedFiles;
+    const bool ok = Database::write(databasePath(), SymbolStore(), SymbolNameMap(), UsrIndex(), projectData);
 
-    const int size = ftell(f);
-    fseek(f, pos, SEEK_SET);
-    out << size;
+    if (!failed.isEmpty()) {
+        MutexLocker lock(&mMutex);
+        mDirtyShards += failed;
+    }
+    error() << "saved project" << path() << "in" << ByteArray::format<12>("%dms", timer.elapsed()).constData()
+            << "wrote" << written.size() << "of" << onDisk.size() << "shards" << (compacted ? "and the name index" : "")
+            << "snapshot took" << ByteArray::format<12>("%dms", snapshotTime).constData();
+    return ok && failed.isEmpty();
+}
+
+template <typename Map>
+static inline void indexNames(const Database &index, Database::Section section, const Set<uint32_t> &changed,
+                              const Map &fileNames, SymbolNameMap &names)
+{
+    const int count = index.isOpen() ? index.count(section) : 0;
+    for (int i=0; i<count; ++i) {
+        Set<Location> files = index.locations(section, i);
+        Set<Location>::iterator it = files.begin();
+        while (it != files.end()) {
+            if (changed.contains(it->fileId())) {
+                files.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        if (!files.isEmpty())
+            names[index.name(section, i)].swap(files);
+    }
+    for (Set<uint32_t>::const_iterator file = changed.begin(); file != changed.end(); ++file) {
+        const typename Map::const_iterator it = fileNames.find(*file);
+        if (it == fileNames.end())
+            continue;
+        const Location location(*file, 0);
+        for (Set<InternedString>::const_iterator name = it->second.begin(); name != it->second.end(); ++name)
+            names[*name].insert(location);
+    }
+}
+
+// Writes a new name index from the old one and the names of the files that
+// have changed since. Those are read first so the index can be built with
+// only read locks, anything that changes meanwhile stays changed.
+bool Project::writeNameIndex()
+{
+    StopWatch timer;
+    load(Database::SymbolNames);
+    load(Database::Usr);
+    Set<uint32_t> changedNames, changedUsrs;
+    {
+        WriteLocker namesLock(&mSymbolNamesLock);
+        WriteLocker usrLock(&mUsrLock);
+        changedNames = mSymbolNameShards.changed;
+        mSymbolNameShards.recent.clear();
+        changedUsrs = mUsrShards.changed;
+        mUsrShards.recent.clear();
+    }
+    SymbolNameMap symbolNames, usrs;
+    {
+        ReadLocker lock(&mSymbolNamesLock);
+        indexNames(mNameIndex, Database::SymbolNames, changedNames, mFileSymbolNames, symbolNames);
+    }
+    {
+        ReadLocker lock(&mUsrLock);
+        indexNames(mNameIndex, Database::Usr, changedUsrs, mFileUsrs, usrs);
+    }
+    const Path path = nameIndexPath();
+    if (!Database::writeNameIndex(path, symbolNames, usrs, ByteArray()))
+        return false;
 
-    error() << "saved project" << path() << "in" << ByteArray::format<12>("%dms", timer.elapsed()).constData();
-    fclose(f);
+    WriteLocker namesLock(&mSymbolNamesLock);
+    WriteLocker usrLock(&mUsrLock);
+    if (!mNameIndex.open(path)) {
+        // Nothing in the index can be trusted
+        Set<uint32_t> shards;
+        {
+            MutexLocker lock(&mDatabaseMutex);
+            shards = mShards;
+        }
+        mSymbolNameShards.changed.unite(shards);
+        mUsrShards.changed.unite(shards);
+        MutexLocker lock(&mDatabaseMutex);
+        mUnloadedSections |= Database::SymbolNames|Database::Usr;
+        return false;
+    }
+    mSymbolNameShards.changed = mSymbolNameShards.recent;
+    mUsrShards.changed = mUsrShards.recent;
+    warning() << "Wrote name index for" << mPath << "in" << timer.elapsed() << "ms";
     return true;
 }
 
@@ -384,10 +1009,17 @@ void Project::index(const SourceInformation &c, unsigned indexerJobFlags)
     }
 
     mSources[fileId] = c;
-    mPendingData.remove(fileId);
+    shared_ptr<IndexData> pending;
+    if (mPendingData.remove(fileId, &pending)) {
+        const int64_t bytes = pending->memoryUsage();
+        mPendingDataBytes -= bytes;
+        MemoryMonitor::add(MemoryMonitor::PendingData, -bytes);
+    }
 
     if (mFlags & IgnorePrintfFixits)
         indexerJobFlags |= IndexerJob::IgnorePrintfFixits;
+    if (mFlags & IndexCallbacks)
+        indexerJobFlags |= IndexerJob::IndexCallbacks;
 
     CXIndex index = 0;
     CXTranslationUnit unit = 0;
@@ -399,14 +1031,68 @@ void Project::index(const SourceInformation &c, unsigned indexerJobFlags)
     if (!mTimerRunning) {
         mTimerRunning = true;
         mTimer.start();
+        mQueryWait.clear();
+    }
+    mIndexScheduler.add(fileId, job->priority());
+    startJobs();
+}
+
+static bool fitsMemoryBudget(uint32_t fileId, void *userData)
+{
+    return MemoryBudget::estimate(fileId) <= *static_cast<const uint64_t*>(userData);
+}
+
+// Called with mMutex held
+void Project::startJobs()
+{
+    // keeping the backlog here instead of in the thread pool lets every job
+    // be picked based on the headers owned at the time a thread frees up
+    const int max = std::max(1, Server::instance()->options().threadCount);
+    while (static_cast<int>(mStartedJobs.size()) < max && !mIndexScheduler.isEmpty()) {
+        if (mIndexScheduler.needsHeaders())
+            mIndexScheduler.resolve(mVisitedFiles);
+        uint32_t fileId;
+        if (MemoryBudget::isEnabled() && !mStartedJobs.isEmpty()) {
+            // jobs that don't fit wait until one of ours finishes, with
+            // nothing running the next one always starts. Until then there's
+            // no point in looking through the backlog again.
+            if (mOverMemoryBudget)
+                break;
+            uint64_t available = MemoryBudget::available();
+            fileId = mIndexScheduler.take(fitsMemoryBudget, &available);
+            if (!fileId) {
+                debug() << "Over the memory budget, deferring" << mIndexScheduler.size() << "jobs";
+                mOverMemoryBudget = true;
+                break;
+            }
+        } else {
+            fileId = mIndexScheduler.take();
+        }
+        const shared_ptr<IndexerJob> job = mJobs.value(fileId);
+        if (!job)
+            continue;
+        mStartedJobs.insert(job);
+        if (MemoryBudget::isEnabled())
+            MemoryBudget::start(job.get(), fileId);
+        Server::instance()->startIndexerJob(job, job->priority());
+    }
+}
+
+// Called with mMutex held
+void Project::unvisitFiles(const Set<uint32_t> &files)
+{
+    for (Set<uint32_t>::const_iterator it = files.begin(); it != files.end(); ++it) {
+        if (mVisitedFiles.remove(*it))
+            mIndexScheduler.onUnvisited(*it);
     }
-    Server::instance()->startIndexerJob(job, job->priority());
 }
 
 void Project::onFileModified(const Path &file)
 {
     const uint32_t fileId = Location::fileId(file);
     warning() << file << "was modified" << fileId << mModifiedFiles.contains(fileId);
+    if (fileId)
+        FileCache::invalidate(fileId);
     if (!fileId || !mModifiedFiles.insert(fileId)) {
         return;
     }
@@ -424,25 +1110,40 @@ SourceInformation Project::sourceInfo(uint32_t fileId) const
     return SourceInformation();
 }
 
-void Project::addDependencies(const DependencyMap &deps, Set<uint32_t> &newFiles)
+void Project::addDependencies(DependencyMap &deps, Set<uint32_t> &newFiles)
 {
     StopWatch timer;
 
-    const DependencyMap::const_iterator end = deps.end();
-    for (DependencyMap::const_iterator it = deps.begin(); it != end; ++it) {
-        Set<uint32_t> &values = mDependencies[it->first];
-        if (values.isEmpty()) {
-            values = it->second;
-        } else {
-            values.unite(it->second);
-        }
+    const DependencyMap::iterator end = deps.end();
+    for (DependencyMap::iterator it = deps.begin(); it != end; ++it) {
         if (newFiles.isEmpty()) {
             newFiles = it->second;
         } else {
             newFiles.unite(it->second);
         }
         newFiles.insert(it->first);
+        Set<uint32_t> &values = mDependencies[it->first];
+        if (values.isEmpty()) {
+            values.swap(it->second);
+            for (Set<uint32_t>::const_iterator i = values.begin(); i != values.end(); ++i)
+                mIndexScheduler.addInclude(*i, it->first);
+        } else {
+            for (Set<uint32_t>::const_iterator i = it->second.begin(); i != it->second.end(); ++i) {
+                if (values.insert(*i))
+                    mIndexScheduler.addInclude(*i, it->first);
+            }
+        }
+    }
+}
+
+bool Project::isVisited(const Set<uint32_t> &fileIds) const
+{
+    MutexLocker lock(&mMutex);
+    for (Set<uint32_t>::const_iterator it = fileIds.begin(); it != fileIds.end(); ++it) {
+        if (!mVisitedFiles.contains(*it))
+            return false;
     }
+    return true;
 }
 
 Set<uint32_t> Project::dependencies(uint32_t fileId) const
@@ -488,6 +1189,36 @@ void Project::onValidateDBJobErrors(const Set<Location> &errors)
     mPreviousErrors = errors;
 }
 
+// Names left without locations are erased and added to removed
+static inline void dirtySymbolNames(SymbolNameMap &map, Map<uint32_t, Set<InternedString> > &fileNames,
+                                    const Set<uint32_t> &dirty, List<InternedString> &removed)
+{
+    for (Set<uint32_t>::const_iterator file = dirty.begin(); file != dirty.end(); ++file) {
+        Set<InternedString> names;
+        if (!fileNames.remove(*file, &names))
+            continue;
+        for (Set<InternedString>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            const SymbolNameMap::iterator it = map.find(*name);
+            if (it == map.end())
+                continue;
+            Set<Location> &locations = it->second;
+            Set<Location>::iterator i = locations.lower_bound(Location(*file, 0));
+            while (i != locations.end() && i->fileId() == *file)
+                locations.erase(i++);
+            if (locations.isEmpty()) {
+                removed.append(it->first);
+                map.erase(it);
+            }
+        }
+    }
+}
+
+static inline void dirtyFileUsrs(Map<uint32_t, Set<InternedString> > &fileUsrs, const Set<uint32_t> &dirty)
+{
+    for (Set<uint32_t>::const_iterator it = dirty.begin(); it != dirty.end(); ++it)
+        fileUsrs.remove(*it);
+}
+
 void Project::onFilesModifiedTimeout()
 {
     Set<uint32_t> dirtyFiles;
@@ -498,10 +1229,11 @@ void Project::onFilesModifiedTimeout()
             dirtyFiles.insert(*it);
             dirtyFiles.unite(mDependencies.value(*it));
         }
-        mVisitedFiles -= dirtyFiles;
+        unvisitFiles(dirtyFiles);
         mPendingDirtyFiles.unite(dirtyFiles);
         mModifiedFiles.clear();
     }
+    PreambleCache::invalidate(dirtyFiles);
     bool indexed = false;
     for (Set<uint32_t>::const_iterator it = dirtyFiles.begin(); it != dirtyFiles.end(); ++it) {
         const SourceInformationMap::const_iterator found = mSources.find(*it);
@@ -510,39 +1242,68 @@ void Project::onFilesModifiedTimeout()
             indexed = true;
         }
     }
-    if (!indexed && !mPendingDirtyFiles.isEmpty()) {
-        {
-            Scope<SymbolMap&> symbols = lockSymbolsForWrite();
-            RTags::dirtySymbols(symbols.data(), mPendingDirtyFiles);
-        }
-        {
-            Scope<SymbolNameMap&> symbolNames = lockSymbolNamesForWrite();
-            RTags::dirtySymbolNames(symbolNames.data(), mPendingDirtyFiles);
-        }
-        {
-            Scope<UsrMap&> usr = lockUsrForWrite();
-            RTags::dirtyUsr(usr.data(), mPendingDirtyFiles);
+    // with nothing to reindex there's no job to merge after, dirty the maps now
+    if (!indexed)
+        merge();
+}
+
+template <typename Locations>
+static inline void addFiles(const Locations &locations, Set<uint32_t> &files)
+{
+    for (typename Locations::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        files.insert(it->fileId());
+    }
+}
+
+// Records name in fileNames for each file it has locations in
+template <typename Locations>
+static inline void addFileNames(const InternedString &name, const Locations &locations,
+                                Map<uint32_t, Set<InternedString> > &fileNames, Set<uint32_t> &files)
+{
+    uint32_t last = 0;
+    for (typename Locations::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        const uint32_t fileId = it->fileId();
+        if (fileId != last) {
+            files.insert(fileId);
+            fileNames[fileId].insert(name);
+            last = fileId;
         }
-        mPendingDirtyFiles.clear();
     }
 }
 
-static inline void writeSymbolNames(const SymbolNameMap &symbolNames, SymbolNameMap &current)
+// trie and fuzzy are 0 until they've been loaded
+static inline void writeSymbolNames(const ArenaSymbolNameMap &symbolNames, SymbolNameMap &current,
+                                    Map<uint32_t, Set<InternedString> > &fileNames, SymbolNameTrie *trie,
+                                    FuzzySymbolIndex *fuzzy, Set<uint32_t> &modifiedFiles)
 {
-    SymbolNameMap::const_iterator it = symbolNames.begin();
-    const SymbolNameMap::const_iterator end = symbolNames.end();
+    ArenaSymbolNameMap::const_iterator it = symbolNames.begin();
+    const ArenaSymbolNameMap::const_iterator end = symbolNames.end();
     while (it != end) {
-        Set<Location> &value = current[it->first];
-        value.unite(it->second);
+        SymbolNameMap::iterator pos = current.lower_bound(it->first);
+        if (pos == current.end() || it->first < pos->first) {
+            pos = current.insert(pos, std::make_pair(it->first, Set<Location>()));
+            if (trie) {
+                trie->insert(it->first);
+                fuzzy->insert(it->first);
+            }
+            // the locations are sorted, appending each one is constant time
+            Set<Location> &locations = pos->second;
+            for (ArenaLocationSet::const_iterator l = it->second.begin(); l != it->second.end(); ++l)
+                locations.insert(locations.end(), *l);
+        } else {
+            pos->second.unite(it->second);
+        }
+        addFileNames(it->first, it->second, fileNames, modifiedFiles);
         ++it;
     }
 }
 
-static inline void joinCursors(SymbolMap &symbols, const Set<Location> &locations)
+static inline void joinCursors(SymbolStore &symbols, const Set<Location> &locations, Set<uint32_t> &modifiedFiles)
 {
     for (Set<Location>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
-        SymbolMap::iterator c = symbols.find(*it);
+        SymbolStore::iterator c = symbols.find(*it);
         if (c != symbols.end()) {
+            modifiedFiles.insert(it->fileId());
             CursorInfo &cursorInfo = c->second;
             for (Set<Location>::const_iterator innerIt = locations.begin(); innerIt != locations.end(); ++innerIt) {
                 if (innerIt != it)
@@ -553,26 +1314,38 @@ static inline void joinCursors(SymbolMap &symbols, const Set<Location> &location
     }
 }
 
-static inline void writeUsr(const UsrMap &usr, UsrMap &current, SymbolMap &symbols)
+// usrFiles are the files whose usrs changed, modifiedFiles the ones whose cursors did
+static inline void writeUsr(UsrIndex &usr, UsrIndex &current, Map<uint32_t, Set<InternedString> > &fileUsrs,
+                            SymbolStore &symbols, Set<uint32_t> &usrFiles, Set<uint32_t> &modifiedFiles)
 {
-    UsrMap::const_iterator it = usr.begin();
-    const UsrMap::const_iterator end = usr.end();
+    UsrIndex::iterator it = usr.begin();
+    const UsrIndex::iterator end = usr.end();
     while (it != end) {
-        Set<Location> &value = current[it->first];
+        Set<Location> &value = current.insert(it->usr, it->hash);
         int count = 0;
-        value.unite(it->second, &count);
+        if (value.isEmpty()) {
+            // nothing to merge with, take the job's set
+            value.swap(it->locations);
+            count = value.size();
+            addFileNames(it->usr, value, fileUsrs, usrFiles);
+        } else {
+            value.unite(it->locations, &count);
+            if (count)
+                addFileNames(it->usr, it->locations, fileUsrs, usrFiles);
+        }
         if (count && value.size() > 1)
-            joinCursors(symbols, value);
+            joinCursors(symbols, value, modifiedFiles);
         ++it;
     }
 }
 
-static inline void writeCursors(SymbolMap &symbols, SymbolMap &current)
+static inline void writeCursors(ArenaSymbolMap &symbols, SymbolStore &current, Set<uint32_t> &modifiedFiles)
 {
     if (!symbols.isEmpty()) {
-        SymbolMap::iterator it = symbols.begin();
-        const SymbolMap::iterator end = symbols.end();
+        ArenaSymbolMap::iterator it = symbols.begin();
+        const ArenaSymbolMap::iterator end = symbols.end();
         while (it != end) {
+            modifiedFiles.insert(it->first.fileId());
             // This is kind of a hack but we use these cursors' symbolnames
             // to make the symbolname of references earlier so we can't
             // inject the class/struct/union stuff then and here we're
@@ -580,40 +1353,31 @@ static inline void writeCursors(SymbolMap &symbols, SymbolMap &current)
             switch (it->second.kind) {
             case CXCursor_ClassDecl:
             case CXCursor_ClassTemplate:
-                it->second.symbolName.prepend("class ");
+                it->second.setSymbolName("class " + it->second.symbolName());
                 break;
             case CXCursor_StructDecl:
-                it->second.symbolName.prepend("struct ");
+                it->second.setSymbolName("struct " + it->second.symbolName());
                 break;
             case CXCursor_UnionDecl:
-                it->second.symbolName.prepend("union ");
+                it->second.setSymbolName("union " + it->second.symbolName());
                 break;
             default:
                 break;
             }
-            if (!current.isEmpty()) {
-                SymbolMap::iterator cur = current.find(it->first);
-                if (cur == current.end()) {
-                    current[it->first] = it->second;
-                } else {
-                    cur->second.unite(it->second);
-                }
-            }
             ++it;
         }
-        if (current.isEmpty()) {
-            current = symbols;
-        }
+        current.unite(symbols);
     }
 }
 
-static inline void writeReferences(const ReferenceMap &references, SymbolMap &symbols)
+static inline void writeReferences(const ArenaReferenceMap &references, SymbolStore &symbols, Set<uint32_t> &modifiedFiles)
 {
     if (!references.isEmpty()) {
-        const ReferenceMap::const_iterator end = references.end();
-        for (ReferenceMap::const_iterator it = references.begin(); it != end; ++it) {
-            const Set<Location> &refs = it->second;
-            for (Set<Location>::const_iterator rit = refs.begin(); rit != refs.end(); ++rit) {
+        const ArenaReferenceMap::const_iterator end = references.end();
+        for (ArenaReferenceMap::const_iterator it = references.begin(); it != end; ++it) {
+            const ArenaLocationSet &refs = it->second;
+            addFiles(refs, modifiedFiles);
+            for (ArenaLocationSet::const_iterator rit = refs.begin(); rit != refs.end(); ++rit) {
                 CursorInfo &ci = symbols[*rit];
                 ci.references.insert(it->first);
             }
@@ -624,26 +1388,123 @@ static inline void writeReferences(const ReferenceMap &references, SymbolMap &sy
 
 void Project::write()
 {
-    Scope<SymbolMap&> symbols = lockSymbolsForWrite();
-    Scope<SymbolNameMap&> symbolNames = lockSymbolNamesForWrite();
-    Scope<UsrMap&> usr = lockUsrForWrite();
-    if (!mPendingDirtyFiles.isEmpty()) {
-        RTags::dirtySymbols(symbols.data(), mPendingDirtyFiles);
-        RTags::dirtySymbolNames(symbolNames.data(), mPendingDirtyFiles);
-        RTags::dirtyUsr(usr.data(), mPendingDirtyFiles);
-        mPendingDirtyFiles.clear();
-    }
-
-    Set<uint32_t> newFiles;
-    for (Map<uint32_t, shared_ptr<IndexData> >::iterator it = mPendingData.begin(); it != mPendingData.end(); ++it) {
-        const shared_ptr<IndexData> &data = it->second;
-        addDependencies(data->dependencies, newFiles);
-        addDiagnostics(data->dependencies, data->diagnostics, data->fixIts);
-        writeCursors(data->symbols, symbols.data());
-        writeUsr(data->usrMap, usr.data(), symbols.data());
-        writeReferences(data->references, symbols.data());
-        writeSymbolNames(data->symbolNames, symbolNames.data());
+    while (merge()) {}
+}
+
+// Removes what dirty's files put in the maps, one map at a time so queries
+// only ever wait for one of them. Called with mMergeMutex held.
+void Project::dirtyMaps(const Set<uint32_t> &dirty, Set<uint32_t> &modified)
+{
+    {
+        // Shards of files that haven't been looked up yet are scrubbed
+        // when they are, see loadSymbols()
+        Scope<SymbolStore&> symbols = lockSymbolsForWrite();
+        {
+            MutexLocker lock(&mDatabaseMutex);
+            mDirtiedFiles[++mGeneration] = dirty;
+        }
+        symbols.data().dirty(dirty, &modified);
+        updateSymbolBytes(symbols.data(), modified);
+    }
+    {
+        Scope<SymbolNameMap&> symbolNames = lockSymbolNamesForWrite();
+        mSymbolNameShards.unloaded -= dirty;
+        mSymbolNameShards.change(dirty);
+        List<InternedString> removed;
+        dirtySymbolNames(symbolNames.data(), mFileSymbolNames, dirty, removed);
+        if (mSymbolNameTrieLoaded) {
+            // Files that haven't been read may still have the name
+            Set<uint32_t> files;
+            for (List<InternedString>::const_iterator it = removed.begin(); it != removed.end(); ++it) {
+                files.clear();
+                indexFiles(Database::SymbolNames, *it, files);
+                if (files.isEmpty()) {
+                    mSymbolNameTrie.remove(*it);
+                    mFuzzySymbolIndex.remove(*it);
+                }
+            }
+        }
+    }
+    {
+        Scope<UsrIndex&> usr = lockUsrForWrite();
+        mUsrShards.unloaded -= dirty;
+        mUsrShards.change(dirty);
+        usr.data().dirty(dirty);
+        dirtyFileUsrs(mFileUsrs, dirty);
+    }
+}
+
+// Merges pending data until about MergeSlice entries have been written. The
+// slice is taken under mMutex but merged without it so jobs can visit files
+// and finish meanwhile, and each map is locked for one slice at a time so
+// queries never wait for a whole batch of jobs. mMergeMutex keeps merges in
+// the order their slices were taken. Returns true if there's more left.
+bool Project::merge()
+{
+    MutexLocker mergeLock(&mMergeMutex);
+    Set<uint32_t> dirty, newFiles;
+    List<shared_ptr<IndexData> > slice;
+    int64_t bytes = 0;
+    bool more;
+    {
+        MutexLocker lock(&mMutex);
+        dirty.swap(mPendingDirtyFiles);
+        int entries = 0;
+        while (!mPendingData.isEmpty() && (slice.isEmpty() || entries < MergeSlice)) {
+            const Map<uint32_t, shared_ptr<IndexData> >::iterator it = mPendingData.begin();
+            const shared_ptr<IndexData> &data = it->second;
+            entries += data->symbols.size() + data->references.size() + data->symbolNames.size() + data->usrs.size();
+            bytes += data->memoryUsage();
+            slice.append(data);
+            mPendingData.erase(it);
+        }
+        for (int i=0; i<slice.size(); ++i) {
+            const shared_ptr<IndexData> &data = slice.at(i);
+            addDependencies(data->dependencies, newFiles);
+            addDiagnostics(data->dependencies, data->diagnostics, data->fixIts);
+        }
+        mPendingDataBytes -= bytes;
+        more = !mPendingData.isEmpty();
     }
+    MemoryMonitor::add(MemoryMonitor::PendingData, -bytes);
+
+    Set<uint32_t> modified = dirty;
+    if (!dirty.isEmpty())
+        dirtyMaps(dirty, modified);
+    if (!slice.isEmpty()) {
+        loadSlice(slice);
+        {
+            Scope<SymbolStore&> symbols = lockSymbolsForWrite();
+            Scope<UsrIndex&> usr = lockUsrForWrite();
+            Set<uint32_t> usrFiles;
+            for (int i=0; i<slice.size(); ++i) {
+                const shared_ptr<IndexData> &data = slice.at(i);
+                writeCursors(data->symbols, symbols.data(), modified);
+                writeUsr(data->usrs, usr.data(), mFileUsrs, symbols.data(), usrFiles, modified);
+                writeReferences(data->references, symbols.data(), modified);
+            }
+            updateSymbolBytes(symbols.data(), modified);
+            mUsrShards.change(usrFiles);
+            modified += usrFiles;
+        }
+        {
+            Scope<SymbolNameMap&> symbolNames = lockSymbolNamesForWrite();
+            SymbolNameTrie *trie = mSymbolNameTrieLoaded ? &mSymbolNameTrie : 0;
+            FuzzySymbolIndex *fuzzy = mSymbolNameTrieLoaded ? &mFuzzySymbolIndex : 0;
+            Set<uint32_t> nameFiles;
+            for (int i=0; i<slice.size(); ++i) {
+                const shared_ptr<IndexData> &data = slice.at(i);
+                writeSymbolNames(data->symbolNames, symbolNames.data(), mFileSymbolNames, trie, fuzzy, nameFiles);
+            }
+            mSymbolNameShards.change(nameFiles);
+            modified += nameFiles;
+        }
+    }
+    if (modified.isEmpty() && newFiles.isEmpty())
+        return more;
+
+    MutexLocker lock(&mMutex);
+    mDirtyShards += modified;
     for (Set<uint32_t>::const_iterator it = newFiles.begin(); it != newFiles.end(); ++it) {
         const Path path = Location::path(*it);
         const Path dir = path.parentDir();
@@ -653,7 +1514,51 @@ void Project::write()
             mWatcher.watch(dir);
         }
     }
-    mPendingData.clear();
+    return more;
+}
+
+// The names and usrs the slice adds to have to be read from the shards
+// first, or they'd end up with only the slice's locations
+void Project::loadSlice(const List<shared_ptr<IndexData> > &slice)
+{
+    Set<uint32_t> nameFiles, usrFiles;
+    for (int i=0; i<slice.size(); ++i) {
+        const shared_ptr<IndexData> &data = slice.at(i);
+        for (ArenaSymbolNameMap::const_iterator it = data->symbolNames.begin(); it != data->symbolNames.end(); ++it)
+            addFiles(it->second, nameFiles);
+    }
+    load(Database::Usr);
+    {
+        ReadLocker lock(&mUsrLock);
+        for (int i=0; i<slice.size(); ++i) {
+            const UsrIndex &usrs = slice.at(i)->usrs;
+            for (UsrIndex::const_iterator it = usrs.begin(); it != usrs.end(); ++it) {
+                addFiles(it->locations, usrFiles);
+                indexFiles(Database::Usr, it->usr, usrFiles);
+            }
+        }
+    }
+    loadNames(Database::SymbolNames, nameFiles);
+    loadNames(Database::Usr, usrFiles);
+}
+
+// Called with mSymbolsLock locked for write
+void Project::updateSymbolBytes(const SymbolStore &symbols, const Set<uint32_t> &files)
+{
+    int64_t delta = 0;
+    for (Set<uint32_t>::const_iterator it = files.begin(); it != files.end(); ++it) {
+        const int64_t bytes = symbols.memoryUsage(*it);
+        if (bytes) {
+            int64_t &old = mSymbolBytes[*it];
+            delta += bytes - old;
+            old = bytes;
+        } else {
+            int64_t old;
+            if (mSymbolBytes.remove(*it, &old))
+                delta -= old;
+        }
+    }
+    MemoryMonitor::add(MemoryMonitor::Symbols, delta);
 }
 
 bool Project::isIndexed(uint32_t fileId) const
@@ -682,6 +1587,8 @@ void Project::addCachedUnit(const Path &path, const List<ByteArray> &args, CXInd
     cachedUnit->index = index;
     cachedUnit->unit = unit;
     cachedUnit->arguments = args;
+    cachedUnit->memory = RTags::memoryUsage(unit);
+    MemoryMonitor::add(MemoryMonitor::CachedUnits, cachedUnit->memory);
     if (!mFirstCachedUnit) {
         assert(!mLastCachedUnit);
         assert(!mUnitCacheSize);
@@ -758,20 +1665,20 @@ void Project::addToCache(const Path &path, const List<ByteArray> &args, CXIndex
     addCachedUnit(path, args, index, unit);
 }
 
-void Project::addDiagnostics(const DependencyMap &visited, const DiagnosticsMap &diagnostics, const FixItMap &fixIts) // lock always held
+void Project::addDiagnostics(const DependencyMap &visited, DiagnosticsMap &diagnostics, FixItMap &fixIts) // lock always held
 {
     for (DependencyMap::const_iterator it = visited.begin(); it != visited.end(); ++it) {
-        const FixItMap::const_iterator fit = fixIts.find(it->first);
+        const FixItMap::iterator fit = fixIts.find(it->first);
         if (fit == fixIts.end()) {
             mFixIts.erase(it->first);
         } else {
-            mFixIts[it->first] = fit->second;
+            mFixIts[it->first].swap(fit->second);
         }
-        const DiagnosticsMap::const_iterator dit = diagnostics.find(it->first);
+        const DiagnosticsMap::iterator dit = diagnostics.find(it->first);
         if (dit == diagnostics.end()) {
             mDiagnostics.erase(it->first);
         } else {
-            mDiagnostics[it->first] = dit->second;
+            mDiagnostics[it->first].swap(dit->second);
         }
 
     }
@@ -798,10 +1705,33 @@ ByteArray Project::fixIts(uint32_t fileId) const
     return out;
 }
 
+void Project::event(const Event *e)
+{
+    switch (e->type()) {
+    case ShardsFailedEvent::Type: {
+        const Set<uint32_t> &files = static_cast<const ShardsFailedEvent*>(e)->files;
+        for (Set<uint32_t>::const_iterator it = files.begin(); it != files.end(); ++it) {
+            FileCache::invalidate(*it);
+            mModifiedFiles.insert(*it);
+        }
+        enum { Timeout = 200 };
+        mModifiedFilesTimer.start(shared_from_this(), Timeout, true, reinterpret_cast<void*>(ModifiedFiles));
+        break; }
+    default:
+        EventReceiver::event(e);
+        break;
+    }
+}
+
 void Project::timerEvent(TimerEvent *e)
 {
     if (e->userData() == Finished) {
         finish();
+    } else if (e->userData() == Merge) {
+        if (merge()) {
+            MutexLocker lock(&mMutex);
+            mMergeTimer.start(shared_from_this(), 0, true, Merge);
+        }
     } else if (e->userData() == ModifiedFiles) {
         onFilesModifiedTimeout();
     } else {
@@ -2,13 +2,22 @@
 #define Project_h
 
 #include "CursorInfo.h"
+#include "Database.h"
 #include "Path.h"
 #include "RTags.h"
 #include "Match.h"
 #include "RegExp.h"
+#include "SymbolNameTrie.h"
+#include "FuzzySymbolIndex.h"
+#include "FileIndex.h"
+#include "IndexScheduler.h"
+#include "LatencyHistogram.h"
+#include "SymbolStore.h"
+#include "UsrIndex.h"
 #include "EventReceiver.h"
 #include "ReadWriteLock.h"
 #include "FileSystemWatcher.h"
+#include "MemoryMonitor.h"
 
 template <typename T>
 class Scope
@@ -37,7 +46,7 @@ private:
 struct CachedUnit
 {
     CachedUnit()
-        : next(0), unit(0), index(0)
+        : next(0), unit(0), index(0), memory(0)
     {}
     ~CachedUnit()
     {
@@ -45,10 +54,12 @@ struct CachedUnit
             clang_disposeTranslationUnit(unit);
         if (index)
             clang_disposeIndex(index);
+        MemoryMonitor::add(MemoryMonitor::CachedUnits, -static_cast<int64_t>(memory));
     }
     CachedUnit *next;
     CXTranslationUnit unit;
     CXIndex index;
+    uint64_t memory;
     Path path;
     List<ByteArray> arguments;
 };
@@ -61,6 +72,7 @@ class Project : public EventReceiver
 {
 public:
     Project(const Path &path);
+    ~Project();
     bool isValid() const;
     void init();
     bool restore();
@@ -70,33 +82,67 @@ public:
     shared_ptr<FileManager> fileManager;
 
     Path path() const { return mPath; }
+    Path databasePath() const;
+    Path shardsPath() const;
+    Path nameIndexPath() const;
 
     bool match(const Match &match);
 
-    Scope<const SymbolMap&> lockSymbolsForRead(int maxTime = 0);
-    Scope<SymbolMap&> lockSymbolsForWrite();
+    // How long queries wait for the maps is tracked in queryWait(), rdm's
+    // own readers pass InternalLock so they don't count
+    enum LockType {
+        QueryLock,
+        InternalLock
+    };
+
+    Scope<const SymbolStore&> lockSymbolsForRead(int maxTime = 0, LockType type = QueryLock);
+    Scope<SymbolStore&> lockSymbolsForWrite();
 
-    Scope<const SymbolNameMap&> lockSymbolNamesForRead(int maxTime = 0);
+    Scope<const SymbolNameMap&> lockSymbolNamesForRead(int maxTime = 0, LockType type = QueryLock);
     Scope<SymbolNameMap&> lockSymbolNamesForWrite();
+    // The keys of the symbol names map, only use while holding its lock
+    const SymbolNameTrie &symbolNameTrie() const { return mSymbolNameTrie; }
+    const FuzzySymbolIndex &fuzzySymbolIndex() const { return mFuzzySymbolIndex; }
 
     Scope<const FilesMap&> lockFilesForRead(int maxTime = 0);
     Scope<FilesMap&> lockFilesForWrite();
-
-    Scope<const UsrMap&> lockUsrForRead(int maxTime = 0);
-    Scope<UsrMap&> lockUsrForWrite();
+    // The files map's paths, only use while holding its lock
+    const FileIndex &fileIndex() const { return mFileIndex; }
+    FileIndex &fileIndex() { return mFileIndex; }
+
+    Scope<const UsrIndex&> lockUsrForRead(int maxTime = 0, LockType type = QueryLock);
+    Scope<UsrIndex&> lockUsrForWrite();
+
+    // The maps only hold what has been read from the shards so far. Symbols
+    // are read by SymbolStore as they're looked up, lookups by name have to
+    // call loadName() before locking the map, listing names by prefix or
+    // fuzzily loadSymbolNameTrie() and anything that walks a whole map
+    // loadAll().
+    void loadName(Database::Section section, const ByteArray &name);
+    void loadSymbolNameTrie();
+    void loadAll(unsigned sections);
+    // The files name has locations in, only use while holding the symbol
+    // names lock
+    void symbolNameFiles(const InternedString &name, Set<uint32_t> &files) const;
 
     bool isIndexed(uint32_t fileId) const;
 
+    // How long queries waited for the maps' locks since indexing last started
+    const LatencyHistogram &queryWait() const { return mQueryWait; }
+
     enum Flag {
         None = 0x0,
         Validate = 0x1,
-        IgnorePrintfFixits = 0x2
+        IgnorePrintfFixits = 0x2,
+        IndexCallbacks = 0x4
     };
 
     void index(const SourceInformation &args, unsigned indexerJobFlags);
     SourceInformation sourceInfo(uint32_t fileId) const;
     Set<uint32_t> dependencies(uint32_t fileId) const;
     bool visitFile(uint32_t fileId, const shared_ptr<IndexerJob> &job);
+    // True if all of fileIds have been visited by a job
+    bool isVisited(const Set<uint32_t> &fileIds) const;
     ByteArray fixIts(uint32_t fileId) const;
     ByteArray diagnostics() const;
     int reindex(const Match &match);
@@ -107,33 +153,104 @@ public:
     bool fetchFromCache(const Path &path, List<ByteArray> &args, CXIndex &index, CXTranslationUnit &unit);
     void addToCache(const Path &path, const List<ByteArray> &args, CXIndex index, CXTranslationUnit unit);
     void timerEvent(TimerEvent *event);
+protected:
+    virtual void event(const Event *event);
 private:
+    friend class SaveJob;
     bool initJobFromCache(const Path &path, const List<ByteArray> &args,
                           CXIndex &index, CXTranslationUnit &unit, List<ByteArray> *argsOut);
     void onFileModified(const Path &);
-    void addDependencies(const DependencyMap &hash, Set<uint32_t> &newFiles);
-    void addDiagnostics(const DependencyMap &dependencies, const DiagnosticsMap &diagnostics, const FixItMap &fixIts);
+    // Both move the job's data into the project, leaving it empty
+    void addDependencies(DependencyMap &hash, Set<uint32_t> &newFiles);
+    void addDiagnostics(const DependencyMap &dependencies, DiagnosticsMap &diagnostics, FixItMap &fixIts);
     void write();
     void onFilesModifiedTimeout();
     void addCachedUnit(const Path &path, const List<ByteArray> &args, CXIndex index, CXTranslationUnit unit);
     bool finish();
+    void startSave();
     bool save();
     void onValidateDBJobErrors(const Set<Location> &errors);
-    
+    void load(Database::Section section);
+    static bool loadSymbols(uint32_t fileId, SymbolStore::FileSymbols &symbols, void *userData);
+    bool openShard(uint32_t fileId, Database &database);
+    void loadNames(Database::Section section, const Set<uint32_t> &files);
+    int readNames(Database::Section section, const Set<uint32_t> &files);
+    void loadSlice(const List<shared_ptr<IndexData> > &slice);
+    void indexFiles(Database::Section section, const ByteArray &name, Set<uint32_t> &files) const;
+    bool writeNameIndex();
+    void startJobs();
+    void unvisitFiles(const Set<uint32_t> &files);
+    void updateSymbolBytes(const SymbolStore &symbols, const Set<uint32_t> &files);
+    bool merge();
+    void dirtyMaps(const Set<uint32_t> &dirty, Set<uint32_t> &modified);
+
     const Path mPath;
 
-    SymbolMap mSymbols;
+    SymbolStore mSymbols;
     ReadWriteLock mSymbolsLock;
+    // What each file's cursors take, protected by mSymbolsLock. loadSymbols()
+    // writes it with only a read lock but holding mSymbols' load mutex.
+    Map<uint32_t, int64_t> mSymbolBytes;
+    LatencyHistogram mQueryWait;
 
     SymbolNameMap mSymbolNames;
+    // Built by loadSymbolNameTrie() and kept up to date from then on
+    SymbolNameTrie mSymbolNameTrie;
+    FuzzySymbolIndex mFuzzySymbolIndex;
+    bool mSymbolNameTrieLoaded;
     ReadWriteLock mSymbolNamesLock;
 
-    UsrMap mUsr;
+    UsrIndex mUsr;
     ReadWriteLock mUsrLock;
 
+    // The symbol names and usrs that have locations in each file, so saving
+    // and dirtying a file only has to look at its own entries. Protected by
+    // mSymbolNamesLock and mUsrLock respectively.
+    Map<uint32_t, Set<InternedString> > mFileSymbolNames, mFileUsrs;
+
     FilesMap mFiles;
+    FileIndex mFileIndex;
     ReadWriteLock mFilesLock;
 
+    // The database is sharded by fileId. mShards are the files that have a
+    // shard on disk and is protected by mDatabaseMutex. mDirtyShards are the
+    // files whose shards need to be rewritten on the next save and is
+    // protected by mMutex.
+    Set<uint32_t> mShards, mDirtyShards;
+    Mutex mDatabaseMutex;
+    bool mSavePending;
+
+    // A shard can have locations in files that have been dirtied since it
+    // was written, loadSymbols() drops them. mGeneration is bumped by every
+    // dirtyMaps(), mDirtiedFiles are the files dirtied in each generation
+    // and mShardGenerations the generation each shard is known to be up to
+    // date with. Protected by mDatabaseMutex.
+    uint32_t mGeneration;
+    Map<uint32_t, Set<uint32_t> > mDirtiedFiles;
+    Map<uint32_t, uint32_t> mShardGenerations;
+
+    // mNameIndex maps symbol names and usrs to the files they were in when
+    // it was written so a lookup only reads the shards of those files. Files
+    // whose names have changed since are read on the section's first
+    // access, mUnloadedSections are the sections where that hasn't happened
+    // yet and is protected by mDatabaseMutex. mNameIndex is replaced with
+    // both sections' locks held for write, the rest is protected by the
+    // section's lock.
+    struct NameShards {
+        Set<uint32_t> unloaded; // shards that haven't been read into the map
+        Set<uint32_t> changed; // files whose names differ from mNameIndex's
+        Set<uint32_t> recent; // changed since writeNameIndex() took its snapshot
+
+        void change(const Set<uint32_t> &files)
+        {
+            changed.unite(files);
+            recent.unite(files);
+        }
+    };
+    Database mNameIndex;
+    NameShards mSymbolNameShards, mUsrShards;
+    unsigned mUnloadedSections;
+
     enum InitMode {
         Normal,
         NoValidate,
@@ -154,9 +271,15 @@ private:
         unsigned jobFlags;
     };
     Map<uint32_t, PendingJob> mPendingJobs;
+    // jobs wait in mIndexScheduler until there's a thread for them
+    IndexScheduler mIndexScheduler;
+    // Nothing in mIndexScheduler fit the memory budget, set until one of our
+    // jobs finishes
+    bool mOverMemoryBudget;
+    Set<shared_ptr<IndexerJob> > mStartedJobs;
 
     Set<uint32_t> mModifiedFiles;
-    Timer mModifiedFilesTimer, mFinishedTimer;
+    Timer mModifiedFilesTimer, mFinishedTimer, mMergeTimer;
 
     bool mTimerRunning;
     StopWatch mTimer;
@@ -176,7 +299,10 @@ private:
     unsigned mFlags;
 
     Map<uint32_t, shared_ptr<IndexData> > mPendingData;
+    int64_t mPendingDataBytes;
     Set<uint32_t> mPendingDirtyFiles;
+    // Held by merge() for the whole merge, never taken while holding mMutex
+    Mutex mMergeMutex;
 
     CachedUnit *mFirstCachedUnit, *mLastCachedUnit;
     int mUnitCacheSize;
@@ -191,6 +317,7 @@ inline bool Project::visitFile(uint32_t fileId, const shared_ptr<IndexerJob> &jo
 
     mVisitedFiles.insert(fileId);
     mVisitedFilesByJob[job].insert(fileId);
+    mIndexScheduler.onVisited(fileId);
     return true;
 }
 
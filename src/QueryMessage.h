@@ -34,7 +34,8 @@ public:
         ReloadProjects,
         Shutdown,
         Status,
-        UnloadProject
+        UnloadProject,
+        FuzzySymbols // last so the values of the older ones don't change
     };
 
     enum Flag {
@@ -264,6 +264,7 @@ enum {
     FindVirtuals,
     FixIts,
     FollowLocation,
+    FuzzySymbols,
     HasFileManager,
     Help,
     IsIndexed,
@@ -334,8 +335,9 @@ struct Option opts[] = {
     { ReferenceLocation, "references", 'r', required_argument, "Find references matching this location." },
     { ListSymbols, "list-symbols", 'S', optional_argument, "List symbol names matching arg." },
     { FindSymbols, "find-symbols", 'F', required_argument, "Find symbols matching arg." },
+    { FuzzySymbols, "fuzzy-symbols", 'J', required_argument, "List symbol names containing the characters of arg in order, best matches first." },
     { CursorInfo, "cursor-info", 'U', required_argument, "Get cursor info for this location." },
-    { Status, "status", 's', optional_argument, "Dump status of rdm. Arg can be symbols or symbolNames." },
+    { Status, "status", 's', optional_argument, "Dump status of rdm. Arg can be symbols, symbolNames or memory." },
     { IsIndexed, "is-indexed", 'T', required_argument, "Check if rtags knows about, and is ready to return information about, this source file." },
     { HasFileManager, "has-filemanager", 0, optional_argument, "Check if rtags has info about files in this directory." },
     { PreprocessFile, "preprocess", 'E', required_argument, "Preprocess file." },
@@ -776,6 +778,9 @@ bool RClient::parse(int &argc, char **argv)
         case FindSymbols:
             addQuery(QueryMessage::FindSymbols, optarg);
             break;
+        case FuzzySymbols:
+            addQuery(QueryMessage::FuzzySymbols, optarg);
+            break;
         }
     }
     if (optind < argc) {
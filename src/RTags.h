@@ -1,6 +1,7 @@
 #ifndef RTags_h
 #define RTags_h
 
+#include "Arena.h"
 #include "ByteArray.h"
 #include "Location.h"
 #include "Log.h"
@@ -8,6 +9,7 @@
 #include "FixIt.h"
 #include "Path.h"
 #include "SourceInformation.h"
+#include "StringPool.h"
 #include <assert.h>
 #include <getopt.h>
 #include <stdio.h>
@@ -37,19 +39,22 @@ enum CursorType {
 
 class CursorInfo;
 typedef Map<Location, CursorInfo> SymbolMap;
-typedef Map<ByteArray, Set<Location> > UsrMap;
 typedef Map<Location, Set<Location> > ReferenceMap;
-typedef Map<ByteArray, Set<Location> > SymbolNameMap;
+typedef Map<InternedString, Set<Location> > SymbolNameMap;
 typedef Map<uint32_t, Set<uint32_t> > DependencyMap;
 typedef Map<uint32_t, SourceInformation> SourceInformationMap;
 typedef Map<Path, Set<ByteArray> > FilesMap;
 typedef Map<uint32_t, Set<FixIt> > FixItMap;
 typedef Map<uint32_t, List<ByteArray> > DiagnosticsMap;
 
+// The maps an indexer job fills in, allocated from the job's arena
+typedef Set<Location, ArenaAllocator<Location> > ArenaLocationSet;
+typedef Map<Location, CursorInfo, ArenaAllocator<std::pair<const Location, CursorInfo> > > ArenaSymbolMap;
+typedef Map<Location, ArenaLocationSet, ArenaAllocator<std::pair<const Location, ArenaLocationSet> > > ArenaReferenceMap;
+typedef Map<InternedString, ArenaLocationSet,
+            ArenaAllocator<std::pair<const InternedString, ArenaLocationSet> > > ArenaSymbolNameMap;
+
 namespace RTags {
-void dirtySymbolNames(SymbolNameMap &map, const Set<uint32_t> &dirty);
-void dirtySymbols(SymbolMap &map, const Set<uint32_t> &dirty);
-void dirtyUsr(UsrMap &map, const Set<uint32_t> &dirty);
 
 ByteArray backtrace(int maxFrames = -1);
 
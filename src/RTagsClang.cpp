@@ -84,12 +84,13 @@ ByteArray cursorToString(CXCursor cursor, unsigned flags)
 }
 
 
-SymbolMap::const_iterator findCursorInfo(const SymbolMap &map, const Location &location)
+template <typename Symbols>
+static inline typename Symbols::const_iterator findCursorInfoInMap(const Symbols &map, const Location &location)
 {
     if (map.isEmpty())
         return map.end();
 
-    SymbolMap::const_iterator it = map.find(location);
+    typename Symbols::const_iterator it = map.find(location);
     if (it != map.end())
         return it;
     it = map.lower_bound(location);
@@ -109,6 +110,27 @@ SymbolMap::const_iterator findCursorInfo(const SymbolMap &map, const Location &l
     return map.end();
 }
 
+SymbolMap::const_iterator findCursorInfo(const SymbolMap &map, const Location &location)
+{
+    return findCursorInfoInMap(map, location);
+}
+
+ArenaSymbolMap::const_iterator findCursorInfo(const ArenaSymbolMap &map, const Location &location)
+{
+    return findCursorInfoInMap(map, location);
+}
+
+SymbolStore::const_iterator findCursorInfo(const SymbolStore &map, const Location &location)
+{
+    const SymbolStore::const_iterator it = map.findAtOrBefore(location);
+    if (it == map.end() || it->first == location)
+        return it;
+    const int off = location.offset() - it->first.offset();
+    if (it->second.symbolLength > off)
+        return it;
+    return map.end();
+}
+
 static CXChildVisitResult findFirstChildVisitor(CXCursor cursor, CXCursor, CXClientData data)
 {
     *reinterpret_cast<CXCursor*>(data) = cursor;
@@ -146,4 +168,14 @@ CXCursor findChild(CXCursor parent, CXCursorKind kind)
         clang_visitChildren(parent, findChildVisitor, &u);
     return u.cursor;
 }
+
+uint64_t memoryUsage(CXTranslationUnit unit)
+{
+    CXTUResourceUsage usage = clang_getCXTUResourceUsage(unit);
+    uint64_t ret = 0;
+    for (unsigned i=0; i<usage.numEntries; ++i)
+        ret += usage.entries[i].amount;
+    clang_disposeCXTUResourceUsage(usage);
+    return ret;
+}
 }
@@ -4,6 +4,7 @@
 #include "Str.h"
 #include "RTags.h"
 #include "CursorInfo.h"
+#include "SymbolStore.h"
 
 namespace RTags {
 
@@ -17,9 +18,12 @@ enum CursorToStringFlags {
 };
 ByteArray cursorToString(CXCursor cursor, unsigned = DefaultCursorToStringFlags);
 SymbolMap::const_iterator findCursorInfo(const SymbolMap &map, const Location &location);
-inline CursorInfo findCursorInfo(const SymbolMap &map, const Location &location, Location *key)
+ArenaSymbolMap::const_iterator findCursorInfo(const ArenaSymbolMap &map, const Location &location);
+SymbolStore::const_iterator findCursorInfo(const SymbolStore &map, const Location &location);
+template <typename Symbols>
+inline CursorInfo findCursorInfo(const Symbols &map, const Location &location, Location *key)
 {
-    const SymbolMap::const_iterator it = findCursorInfo(map, location);
+    const typename Symbols::const_iterator it = findCursorInfo(map, location);
     if (it == map.end()) {
         if (key)
             key->clear();
@@ -32,6 +36,8 @@ inline CursorInfo findCursorInfo(const SymbolMap &map, const Location &location,
 
 CXCursor findFirstChild(CXCursor parent);
 CXCursor findChild(CXCursor parent, CXCursorKind kind);
+// What libclang says unit uses
+uint64_t memoryUsage(CXTranslationUnit unit);
 
 template <typename T>
 inline bool startsWith(const List<T> &list, const T &str)
@@ -21,17 +21,18 @@ void ReferencesJob::execute()
     Set<Location> references;
     if (proj) {
         if (!symbolName.isEmpty()) {
+            proj->loadName(Database::SymbolNames, symbolName);
             Scope<const SymbolNameMap&> scope = proj->lockSymbolNamesForRead();
             if (scope.isNull())
                 return;
-            locations = scope.data().value(symbolName);
+            locations = scope.data().value(InternedString::view(symbolName));
         }
         if (!locations.isEmpty()) {
-            Scope<const SymbolMap&> scope = proj->lockSymbolsForRead();
+            Scope<const SymbolStore&> scope = proj->lockSymbolsForRead();
             if (scope.isNull())
                 return;
 
-            const SymbolMap &map = scope.data();
+            const SymbolStore &map = scope.data();
             for (Set<Location>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
                 Location pos;
                 CursorInfo cursorInfo = RTags::findCursorInfo(map, *it, &pos);
@@ -109,10 +110,7 @@ void ReferencesJob::execute()
     if (!(queryFlags() & QueryMessage::ReverseSort) && sorted.size() != 1 && !startLocation.isNull()) {
         startIndex = sorted.indexOf(startLocation) + 1;
     }
-    const unsigned keyFlags = Job::keyFlags();
-
-    for (int i=0; i<count; ++i) {
-        const Location &loc = sorted.at((startIndex + i) % count);
-        write(loc.key(keyFlags));
-    }
+    if (startIndex)
+        std::rotate(sorted.begin(), sorted.begin() + (startIndex % count), sorted.end());
+    write(sorted);
 }
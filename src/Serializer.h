@@ -172,12 +172,12 @@ Serializer &operator<<(Serializer &s, const List<T> &list)
     return s;
 }
 
-template <typename Key, typename Value>
-Serializer &operator<<(Serializer &s, const Map<Key, Value> &map)
+template <typename Key, typename Value, typename Alloc>
+Serializer &operator<<(Serializer &s, const Map<Key, Value, Alloc> &map)
 {
     const int size = map.size();
     s << size;
-    for (typename Map<Key, Value>::const_iterator it = map.begin(); it != map.end(); ++it) {
+    for (typename Map<Key, Value, Alloc>::const_iterator it = map.begin(); it != map.end(); ++it) {
         s << it->first << it->second;
     }
     return s;
@@ -191,19 +191,19 @@ Serializer &operator<<(Serializer &s, const std::pair<First, Second> &pair)
 }
 
 
-template <typename T>
-Serializer &operator<<(Serializer &s, const Set<T> &set)
+template <typename T, typename Alloc>
+Serializer &operator<<(Serializer &s, const Set<T, Alloc> &set)
 {
     const int size = set.size();
     s << size;
-    for (typename Set<T>::const_iterator it = set.begin(); it != set.end(); ++it) {
+    for (typename Set<T, Alloc>::const_iterator it = set.begin(); it != set.end(); ++it) {
         s << *it;
     }
     return s;
 }
 
-template <typename Key, typename Value>
-Deserializer &operator>>(Deserializer &s, Map<Key, Value> &map)
+template <typename Key, typename Value, typename Alloc>
+Deserializer &operator>>(Deserializer &s, Map<Key, Value, Alloc> &map)
 {
     int size;
     s >> size;
@@ -238,8 +238,8 @@ Deserializer &operator>>(Deserializer &s, List<T> &list)
     return s;
 }
 
-template <typename T>
-Deserializer &operator>>(Deserializer &s, Set<T> &set)
+template <typename T, typename Alloc>
+Deserializer &operator>>(Deserializer &s, Set<T, Alloc> &set)
 {
     set.clear();
     int size;
@@ -6,13 +6,17 @@
 #include "Connection.h"
 #include "CreateOutputMessage.h"
 #include "CursorInfoJob.h"
+#include "Database.h"
 #include "Event.h"
 #include "EventLoop.h"
 #include "Filter.h"
 #include "FindFileJob.h"
 #include "FindSymbolsJob.h"
+#include "FuzzySymbolsJob.h"
 #include "FollowLocationJob.h"
 #include "IndexerJob.h"
+#include "IndexerWorker.h"
+#include "MemoryBudget.h"
 #include "ListSymbolsJob.h"
 #include "LocalClient.h"
 #include "LocalServer.h"
@@ -22,6 +26,7 @@
 #include "Message.h"
 #include "Messages.h"
 #include "Path.h"
+#include "PreambleCache.h"
 #include "Preprocessor.h"
 #include "Process.h"
 #include "CompileMessage.h"
@@ -37,7 +42,7 @@
 Server *Server::sInstance = 0;
 Server::Server()
     : mServer(0), mVerbose(false), mJobId(0), mIndexerThreadPool(0), mQueryThreadPool(2),
-      mRestoreProjects(false)
+      mSaveThreadPool(1), mRestoreProjects(false)
 {
     assert(!sInstance);
     sInstance = this;
@@ -58,6 +63,7 @@ void Server::clear()
         delete mIndexerThreadPool;
         mIndexerThreadPool = 0;
     }
+    IndexerWorker::cleanup();
     Path::rm(mOptions.socketFile);
     delete mServer;
     mServer = 0;
@@ -66,7 +72,8 @@ void Server::clear()
 
 bool Server::init(const Options &options)
 {
-    mIndexerThreadPool = new ThreadPool(options.threadCount);
+    mIndexerThreadPool = new ThreadPool(options.threadCount,
+                                        options.options & WorkStealing ? ThreadPool::WorkStealing : ThreadPool::Shared);
 
     mOptions = options;
     if (!(options.options & NoClangIncludePath)) {
@@ -85,6 +92,14 @@ bool Server::init(const Options &options)
     if (mOptions.options & ClearProjects) {
         clearProjects();
     }
+    if (mOptions.options & SharePreambles)
+        PreambleCache::init(mOptions.dataDir + "preambles/");
+    if (mOptions.memoryBudget)
+        MemoryBudget::init(static_cast<uint64_t>(mOptions.memoryBudget) * 1024 * 1024);
+    if (mOptions.options & IndexInWorkers) {
+        IndexerWorker::init(RTags::applicationDirPath() + "/rdm", mOptions.workerMaxJobs,
+                            static_cast<uint64_t>(mOptions.workerMaxMemory) * 1024 * 1024);
+    }
 
     for (int i=0; i<10; ++i) {
         mServer = new LocalServer;
@@ -131,33 +146,22 @@ void Server::reloadProjects()
     const Path home = Path::home();
     for (int i=0; i<projects.size(); ++i) {
         Path file = projects.at(i);
+        if (file.endsWith(".names")) // a project's name index
+            continue;
         Path p = file.mid(mOptions.dataDir.size());
         RTags::decodePath(p);
         if (p.isDir()) {
-            bool remove = false;
-            if (FILE *f = fopen(file.constData(), "r")) {
-                Deserializer in(f);
-                int version;
-                in >> version;
-
-                if (version == Server::DatabaseVersion) {
-                    int fs;
-                    in >> fs;
-                    if (fs != RTags::fileSize(f)) {
-                        error("%s seems to be corrupted, refusing to restore. Removing.",
-                              file.constData());
-                        remove = true;
-                    } else {
-                        addProject(p);
-                    }
-                } else {
-                    remove = true;
-                    error() << file << "has wrong format. Got" << version << "expected" << Server::DatabaseVersion << "Removing";
-                }
-                fclose(f);
+            // open() checks the version and every offset and logs why it
+            // refused the file
+            Database database;
+            if (database.open(file)) {
+                addProject(p);
+            } else {
+                error("Refusing to restore %s. Removing.", file.constData());
+                Path::rm(file);
+                Path::rm(file + ".names");
+                RTags::removeDirectory(file + ".shards/");
             }
-            if (remove)
-                Path::rm(p);
         }
     }
 }
@@ -311,6 +315,9 @@ void Server::handleQueryMessage(QueryMessage *message, Connection *conn)
     case QueryMessage::FindSymbols:
         findSymbols(*message, conn);
         break;
+    case QueryMessage::FuzzySymbols:
+        fuzzySymbols(*message, conn);
+        break;
     case QueryMessage::Status:
         status(*message, conn);
         break;
@@ -498,6 +505,20 @@ void Server::listSymbols(const QueryMessage &query, Connection *conn)
     conn->finish();
 }
 
+void Server::fuzzySymbols(const QueryMessage &query, Connection *conn)
+{
+    shared_ptr<Project> project = currentProject();
+    if (!project) {
+        error("No project");
+        conn->finish();
+        return;
+    }
+
+    FuzzySymbolsJob job(query, project);
+    job.run(conn);
+    conn->finish();
+}
+
 void Server::status(const QueryMessage &query, Connection *conn)
 {
     shared_ptr<Project> project = currentProject();
@@ -600,6 +621,11 @@ void Server::startQueryJob(const shared_ptr<Job> &job)
     mQueryThreadPool.start(job);
 }
 
+void Server::startSaveJob(const shared_ptr<ThreadPool::Job> &job)
+{
+    mSaveThreadPool.start(job);
+}
+
 
 void Server::processSourceFile(GccArguments args, Path proj)
 {
@@ -744,8 +770,9 @@ void Server::removeProject(const QueryMessage &query, Connection *conn)
             Path path = cur->first;
             conn->write<128>("%s project: %s", unload ? "Unloaded" : "Deleted", path.constData());
             if (!unload) {
-                RTags::encodePath(path);
-                Path::rm(mOptions.dataDir + path);
+                Path::rm(cur->second->databasePath());
+                Path::rm(cur->second->nameIndexPath());
+                RTags::removeDirectory(cur->second->shardsPath());
                 mProjects.erase(cur);
             }
         }
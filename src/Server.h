@@ -25,7 +25,7 @@ class Job;
 class Server : public EventReceiver
 {
 public:
-    enum { DatabaseVersion = 12 };
+    enum { DatabaseVersion = 15 };
 
     Server();
     ~Server();
@@ -37,17 +37,24 @@ public:
         ClearProjects = 0x04,
         NoWall = 0x08,
         IgnorePrintfFixits = 0x10,
-        NoUnlimitedErrors = 0x20
+        NoUnlimitedErrors = 0x20,
+        WorkStealing = 0x40,
+        SharePreambles = 0x80,
+        IndexInWorkers = 0x100,
+        IndexCallbacks = 0x200
     };
     ThreadPool *threadPool() const { return mIndexerThreadPool; }
     void startQueryJob(const shared_ptr<Job> &job);
     void startIndexerJob(const shared_ptr<IndexerJob> &job, int priority);
+    void startSaveJob(const shared_ptr<ThreadPool::Job> &job);
     struct Options {
-        Options() : options(0), threadCount(0), completionCacheSize(0) {}
+        Options() : options(0), threadCount(0), completionCacheSize(0), workerMaxJobs(0), workerMaxMemory(0), memoryBudget(0) {}
         Path projectsFile, socketFile, dataDir;
         unsigned options;
         int threadCount;
         int completionCacheSize;
+        int workerMaxJobs, workerMaxMemory; // memory in mb
+        int memoryBudget; // mb, 0 for no budget
         List<ByteArray> defaultArguments, excludeFilters;
     };
     bool init(const Options &options);
@@ -85,6 +92,7 @@ private:
     void referencesForName(const QueryMessage &query, Connection *conn);
     void findSymbols(const QueryMessage &query, Connection *conn);
     void listSymbols(const QueryMessage &query, Connection *conn);
+    void fuzzySymbols(const QueryMessage &query, Connection *conn);
     void status(const QueryMessage &query, Connection *conn);
     void isIndexed(const QueryMessage &query, Connection *conn);
     void hasFileManager(const QueryMessage &query, Connection *conn);
@@ -121,6 +129,7 @@ private:
 
     ThreadPool *mIndexerThreadPool;
     ThreadPool mQueryThreadPool;
+    ThreadPool mSaveThreadPool; // one thread so saves never overlap
     signalslot::Signal2<int, const List<ByteArray> &> mComplete;
     Path mClangPath;
 
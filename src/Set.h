@@ -4,27 +4,31 @@
 #include <set>
 #include "List.h"
 
-template <typename T>
-class Set : public std::set<T>
+template <typename T, typename Alloc>
+class Set : public std::set<T, std::less<T>, Alloc>
 {
+    typedef std::set<T, std::less<T>, Alloc> Base;
 public:
     Set() {}
+    explicit Set(const Alloc &alloc)
+        : Base(std::less<T>(), alloc)
+    {}
 
     bool contains(const T &t) const
     {
-        return std::set<T>::find(t) != std::set<T>::end();
+        return Base::find(t) != Base::end();
     }
 
     bool isEmpty() const
     {
-        return !std::set<T>::size();
+        return !Base::size();
     }
 
     bool remove(const T &t)
     {
-        typename std::set<T>::iterator it = std::set<T>::find(t);
-        if (it != std::set<T>::end()) {
-            std::set<T>::erase(it);
+        typename Base::iterator it = Base::find(t);
+        if (it != Base::end()) {
+            Base::erase(it);
             return true;
         }
         return false;
@@ -32,8 +36,8 @@ public:
     List<T> toList() const
     {
         List<T> ret;
-        typename std::set<T>::iterator it = std::set<T>::begin();
-        while (it != std::set<T>::end()) {
+        typename Base::iterator it = Base::begin();
+        while (it != Base::end()) {
             ret.append(*it);
             ++it;
         }
@@ -42,13 +46,19 @@ public:
 
     bool insert(const T &t)
     {
-        return std::set<T>::insert(t).second;
+        return Base::insert(t).second;
+    }
+
+    typename Base::iterator insert(typename Base::iterator hint, const T &t)
+    {
+        return Base::insert(hint, t);
     }
 
-    Set<T> &unite(const Set<T> &other, int *count = 0)
+    template <typename OtherAlloc>
+    Set &unite(const Set<T, OtherAlloc> &other, int *count = 0)
     {
         int c = 0;
-        typename std::set<T>::iterator it = other.begin();
+        typename Set<T, OtherAlloc>::const_iterator it = other.begin();
         while (it != other.end()) {
             if (insert(*it))
                 ++c;
@@ -59,12 +69,12 @@ public:
         return *this;
     }
 
-    Set<T> &subtract(const Set<T> &other, int *count = 0)
+    Set &subtract(const Set &other, int *count = 0)
     {
         int c = 0;
-        typename std::set<T>::iterator it = other.begin();
+        typename Base::iterator it = other.begin();
         while (it != other.end()) {
-            c += std::set<T>::erase(*it);
+            c += Base::erase(*it);
             ++it;
         }
         if (count)
@@ -72,19 +82,19 @@ public:
         return *this;
     }
 
-    Set<T> &operator+=(const Set<T> &other)
+    Set &operator+=(const Set &other)
     {
         return unite(other);
     }
 
-    Set<T> &operator-=(const Set<T> &other)
+    Set &operator-=(const Set &other)
     {
         return subtract(other);
     }
 
     int size() const
     {
-        return std::set<T>::size();
+        return Base::size();
     }
 };
 
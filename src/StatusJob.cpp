@@ -1,7 +1,9 @@
 #include "StatusJob.h"
 #include "CursorInfo.h"
+#include "MemoryMonitor.h"
 #include "RTags.h"
 #include "Server.h"
+#include "StringPool.h"
 #include <clang-c/Index.h>
 
 const char *StatusJob::delimiter = "*********************************";
@@ -13,7 +15,7 @@ StatusJob::StatusJob(const QueryMessage &q, const shared_ptr<Project> &project)
 void StatusJob::execute()
 {
     bool matched = false;
-    const char *alternatives = "fileids|dependencies|fileinfos|symbols|symbolnames|watchedpaths";
+    const char *alternatives = "fileids|dependencies|fileinfos|symbols|symbolnames|watchedpaths|memory|querywait";
     if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "fileids")) {
         matched = true;
         write(delimiter);
@@ -78,14 +80,15 @@ void StatusJob::execute()
 
     if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "symbols")) {
         matched = true;
-        Scope<const SymbolMap&> scope = proj->lockSymbolsForRead();
+        proj->loadAll(Database::Symbols);
+        Scope<const SymbolStore&> scope = proj->lockSymbolsForRead();
         if (scope.isNull())
             return;
-        const SymbolMap &map = scope.data();
+        const SymbolStore &map = scope.data();
         write(delimiter);
         write("symbols");
         write(delimiter);
-        for (SymbolMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        for (SymbolStore::const_iterator it = map.begin(); it != map.end(); ++it) {
             const Location loc = it->first;
             const CursorInfo ci = it->second;
             write(loc);
@@ -97,6 +100,7 @@ void StatusJob::execute()
 
     if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "symbolnames")) {
         matched = true;
+        proj->loadAll(Database::SymbolNames);
         Scope<const SymbolNameMap&> scope = proj->lockSymbolNamesForRead();
         if (scope.isNull())
             return;
@@ -105,7 +109,7 @@ void StatusJob::execute()
         write("symbolnames");
         write(delimiter);
         for (SymbolNameMap::const_iterator it = map.begin(); it != map.end(); ++it) {
-            write<128>("  %s", it->first.constData());
+            write<128>("  %s", it->first.string().constData());
             const Set<Location> &locations = it->second;
             for (Set<Location>::const_iterator lit = locations.begin(); lit != locations.end(); ++lit) {
                 const Location &loc = *lit;
@@ -116,6 +120,69 @@ void StatusJob::execute()
         }
     }
 
+    if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "memory")) {
+        matched = true;
+        write(delimiter);
+        write("memory");
+        write(delimiter);
+        write<256>("  rdm: %llu bytes", static_cast<unsigned long long>(MemoryMonitor::usage()));
+        for (int i=0; i<MemoryMonitor::CounterCount; ++i) {
+            const MemoryMonitor::Counter counter = static_cast<MemoryMonitor::Counter>(i);
+            write<256>("  %s: %lld bytes", MemoryMonitor::counterName(counter),
+                       static_cast<long long>(MemoryMonitor::count(counter)));
+        }
+        Scope<const SymbolStore&> scope = proj->lockSymbolsForRead();
+        if (scope.isNull())
+            return;
+        const SymbolStore &map = scope.data();
+        int64_t locations = 0, heap = 0, legacyNames = 0;
+        for (SymbolStore::const_iterator it = map.begin(); it != map.end(); ++it) {
+            const CursorInfo &ci = it->second;
+            locations += ci.targets.size() + ci.references.size();
+            heap += ci.heapSize();
+            legacyNames += ci.symbolName().size();
+            if (isAborted())
+                return;
+        }
+        const int cursors = map.size();
+        const int64_t bytes = (static_cast<int64_t>(cursors) * sizeof(CursorInfo)) + heap;
+        // What the same cursors would take with an owned symbol name and a
+        // Set<Location> for targets and references. A std::set node is the
+        // Location, which used to carry a cached Path, plus color, parent,
+        // left and right.
+        const int setNode = sizeof(uint64_t) + sizeof(Path) + (4 * sizeof(void*));
+        const int legacyCursor = (sizeof(uint16_t) + sizeof(ByteArray) + (2 * sizeof(int)) + sizeof(int64_t)
+                                  + (2 * sizeof(Set<Location>)) + (2 * sizeof(int)));
+        const int64_t legacy = (static_cast<int64_t>(cursors) * legacyCursor) + (locations * setNode) + legacyNames;
+        write<256>("  cursors: %d in %d files", cursors, map.fileCount());
+        write<256>("  locations: %lld", static_cast<long long>(locations));
+        write<256>("  cursor bytes: %lld (%d per cursor + %lld allocated)",
+                   static_cast<long long>(bytes), static_cast<int>(sizeof(CursorInfo)), static_cast<long long>(heap));
+        if (cursors) {
+            write<256>("  bytes per cursor: %.1f (%.1f with Set<Location> and owned names)",
+                       static_cast<double>(bytes) / cursors, static_cast<double>(legacy) / cursors);
+        }
+        write<256>("  interned strings: %d (%d bytes)", StringPool::count(), StringPool::memoryUsage());
+        write<256>("  file ids: %d", PathRegistry::count());
+    }
+
+    if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "querywait")) {
+        matched = true;
+        write(delimiter);
+        write("querywait");
+        write(delimiter);
+        const LatencyHistogram &wait = proj->queryWait();
+        write<256>("  %s", wait.toString().constData());
+        for (int i=0; i<LatencyHistogram::BucketCount; ++i) {
+            const int limit = LatencyHistogram::limit(i);
+            if (limit == -1) {
+                write<64>("  longer: %d", wait.count(i));
+            } else {
+                write<64>("  < %dms: %d", limit, wait.count(i));
+            }
+        }
+    }
+
     if (query.isEmpty() || !strcasecmp(query.nullTerminated(), "fileinfos")) {
         matched = true;
         const SourceInformationMap map = proj->sources();
@@ -0,0 +1,141 @@
+#include "StringPool.h"
+#include "ReadLocker.h"
+#include "WriteLocker.h"
+
+Map<ByteArray, uint32_t> StringPool::sIds;
+StringPool::Entry *volatile *volatile StringPool::sChunks[StringPool::MaxChunks];
+List<uint32_t> StringPool::sFreeIds;
+uint32_t StringPool::sLastId = 0;
+volatile int StringPool::sUnreferenced = 0;
+int StringPool::sBytes = 0;
+ReadWriteLock StringPool::sLock;
+
+// Same as in PathRegistry.cpp, orders the loads through a published pointer
+// after the load of the pointer itself
+static inline void acquire()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile("" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
+// The caller holds a reference to id, so its chunk and entry are published
+StringPool::Entry *StringPool::entry(uint32_t id)
+{
+    Entry *volatile *chunk = sChunks[id >> ChunkBits];
+    acquire();
+    Entry *ret = chunk[id & (ChunkSize - 1)];
+    acquire();
+    return ret;
+}
+
+const ByteArray &StringPool::string(uint32_t id)
+{
+    static const ByteArray empty;
+    if (!id)
+        return empty;
+    return *entry(id)->string;
+}
+
+void StringPool::ref(uint32_t id)
+{
+    if (id)
+        __sync_add_and_fetch(&entry(id)->refs, 1);
+}
+
+// The count of unreferenced strings is only a hint for when to compact, it
+// can be off when a string is dropped while compact() runs
+void StringPool::deref(uint32_t id)
+{
+    if (id && !__sync_sub_and_fetch(&entry(id)->refs, 1))
+        __sync_add_and_fetch(&sUnreferenced, 1);
+}
+
+uint32_t StringPool::insert(const ByteArray &string)
+{
+    if (string.isEmpty())
+        return 0;
+    {
+        // Only an unreferenced string's count can go up from 0 and that's
+        // done with sLock held so compact() can't free it meanwhile
+        ReadLocker lock(&sLock);
+        const Map<ByteArray, uint32_t>::const_iterator it = sIds.find(string);
+        if (it != sIds.end()) {
+            if (!__sync_fetch_and_add(&entry(it->second)->refs, 1))
+                __sync_sub_and_fetch(&sUnreferenced, 1);
+            return it->second;
+        }
+    }
+    WriteLocker lock(&sLock);
+    if (sUnreferenced > CompactThreshold && sUnreferenced * 4 > static_cast<int>(sIds.size()))
+        compact();
+    const std::pair<Map<ByteArray, uint32_t>::iterator, bool> inserted = sIds.insert(std::make_pair(string, 0));
+    if (!inserted.second) {
+        if (!__sync_fetch_and_add(&entry(inserted.first->second)->refs, 1))
+            __sync_sub_and_fetch(&sUnreferenced, 1);
+        return inserted.first->second;
+    }
+
+    uint32_t id;
+    if (!sFreeIds.isEmpty()) {
+        id = sFreeIds.last();
+        sFreeIds.removeLast();
+    } else {
+        id = ++sLastId;
+    }
+    const uint32_t chunkIdx = id >> ChunkBits;
+    assert(chunkIdx < MaxChunks);
+    if (!sChunks[chunkIdx]) {
+        Entry *volatile *chunk = new Entry *volatile[ChunkSize];
+        for (int i=0; i<ChunkSize; ++i)
+            chunk[i] = 0;
+        __sync_synchronize();
+        sChunks[chunkIdx] = chunk;
+    }
+    Entry *e = new Entry;
+    e->string = &inserted.first->first;
+    e->refs = 1;
+    __sync_synchronize();
+    sChunks[chunkIdx][id & (ChunkSize - 1)] = e;
+    inserted.first->second = id;
+    sBytes += string.size();
+    return id;
+}
+
+// Called with sLock held for writing. Nobody can get at an unreferenced
+// string without sLock so it's safe to free them.
+void StringPool::compact()
+{
+    Map<ByteArray, uint32_t>::iterator it = sIds.begin();
+    while (it != sIds.end()) {
+        const uint32_t id = it->second;
+        Entry *e = entry(id);
+        if (!e->refs) {
+            sChunks[id >> ChunkBits][id & (ChunkSize - 1)] = 0;
+            delete e;
+            sFreeIds.append(id);
+            sBytes -= it->first.size();
+            sIds.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    sUnreferenced = 0;
+}
+
+int StringPool::count()
+{
+    ReadLocker lock(&sLock);
+    return sIds.size();
+}
+
+int StringPool::memoryUsage()
+{
+    ReadLocker lock(&sLock);
+    // string data plus a map node (key, id and tree pointers), an entry and
+    // a chunk slot per string
+    const int perString = sizeof(ByteArray) + sizeof(uint32_t) + (4 * sizeof(void*)) + sizeof(Entry) + sizeof(Entry*);
+    return sBytes + (sIds.size() * perString);
+}
@@ -0,0 +1,140 @@
+#ifndef StringPool_h
+#define StringPool_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "Map.h"
+#include "ReadWriteLock.h"
+#include "Serializer.h"
+
+/*
+  Process wide pool of interned strings. Each distinct string is stored once
+  and identified by a 32-bit id, 0 being the empty string.
+
+  Strings are reference counted, insert() and ref() take a reference and
+  deref() drops it. A string and the reference returned by string() stay
+  valid for as long as someone holds a reference to it. Once enough strings
+  are unreferenced the next insert() frees them and their ids are reused.
+
+  Looking up a string by id doesn't take any locks, ids map to strings
+  through an append-only array of chunks like PathRegistry's. Only insert()
+  takes sLock.
+*/
+
+class StringPool
+{
+public:
+    // Returns the string's id with a reference taken
+    static uint32_t insert(const ByteArray &string);
+    // id has to be referenced by the caller
+    static const ByteArray &string(uint32_t id);
+    static void ref(uint32_t id);
+    static void deref(uint32_t id);
+
+    static int count();
+    static int memoryUsage();
+private:
+    enum {
+        ChunkBits = 14,
+        ChunkSize = 1 << ChunkBits,
+        MaxChunks = 1 << 16,
+        CompactThreshold = 4096
+    };
+
+    struct Entry {
+        const ByteArray *string; // points to the key in sIds
+        volatile int refs;
+    };
+
+    static Entry *entry(uint32_t id);
+    static void compact();
+
+    static Map<ByteArray, uint32_t> sIds;
+    static Entry *volatile *volatile sChunks[MaxChunks];
+    static List<uint32_t> sFreeIds;
+    static uint32_t sLastId;
+    static volatile int sUnreferenced; // roughly, see deref()
+    static int sBytes;
+    static ReadWriteLock sLock;
+};
+
+/*
+  A string in StringPool, used as the key of SymbolNameMap and in UsrIndex. It's
+  a single pointer so two interned strings compare equal if and only if the
+  pointers do. Ordering is the same as ByteArray's so prefix searches with
+  lower_bound keep working.
+
+  view() wraps a string without interning it. It's meant for lookups of
+  strings that may not be in the pool, e.g. from queries, and must not
+  outlive the string it was created from.
+*/
+
+class InternedString
+{
+public:
+    InternedString()
+        : mString(&StringPool::string(0)), mId(0)
+    {}
+    InternedString(const ByteArray &string)
+        : mId(StringPool::insert(string))
+    {
+        mString = &StringPool::string(mId);
+    }
+    InternedString(const InternedString &other)
+        : mString(other.mString), mId(other.mId)
+    {
+        StringPool::ref(mId);
+    }
+    ~InternedString()
+    {
+        StringPool::deref(mId);
+    }
+    InternedString &operator=(const InternedString &other)
+    {
+        StringPool::ref(other.mId);
+        StringPool::deref(mId);
+        mString = other.mString;
+        mId = other.mId;
+        return *this;
+    }
+
+    static InternedString view(const ByteArray &string)
+    {
+        InternedString ret;
+        ret.mString = &string;
+        return ret;
+    }
+
+    const ByteArray &string() const { return *mString; }
+    operator const ByteArray &() const { return *mString; }
+
+    bool operator==(const InternedString &other) const { return mString == other.mString; }
+    bool operator!=(const InternedString &other) const { return mString != other.mString; }
+    bool operator<(const InternedString &other) const { return mString != other.mString && *mString < *other.mString; }
+    bool operator>(const InternedString &other) const { return mString != other.mString && *mString > *other.mString; }
+private:
+    const ByteArray *mString;
+    uint32_t mId; // 0 for views, they don't hold a reference
+};
+
+template <> inline Serializer &operator<<(Serializer &s, const InternedString &string)
+{
+    s << string.string();
+    return s;
+}
+
+template <> inline Deserializer &operator>>(Deserializer &s, InternedString &string)
+{
+    ByteArray str;
+    s >> str;
+    string = str;
+    return s;
+}
+
+inline Log operator<<(Log log, const InternedString &string)
+{
+    log << string.string();
+    return log;
+}
+
+#endif
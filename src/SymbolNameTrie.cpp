@@ -0,0 +1,202 @@
+#include "SymbolNameTrie.h"
+
+SymbolNameTrie::Node::~Node()
+{
+    for (int i=0; i<children.size(); ++i)
+        delete children.at(i);
+}
+
+SymbolNameTrie::SymbolNameTrie()
+    : mSize(0)
+{
+}
+
+SymbolNameTrie::~SymbolNameTrie()
+{
+}
+
+int SymbolNameTrie::childIndex(const Node *node, char ch)
+{
+    int lower = 0, upper = node->children.size();
+    while (lower < upper) {
+        const int mid = lower + ((upper - lower) / 2);
+        if (static_cast<unsigned char>(node->children.at(mid)->label[0]) < static_cast<unsigned char>(ch)) {
+            lower = mid + 1;
+        } else {
+            upper = mid;
+        }
+    }
+    return lower;
+}
+
+bool SymbolNameTrie::insert(const InternedString &name)
+{
+    const ByteArray &string = name.string();
+    const char *str = string.constData();
+    int remaining = string.size();
+    if (!remaining)
+        return false;
+
+    Node *node = &mRoot;
+    while (remaining) {
+        const int idx = childIndex(node, *str);
+        Node *child = idx < node->children.size() ? node->children.at(idx) : 0;
+        if (!child || child->label[0] != *str) {
+            Node *leaf = new Node;
+            leaf->label = str;
+            leaf->labelLength = remaining;
+            leaf->terminal = true;
+            leaf->name = name;
+            node->children.insert(node->children.begin() + idx, leaf);
+            ++mSize;
+            return true;
+        }
+
+        const int max = std::min(child->labelLength, remaining);
+        int common = 1;
+        while (common < max && child->label[common] == str[common])
+            ++common;
+        if (common < child->labelLength) {
+            // split the edge, the new node gets the shared part of the label
+            Node *mid = new Node;
+            mid->label = child->label;
+            mid->labelLength = common;
+            child->label += common;
+            child->labelLength -= common;
+            mid->children.append(child);
+            node->children[idx] = mid;
+            child = mid;
+        }
+        node = child;
+        str += common;
+        remaining -= common;
+    }
+    if (node->terminal)
+        return false;
+    node->terminal = true;
+    node->name = name;
+    ++mSize;
+    return true;
+}
+
+bool SymbolNameTrie::remove(const InternedString &name)
+{
+    const ByteArray &string = name.string();
+    const char *str = string.constData();
+    int remaining = string.size();
+    if (!remaining)
+        return false;
+
+    List<Node*> path;
+    List<int> indexes;
+    Node *node = &mRoot;
+    while (remaining) {
+        const int idx = childIndex(node, *str);
+        if (idx == node->children.size())
+            return false;
+        Node *child = node->children.at(idx);
+        if (child->labelLength > remaining || memcmp(child->label, str, child->labelLength))
+            return false;
+        path.append(node);
+        indexes.append(idx);
+        node = child;
+        str += child->labelLength;
+        remaining -= child->labelLength;
+    }
+    if (!node->terminal)
+        return false;
+    node->terminal = false;
+    node->name = InternedString();
+    --mSize;
+
+    if (node->children.isEmpty()) {
+        Node *parent = path.last();
+        parent->children.removeAt(indexes.last());
+        delete node;
+        if (parent != &mRoot)
+            collapse(parent);
+    } else {
+        collapse(node);
+    }
+    return true;
+}
+
+// Merges a node that's no longer a name into its only child
+void SymbolNameTrie::collapse(Node *node)
+{
+    if (node->terminal || node->children.size() != 1)
+        return;
+    Node *child = node->children.first();
+    // The labels come from different names so they're not necessarily next
+    // to each other in memory. Any name below child spells out both of them.
+    const Node *leaf = child;
+    while (!leaf->terminal)
+        leaf = leaf->children.first();
+    const char *label = leaf->name.string().constData();
+    // leaf's name ends with leaf's label, work backwards to where node's label starts
+    int depth = leaf->name.string().size() - leaf->labelLength;
+    for (const Node *n = child; n != leaf; n = n->children.first())
+        depth -= n->labelLength;
+    depth -= node->labelLength;
+
+    node->label = label + depth;
+    node->labelLength += child->labelLength;
+    node->terminal = child->terminal;
+    node->name = child->name;
+    node->children.swap(child->children);
+    child->children.clear(); // holds child itself after the swap
+    delete child;
+}
+
+bool SymbolNameTrie::contains(const ByteArray &name) const
+{
+    const char *str = name.constData();
+    int remaining = name.size();
+    const Node *node = &mRoot;
+    while (remaining) {
+        const int idx = childIndex(node, *str);
+        if (idx == node->children.size())
+            return false;
+        const Node *child = node->children.at(idx);
+        if (child->labelLength > remaining || memcmp(child->label, str, child->labelLength))
+            return false;
+        node = child;
+        str += child->labelLength;
+        remaining -= child->labelLength;
+    }
+    return node->terminal;
+}
+
+void SymbolNameTrie::clear()
+{
+    for (int i=0; i<mRoot.children.size(); ++i)
+        delete mRoot.children.at(i);
+    mRoot.children.clear();
+    mSize = 0;
+}
+
+class SymbolNameCollector
+{
+public:
+    SymbolNameCollector(int max)
+        : mMax(max)
+    {}
+
+    bool operator()(const InternedString &name)
+    {
+        mNames.append(name);
+        return mMax == -1 || mNames.size() < mMax;
+    }
+
+    List<InternedString> mNames;
+private:
+    const int mMax;
+};
+
+List<InternedString> SymbolNameTrie::find(const ByteArray &prefix, unsigned flags, int max) const
+{
+    SymbolNameCollector collector(max);
+    if (max)
+        visit(prefix, flags, collector);
+    return collector.mNames;
+}
@@ -0,0 +1,127 @@
+#ifndef SymbolNameTrie_h
+#define SymbolNameTrie_h
+
+#include "ByteArray.h"
+#include "List.h"
+#include "StringPool.h"
+#include <ctype.h>
+#include <string.h>
+
+/*
+  Radix trie of the project's symbol names, kept next to SymbolNameMap so
+  names can be listed by prefix without walking the map. Edge labels point
+  into the interned names themselves so the trie doesn't copy any string
+  data. Names are visited in the same order as SymbolNameMap's keys, or in
+  reverse with Reverse.
+*/
+
+class SymbolNameTrie
+{
+public:
+    SymbolNameTrie();
+    ~SymbolNameTrie();
+
+    enum Flag {
+        NoFlag = 0x0,
+        CaseInsensitive = 0x1,
+        Reverse = 0x2
+    };
+
+    bool insert(const InternedString &name);
+    bool remove(const InternedString &name);
+    bool contains(const ByteArray &name) const;
+    void clear();
+    int size() const { return mSize; }
+    bool isEmpty() const { return !mSize; }
+
+    // Calls visitor(const InternedString &) for each name starting with
+    // prefix until it returns false
+    template <typename Visitor> void visit(const ByteArray &prefix, unsigned flags, Visitor &visitor) const;
+
+    // Up to max names starting with prefix, -1 means all of them
+    List<InternedString> find(const ByteArray &prefix, unsigned flags = NoFlag, int max = -1) const;
+private:
+    SymbolNameTrie(const SymbolNameTrie &);
+    SymbolNameTrie &operator=(const SymbolNameTrie &);
+
+    struct Node {
+        Node()
+            : label(0), labelLength(0), terminal(false)
+        {}
+        ~Node();
+
+        const char *label;
+        int labelLength;
+        bool terminal;
+        InternedString name;
+        List<Node*> children; // sorted by the first character of their labels
+    };
+
+    static int childIndex(const Node *node, char ch);
+    static void collapse(Node *node);
+    static bool matches(const char *a, const char *b, int length, bool caseInsensitive);
+
+    template <typename Visitor> static bool visitMatching(const Node *node, const char *prefix, int prefixLength,
+                                                         unsigned flags, Visitor &visitor);
+    template <typename Visitor> static bool visitAll(const Node *node, unsigned flags, Visitor &visitor);
+
+    Node mRoot;
+    int mSize;
+};
+
+template <typename Visitor>
+inline void SymbolNameTrie::visit(const ByteArray &prefix, unsigned flags, Visitor &visitor) const
+{
+    visitMatching(&mRoot, prefix.constData(), prefix.size(), flags, visitor);
+}
+
+template <typename Visitor>
+inline bool SymbolNameTrie::visitMatching(const Node *node, const char *prefix, int prefixLength,
+                                          unsigned flags, Visitor &visitor)
+{
+    if (!prefixLength)
+        return visitAll(node, flags, visitor);
+
+    const bool caseInsensitive = flags & CaseInsensitive;
+    const int count = node->children.size();
+    for (int i=0; i<count; ++i) {
+        const Node *child = node->children.at(flags & Reverse ? count - i - 1 : i);
+        const int length = std::min(child->labelLength, prefixLength);
+        if (!matches(child->label, prefix, length, caseInsensitive))
+            continue;
+        if (!visitMatching(child, prefix + length, prefixLength - length, flags, visitor))
+            return false;
+        if (!caseInsensitive)
+            break; // only one child can match
+    }
+    return true;
+}
+
+template <typename Visitor>
+inline bool SymbolNameTrie::visitAll(const Node *node, unsigned flags, Visitor &visitor)
+{
+    // a name sorts before any name it's a prefix of
+    if (node->terminal && !(flags & Reverse) && !visitor(node->name))
+        return false;
+    const int count = node->children.size();
+    for (int i=0; i<count; ++i) {
+        if (!visitAll(node->children.at(flags & Reverse ? count - i - 1 : i), flags, visitor))
+            return false;
+    }
+    if (node->terminal && flags & Reverse && !visitor(node->name))
+        return false;
+    return true;
+}
+
+inline bool SymbolNameTrie::matches(const char *a, const char *b, int length, bool caseInsensitive)
+{
+    if (!caseInsensitive)
+        return !memcmp(a, b, length);
+    for (int i=0; i<length; ++i) {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    }
+    return true;
+}
+
+#endif
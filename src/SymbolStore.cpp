@@ -0,0 +1,221 @@
+#include "SymbolStore.h"
+#include "MutexLocker.h"
+
+int SymbolStore::lowerBound(const FileSymbols &symbols, uint32_t offset)
+{
+    int lower = 0, upper = symbols.size();
+    while (lower < upper) {
+        const int mid = lower + ((upper - lower) / 2);
+        if (symbols[mid].first.offset() < offset) {
+            lower = mid + 1;
+        } else {
+            upper = mid;
+        }
+    }
+    return lower;
+}
+
+void SymbolStore::setUnloaded(const Set<uint32_t> &fileIds, LoadCallback callback, void *userData)
+{
+    assert(mFiles.isEmpty());
+    mLoader.reset(new Loader);
+    mLoader->callback = callback;
+    mLoader->userData = userData;
+    for (Set<uint32_t>::const_iterator it = fileIds.begin(); it != fileIds.end(); ++it) {
+        mFiles[*it].loaded = 0;
+        ++mUnloaded;
+    }
+}
+
+// Only unloaded files are ever written here and nobody can be looking at
+// their (empty) symbols, the map itself isn't touched
+void SymbolStore::load(const File &file, uint32_t fileId) const
+{
+    MutexLocker lock(&mLoader->mutex);
+    if (file.loaded) // someone else beat us to it
+        return;
+    FileSymbols symbols;
+    if (mLoader->callback(fileId, symbols, mLoader->userData))
+        file.symbols.swap(symbols);
+    mSize += file.symbols.size();
+    --mUnloaded;
+    __sync_synchronize(); // symbols has to be visible before loaded is
+    file.loaded = 1;
+}
+
+void SymbolStore::loadAll() const
+{
+    for (FileMap::const_iterator it = mFiles.begin(); mUnloaded && it != mFiles.end(); ++it)
+        ensureLoaded(it->second, it->first);
+}
+
+SymbolStore::iterator SymbolStore::find(const Location &location)
+{
+    const FileMap::iterator file = mFiles.find(location.fileId());
+    if (file != mFiles.end()) {
+        ensureLoaded(file->second, file->first);
+        const FileSymbols &symbols = file->second.symbols;
+        const int idx = lowerBound(symbols, location.offset());
+        if (idx < symbols.size() && symbols[idx].first == location)
+            return iterator(file, mFiles.end(), idx);
+    }
+    return end();
+}
+
+SymbolStore::const_iterator SymbolStore::find(const Location &location) const
+{
+    const FileMap::const_iterator file = mFiles.find(location.fileId());
+    if (file != mFiles.end()) {
+        ensureLoaded(file->second, file->first);
+        const FileSymbols &symbols = file->second.symbols;
+        const int idx = lowerBound(symbols, location.offset());
+        if (idx < symbols.size() && symbols[idx].first == location)
+            return const_iterator(file, mFiles.end(), idx);
+    }
+    return end();
+}
+
+SymbolStore::const_iterator SymbolStore::findAtOrBefore(const Location &location) const
+{
+    const FileMap::const_iterator file = mFiles.find(location.fileId());
+    if (file != mFiles.end()) {
+        ensureLoaded(file->second, file->first);
+        const FileSymbols &symbols = file->second.symbols;
+        const int idx = lowerBound(symbols, location.offset());
+        if (idx < symbols.size() && symbols[idx].first == location)
+            return const_iterator(file, mFiles.end(), idx);
+        if (idx > 0)
+            return const_iterator(file, mFiles.end(), idx - 1);
+    }
+    return end();
+}
+
+CursorInfo &SymbolStore::operator[](const Location &location)
+{
+    const File &file = mFiles[location.fileId()];
+    ensureLoaded(file, location.fileId());
+    FileSymbols &symbols = file.symbols;
+    int idx = lowerBound(symbols, location.offset());
+    if (idx == symbols.size() || symbols[idx].first != location) {
+        symbols.insert(symbols.begin() + idx, Entry(location, CursorInfo()));
+        ++mSize;
+    }
+    return symbols[idx].second;
+}
+
+const SymbolStore::FileSymbols *SymbolStore::symbols(uint32_t fileId) const
+{
+    const FileMap::const_iterator file = mFiles.find(fileId);
+    if (file == mFiles.end())
+        return 0;
+    ensureLoaded(file->second, fileId);
+    return file->second.symbols.isEmpty() ? 0 : &file->second.symbols;
+}
+
+int64_t SymbolStore::memoryUsage(uint32_t fileId) const
+{
+    const FileMap::const_iterator file = mFiles.find(fileId);
+    return file == mFiles.end() || !file->second.loaded ? 0 : memoryUsage(file->second.symbols);
+}
+
+int64_t SymbolStore::memoryUsage(const FileSymbols &symbols)
+{
+    int64_t ret = symbols.capacity() * sizeof(Entry);
+    for (int i=0; i<symbols.size(); ++i)
+        ret += symbols.at(i).second.heapSize();
+    return ret;
+}
+
+static inline void take(SymbolStore::FileSymbols &symbols, const Location &location, CursorInfo &cursorInfo)
+{
+    symbols.append(SymbolStore::Entry(location, CursorInfo()));
+    symbols.back().second.take(cursorInfo);
+}
+
+void SymbolStore::unite(ArenaSymbolMap &symbols)
+{
+    ArenaSymbolMap::iterator it = symbols.begin();
+    while (it != symbols.end()) {
+        const uint32_t fileId = it->first.fileId();
+        ArenaSymbolMap::iterator end = it;
+        int count = 0;
+        while (end != symbols.end() && end->first.fileId() == fileId) {
+            ++end;
+            ++count;
+        }
+
+        const File &file = mFiles[fileId];
+        ensureLoaded(file, fileId);
+        FileSymbols &current = file.symbols;
+        if (current.isEmpty()) {
+            current.reserve(count);
+            while (it != end) {
+                take(current, it->first, it->second);
+                ++it;
+            }
+            mSize += count;
+            continue;
+        }
+
+        // current is replaced by merged so its cursors can be moved too
+        FileSymbols merged;
+        merged.reserve(current.size() + count);
+        int idx = 0;
+        while (idx < current.size() || it != end) {
+            if (it == end || (idx < current.size() && current[idx].first.offset() < it->first.offset())) {
+                take(merged, current[idx].first, current[idx].second);
+                ++idx;
+            } else if (idx == current.size() || it->first.offset() < current[idx].first.offset()) {
+                take(merged, it->first, it->second);
+                ++it;
+                ++mSize;
+            } else {
+                take(merged, current[idx].first, current[idx].second);
+                ++idx;
+                merged.back().second.unite(it->second);
+                ++it;
+            }
+        }
+        current.swap(merged);
+    }
+}
+
+void SymbolStore::replace(uint32_t fileId, FileSymbols &symbols)
+{
+    if (symbols.isEmpty()) {
+        remove(fileId);
+        return;
+    }
+    File &current = mFiles[fileId];
+    if (!current.loaded) {
+        current.loaded = 1;
+        --mUnloaded;
+    }
+    mSize += symbols.size() - current.symbols.size();
+    current.symbols.swap(symbols);
+}
+
+bool SymbolStore::remove(uint32_t fileId)
+{
+    const FileMap::iterator file = mFiles.find(fileId);
+    if (file == mFiles.end())
+        return false;
+    if (!file->second.loaded)
+        --mUnloaded;
+    mSize -= file->second.symbols.size();
+    mFiles.erase(file);
+    return true;
+}
+
+void SymbolStore::dirty(const Set<uint32_t> &dirty, Set<uint32_t> *modifiedFiles)
+{
+    for (Set<uint32_t>::const_iterator it = dirty.begin(); it != dirty.end(); ++it) {
+        remove(*it);
+    }
+    // Files that haven't been read are left alone, whoever reads them has
+    // to drop the dirty locations
+    for (iterator it = begin(); it != end(); ++it) {
+        if (it->second.dirty(dirty) && modifiedFiles)
+            modifiedFiles->insert(it->first.fileId());
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef SymbolStore_h
+#define SymbolStore_h
+
+#include "CursorInfo.h"
+#include "List.h"
+#include "Location.h"
+#include "Map.h"
+#include "Memory.h"
+#include "Mutex.h"
+
+/*
+  The project's cursors stored as one contiguous array per file, sorted by
+  offset, rather than one tree node per cursor. A lookup is a map lookup on
+  the fileId followed by a binary search and a re-indexed file can be
+  replaced or removed wholesale. Iterators walk the files in fileId order and
+  have the same first/second interface as SymbolMap's.
+
+  Files can also be added unloaded with setUnloaded(), their cursors are read
+  through a callback the first time a lookup needs them. Readers sharing the
+  store can do that concurrently, loads are serialized by a mutex and a file
+  is published once it's been read. Iterators only walk files that have been
+  read, loadAll() reads the rest.
+*/
+
+class SymbolStore
+{
+public:
+    typedef std::pair<Location, CursorInfo> Entry;
+    typedef List<Entry> FileSymbols;
+
+    // Reads fileId's cursors, called with the store's load mutex held
+    typedef bool (*LoadCallback)(uint32_t fileId, FileSymbols &symbols, void *userData);
+private:
+    struct File {
+        File()
+            : loaded(1)
+        {}
+        mutable FileSymbols symbols;
+        mutable volatile int loaded; // 0 until an unloaded file's symbols have been read
+    };
+    typedef Map<uint32_t, File> FileMap;
+
+    struct Loader {
+        LoadCallback callback;
+        void *userData;
+        Mutex mutex;
+    };
+
+    template <typename FileIterator, typename T>
+    class Iterator
+    {
+    public:
+        Iterator()
+            : mIndex(0)
+        {}
+        Iterator(const FileIterator &file, const FileIterator &end, int index)
+            : mFile(file), mEnd(end), mIndex(index)
+        {
+            skip();
+        }
+        template <typename F, typename U>
+        Iterator(const Iterator<F, U> &other)
+            : mFile(other.mFile), mEnd(other.mEnd), mIndex(other.mIndex)
+        {}
+
+        T &operator*() const { return mFile->second.symbols[mIndex]; }
+        T *operator->() const { return &mFile->second.symbols[mIndex]; }
+
+        Iterator &operator++()
+        {
+            if (++mIndex == mFile->second.symbols.size()) {
+                ++mFile;
+                mIndex = 0;
+                skip();
+            }
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            const Iterator ret = *this;
+            operator++();
+            return ret;
+        }
+
+        bool operator==(const Iterator &other) const { return mFile == other.mFile && mIndex == other.mIndex; }
+        bool operator!=(const Iterator &other) const { return mFile != other.mFile || mIndex != other.mIndex; }
+    private:
+        template <typename F, typename U> friend class Iterator;
+        friend class SymbolStore;
+
+        // Files that haven't been read or have no cursors are skipped
+        void skip()
+        {
+            while (mFile != mEnd && (!mFile->second.loaded || mFile->second.symbols.isEmpty()))
+                ++mFile;
+        }
+
+        FileIterator mFile, mEnd;
+        int mIndex;
+    };
+public:
+    typedef Iterator<FileMap::iterator, Entry> iterator;
+    typedef Iterator<FileMap::const_iterator, const Entry> const_iterator;
+
+    SymbolStore()
+        : mSize(0), mUnloaded(0)
+    {}
+
+    iterator begin() { return iterator(mFiles.begin(), mFiles.end(), 0); }
+    iterator end() { return iterator(mFiles.end(), mFiles.end(), 0); }
+    const_iterator begin() const { return const_iterator(mFiles.begin(), mFiles.end(), 0); }
+    const_iterator end() const { return const_iterator(mFiles.end(), mFiles.end(), 0); }
+
+    // size() and fileCount() only count what has been read
+    int size() const { return mSize; }
+    bool isEmpty() const { return !mSize && !mUnloaded; }
+    int fileCount() const { return mFiles.size() - mUnloaded; }
+    void clear()
+    {
+        mFiles.clear();
+        mSize = 0;
+        mUnloaded = 0;
+    }
+
+    // Only meant for an empty store
+    void setUnloaded(const Set<uint32_t> &fileIds, LoadCallback callback, void *userData);
+    void loadAll() const;
+
+    iterator find(const Location &location);
+    const_iterator find(const Location &location) const;
+    bool contains(const Location &location) const { return find(location) != end(); }
+
+    // The last cursor in location's file that starts at or before location
+    const_iterator findAtOrBefore(const Location &location) const;
+
+    CursorInfo &operator[](const Location &location);
+
+    const FileSymbols *symbols(uint32_t fileId) const;
+    // Bytes held by fileId's cursors, 0 if they haven't been read
+    int64_t memoryUsage(uint32_t fileId) const;
+    static int64_t memoryUsage(const FileSymbols &symbols);
+    // Moves symbols' cursors in, symbols is left with empty ones
+    void unite(ArenaSymbolMap &symbols);
+    void replace(uint32_t fileId, FileSymbols &symbols);
+    bool remove(uint32_t fileId);
+    void dirty(const Set<uint32_t> &dirty, Set<uint32_t> *modifiedFiles = 0);
+
+    // Index of the first cursor in symbols that starts at or after offset
+    static int lowerBound(const FileSymbols &symbols, uint32_t offset);
+private:
+    void load(const File &file, uint32_t fileId) const;
+    void ensureLoaded(const File &file, uint32_t fileId) const
+    {
+        if (!file.loaded)
+            load(file, fileId);
+    }
+
+    FileMap mFiles;
+    mutable int mSize;
+    mutable volatile int mUnloaded;
+    shared_ptr<Loader> mLoader;
+};
+
+#endif
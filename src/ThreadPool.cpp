@@ -1,6 +1,8 @@
 #include "ThreadPool.h"
 #include "Thread.h"
 #include "MutexLocker.h"
+#include "ReadLocker.h"
+#include "WriteLocker.h"
 #include <algorithm>
 #include <assert.h>
 #if defined (OS_FreeBSD) || defined (OS_NetBSD) || defined (OS_OpenBSD)
@@ -27,19 +29,28 @@ protected:
     virtual void run();
 
 private:
+    void runJob(const shared_ptr<ThreadPool::Job> &job);
+
     shared_ptr<ThreadPool::Job> mJob;
     ThreadPool* mPool;
-    bool mStopped;
+    volatile bool mStopped;
+
+    // WorkStealing, the owner takes from the front and others steal from the back
+    Mutex mQueueMutex;
+    std::deque<shared_ptr<ThreadPool::Job> > mQueue;
+    unsigned mNextVictim;
+
+    friend class ThreadPool;
 };
 
 ThreadPoolThread::ThreadPoolThread(ThreadPool* pool)
-    : mPool(pool), mStopped(false)
+    : mPool(pool), mStopped(false), mNextVictim(0)
 {
     setAutoDelete(false);
 }
 
 ThreadPoolThread::ThreadPoolThread(const shared_ptr<ThreadPool::Job> &job)
-    : mJob(job), mPool(0), mStopped(false)
+    : mJob(job), mPool(0), mStopped(false), mNextVictim(0)
 {
     setAutoDelete(false);
 }
@@ -51,12 +62,30 @@ void ThreadPoolThread::stop()
     mPool->mCond.wakeAll();
 }
 
+void ThreadPoolThread::runJob(const shared_ptr<ThreadPool::Job> &job)
+{
+    job->mMutex.lock();
+    job->run();
+    job->mMutex.unlock();
+}
+
 void ThreadPoolThread::run()
 {
     if (mJob) {
-        mJob->mMutex.lock();
-        mJob->run();
-        mJob->mMutex.unlock();
+        runJob(mJob);
+        return;
+    }
+    if (mPool->mMode == ThreadPool::WorkStealing) {
+        while (!mStopped) {
+            const shared_ptr<ThreadPool::Job> job = mPool->takeJob(this);
+            if (!job) {
+                mPool->wait(this);
+                continue;
+            }
+            __sync_add_and_fetch(&mPool->mBusyThreads, 1);
+            runJob(job);
+            __sync_sub_and_fetch(&mPool->mBusyThreads, 1);
+        }
         return;
     }
     bool first = true;
@@ -71,10 +100,8 @@ void ThreadPoolThread::run()
             mPool->mCond.wait(&mPool->mMutex);
         if (mStopped)
             break;
-        std::deque<shared_ptr<ThreadPool::Job> >::iterator item = mPool->mJobs.begin();
-        assert(item != mPool->mJobs.end());
-        shared_ptr<ThreadPool::Job> job = *item;
-        mPool->mJobs.erase(item);
+        shared_ptr<ThreadPool::Job> job = mPool->mJobs.top().job;
+        mPool->mJobs.pop();
         job->mMutex.lock();
         ++mPool->mBusyThreads;
         locker.unlock();
@@ -83,20 +110,16 @@ void ThreadPoolThread::run()
     }
 }
 
-ThreadPool::ThreadPool(int concurrentJobs)
-    : mConcurrentJobs(concurrentJobs), mBusyThreads(0)
+ThreadPool::ThreadPool(int concurrentJobs, Mode mode)
+    : mMode(mode), mConcurrentJobs(concurrentJobs), mSequence(0), mBusyThreads(0),
+      mPending(0), mPendingPriority(0), mNextThread(0), mIdleThreads(0)
 {
-    for (int i = 0; i < mConcurrentJobs; ++i) {
-        mThreads.push_back(new ThreadPoolThread(this));
-        mThreads.back()->start();
-    }
+    startThreads(mConcurrentJobs);
 }
 
 ThreadPool::~ThreadPool()
 {
-    MutexLocker locker(&mMutex);
-    mJobs.clear();
-    locker.unlock();
+    clearBackLog();
     for (List<ThreadPoolThread*>::iterator it = mThreads.begin();
          it != mThreads.end(); ++it) {
         ThreadPoolThread* t = *it;
@@ -112,17 +135,27 @@ void ThreadPool::setConcurrentJobs(int concurrentJobs)
         return;
     if (concurrentJobs > mConcurrentJobs) {
         MutexLocker locker(&mMutex);
-        for (int i = mConcurrentJobs; i < concurrentJobs; ++i) {
-            mThreads.push_back(new ThreadPoolThread(this));
-            mThreads.back()->start();
-        }
+        startThreads(concurrentJobs - mConcurrentJobs);
         mConcurrentJobs = concurrentJobs;
     } else {
         MutexLocker locker(&mMutex);
         for (int i = mConcurrentJobs; i > concurrentJobs; --i) {
-            ThreadPoolThread* t = mThreads.back();
-            mThreads.pop_back();
+            ThreadPoolThread* t;
+            std::deque<shared_ptr<Job> > orphaned;
+            {
+                WriteLocker threadsLocker(&mThreadsLock);
+                t = mThreads.back();
+                mThreads.pop_back();
+                MutexLocker queueLocker(&t->mQueueMutex);
+                orphaned.swap(t->mQueue);
+            }
             locker.unlock();
+            // hand whatever was left in its queue to the remaining threads
+            while (!orphaned.empty()) {
+                __sync_sub_and_fetch(&mPending, 1);
+                queue(orphaned.front(), 0);
+                orphaned.pop_front();
+            }
             t->stop();
             t->join();
             locker.relock();
@@ -132,9 +165,13 @@ void ThreadPool::setConcurrentJobs(int concurrentJobs)
     }
 }
 
-bool ThreadPool::jobLessThan(const shared_ptr<Job> &l, const shared_ptr<Job> &r)
+void ThreadPool::startThreads(int count)
 {
-    return static_cast<unsigned>(l->mPriority) > static_cast<unsigned>(r->mPriority);
+    WriteLocker threadsLocker(&mThreadsLock);
+    for (int i = 0; i < count; ++i) {
+        mThreads.push_back(new ThreadPoolThread(this));
+        mThreads.back()->start();
+    }
 }
 
 void ThreadPool::start(const shared_ptr<Job> &job, int priority)
@@ -146,20 +183,97 @@ void ThreadPool::start(const shared_ptr<Job> &job, int priority)
         return;
     }
 
+    if (mMode == WorkStealing) {
+        queue(job, priority);
+        return;
+    }
+
     MutexLocker locker(&mMutex);
-    if (mJobs.empty()) {
-        mJobs.push_back(job);
-    } else {
-        if (mJobs.at(mJobs.size() - 1)->mPriority >= priority) {
-            mJobs.push_back(job);
-        } else if (mJobs.at(0)->mPriority < priority) {
-            mJobs.push_front(job);
-        } else {
-            mJobs.push_back(job);
-            std::sort(mJobs.begin(), mJobs.end(), jobLessThan);
+    // after all jobs with the same or a higher priority
+    const PriorityJob priorityJob = { priority, mSequence++, job };
+    mJobs.push(priorityJob);
+    mCond.wakeOne();
+}
+
+void ThreadPool::queue(const shared_ptr<Job> &job, int priority)
+{
+    bool queued = false;
+    if (!priority) {
+        ReadLocker threadsLocker(&mThreadsLock);
+        if (!mThreads.isEmpty()) {
+            ThreadPoolThread *t = mThreads.at(__sync_fetch_and_add(&mNextThread, 1) % mThreads.size());
+            MutexLocker queueLocker(&t->mQueueMutex);
+            t->mQueue.push_back(job);
+            queued = true;
         }
     }
-    mCond.wakeOne();
+    if (!queued) {
+        MutexLocker priorityLocker(&mPriorityMutex);
+        const PriorityJob priorityJob = { priority, mSequence++, job };
+        mPriorityJobs.push(priorityJob);
+        __sync_add_and_fetch(&mPendingPriority, 1);
+    }
+
+    // mPending is bumped before taking mMutex so a thread that's about to
+    // go to sleep either sees it or is already waiting for the wakeup
+    __sync_add_and_fetch(&mPending, 1);
+    MutexLocker locker(&mMutex);
+    if (mIdleThreads)
+        mCond.wakeOne();
+}
+
+shared_ptr<ThreadPool::Job> ThreadPool::takeJob(ThreadPoolThread *thread)
+{
+    shared_ptr<Job> job;
+    if (mPendingPriority) {
+        MutexLocker priorityLocker(&mPriorityMutex);
+        if (!mPriorityJobs.empty()) {
+            job = mPriorityJobs.top().job;
+            mPriorityJobs.pop();
+            __sync_sub_and_fetch(&mPendingPriority, 1);
+            __sync_sub_and_fetch(&mPending, 1);
+            return job;
+        }
+    }
+
+    {
+        MutexLocker queueLocker(&thread->mQueueMutex);
+        if (!thread->mQueue.empty()) {
+            job = thread->mQueue.front();
+            thread->mQueue.pop_front();
+            __sync_sub_and_fetch(&mPending, 1);
+            return job;
+        }
+    }
+
+    if (!mPending)
+        return job;
+
+    ReadLocker threadsLocker(&mThreadsLock);
+    const int count = mThreads.size();
+    for (int i = 0; i < count; ++i) {
+        ThreadPoolThread *victim = mThreads.at(thread->mNextVictim++ % count);
+        if (victim == thread)
+            continue;
+        MutexLocker queueLocker(&victim->mQueueMutex);
+        if (!victim->mQueue.empty()) {
+            job = victim->mQueue.back();
+            victim->mQueue.pop_back();
+            __sync_sub_and_fetch(&mPending, 1);
+            return job;
+        }
+    }
+    return job;
+}
+
+void ThreadPool::wait(ThreadPoolThread *thread)
+{
+    MutexLocker locker(&mMutex);
+    while (mPending <= 0 && !thread->mStopped) {
+        ++mIdleThreads;
+        mCond.wait(&mMutex);
+        --mIdleThreads;
+    }
 }
 
 int ThreadPool::idealThreadCount()
@@ -212,5 +326,22 @@ ThreadPool::Job::~Job()
 void ThreadPool::clearBackLog()
 {
     MutexLocker locker(&mMutex);
-    mJobs.clear();
+    mJobs = std::priority_queue<PriorityJob>();
+    if (mMode != WorkStealing)
+        return;
+    int cleared = 0;
+    {
+        MutexLocker priorityLocker(&mPriorityMutex);
+        cleared = mPriorityJobs.size();
+        mPriorityJobs = std::priority_queue<PriorityJob>();
+        __sync_sub_and_fetch(&mPendingPriority, cleared);
+    }
+    ReadLocker threadsLocker(&mThreadsLock);
+    for (int i = 0; i < mThreads.size(); ++i) {
+        ThreadPoolThread *t = mThreads.at(i);
+        MutexLocker queueLocker(&t->mQueueMutex);
+        cleared += t->mQueue.size();
+        t->mQueue.clear();
+    }
+    __sync_sub_and_fetch(&mPending, cleared);
 }
@@ -0,0 +1,103 @@
+#include "UsrIndex.h"
+
+UsrIndex::UsrIndex()
+{
+}
+
+uint64_t UsrIndex::hash(const ByteArray &usr)
+{
+    // 64-bit FNV-1a
+    uint64_t ret = 14695981039346656037ULL;
+    const char *data = usr.constData();
+    const int size = usr.size();
+    for (int i=0; i<size; ++i) {
+        ret ^= static_cast<unsigned char>(data[i]);
+        ret *= 1099511628211ULL;
+    }
+    return ret;
+}
+
+Set<Location> &UsrIndex::insert(const InternedString &usr, uint64_t hash)
+{
+    if ((mEntries.size() + 1) * 2 > mBuckets.size())
+        rehash(mBuckets.isEmpty() ? 64 : mBuckets.size() * 2);
+
+    const int mask = mBuckets.size() - 1;
+    int idx = hash & mask;
+    while (const int bucket = mBuckets.at(idx)) {
+        Entry &entry = mEntries[bucket - 1];
+        if (entry.hash == hash && entry.usr == usr)
+            return entry.locations;
+        idx = (idx + 1) & mask;
+    }
+    mEntries.append(Entry());
+    Entry &entry = mEntries.last();
+    entry.hash = hash;
+    entry.usr = usr;
+    mBuckets[idx] = mEntries.size();
+    return entry.locations;
+}
+
+const Set<Location> *UsrIndex::find(const ByteArray &usr, uint64_t h) const
+{
+    if (mEntries.isEmpty())
+        return 0;
+    const int mask = mBuckets.size() - 1;
+    int idx = h & mask;
+    while (const int bucket = mBuckets.at(idx)) {
+        const Entry &entry = mEntries.at(bucket - 1);
+        if (entry.hash == h && entry.usr.string() == usr)
+            return &entry.locations;
+        idx = (idx + 1) & mask;
+    }
+    return 0;
+}
+
+void UsrIndex::clear()
+{
+    mEntries.clear();
+    mBuckets.clear();
+}
+
+void UsrIndex::dirty(const Set<uint32_t> &dirty)
+{
+    int out = 0;
+    const int count = mEntries.size();
+    for (int i=0; i<count; ++i) {
+        Set<Location> &locations = mEntries[i].locations;
+        Set<Location>::iterator it = locations.begin();
+        while (it != locations.end()) {
+            if (dirty.contains(it->fileId())) {
+                locations.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        if (!locations.isEmpty()) {
+            if (out != i) {
+                mEntries[out].hash = mEntries[i].hash;
+                mEntries[out].usr = mEntries[i].usr;
+                mEntries[out].locations.swap(locations);
+            }
+            ++out;
+        }
+    }
+    if (out != count) {
+        mEntries.resize(out);
+        rehash(mBuckets.size());
+    }
+}
+
+void UsrIndex::rehash(int bucketCount)
+{
+    mBuckets.clear();
+    mBuckets.resize(bucketCount, 0);
+    const int mask = bucketCount - 1;
+    const int count = mEntries.size();
+    for (int i=0; i<count; ++i) {
+        int idx = mEntries.at(i).hash & mask;
+        while (mBuckets.at(idx))
+            idx = (idx + 1) & mask;
+        mBuckets[idx] = i + 1;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef UsrIndex_h
+#define UsrIndex_h
+
+#include "List.h"
+#include "Location.h"
+#include "Set.h"
+#include "StringPool.h"
+
+/*
+  Locations of cursors by USR. Lookups go through an open addressing table
+  keyed on a 64-bit hash of the USR and a match is verified against the
+  interned USR, so collisions are harmless. Entries remember their hash so
+  merging one index into another never hashes a string again.
+
+  References returned by insert() and operator[] are invalidated by the
+  next insertion.
+*/
+
+class UsrIndex
+{
+public:
+    struct Entry {
+        uint64_t hash;
+        InternedString usr;
+        Set<Location> locations;
+    };
+    typedef List<Entry>::iterator iterator;
+    typedef List<Entry>::const_iterator const_iterator;
+
+    UsrIndex();
+
+    static uint64_t hash(const ByteArray &usr);
+
+    // hash has to be hash(usr)
+    Set<Location> &insert(const InternedString &usr, uint64_t hash);
+    Set<Location> &operator[](const ByteArray &usr) { return insert(usr, hash(usr)); }
+    const Set<Location> *find(const ByteArray &usr) const { return find(usr, hash(usr)); }
+    const Set<Location> *find(const ByteArray &usr, uint64_t hash) const;
+
+    // Changing an entry's locations is fine, its usr and hash aren't
+    iterator begin() { return mEntries.begin(); }
+    iterator end() { return mEntries.end(); }
+    const_iterator begin() const { return mEntries.begin(); }
+    const_iterator end() const { return mEntries.end(); }
+    int size() const { return mEntries.size(); }
+    bool isEmpty() const { return mEntries.isEmpty(); }
+    void clear();
+
+    void dirty(const Set<uint32_t> &dirty);
+private:
+    void rehash(int bucketCount);
+
+    List<Entry> mEntries;
+    List<int> mBuckets; // index in mEntries + 1, 0 means empty. Size is a power of 2
+};
+
+template <> inline Serializer &operator<<(Serializer &s, const UsrIndex &t)
+{
+    s << t.size();
+    for (UsrIndex::const_iterator it = t.begin(); it != t.end(); ++it)
+        s << it->usr << it->locations;
+    return s;
+}
+
+template <> inline Deserializer &operator>>(Deserializer &s, UsrIndex &t)
+{
+    t.clear();
+    int size;
+    s >> size;
+    for (int i=0; i<size; ++i) {
+        ByteArray usr;
+        s >> usr;
+        s >> t.insert(usr, UsrIndex::hash(usr));
+    }
+    return s;
+}
+
+#endif
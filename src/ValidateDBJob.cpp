@@ -50,13 +50,14 @@ void ValidateDBJob::execute()
     int total = 0;
     Set<Location> newErrors;
     {
-        Scope<const SymbolMap&> scope = project()->lockSymbolsForRead();
+        project()->loadAll(Database::Symbols);
+        Scope<const SymbolStore&> scope = project()->lockSymbolsForRead(0, Project::InternalLock);
         if (scope.isNull())
             return;
-        const SymbolMap &map = scope.data();
+        const SymbolStore &map = scope.data();
         char *lastFileContents = 0;
         uint32_t lastFileId = -1;
-        for (SymbolMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        for (SymbolStore::const_iterator it = map.begin(); it != map.end(); ++it) {
             if (isAborted()) {
                 delete []lastFileContents;
                 return;
@@ -67,13 +68,13 @@ void ValidateDBJob::execute()
                 if (!mPrevious.contains(loc)) {
                     Log stream(Error);
                     stream << "Invalid entry for " << loc
-                           << " symbolName: " << ci.symbolName;
+                           << " symbolName: " << ci.symbolName();
                     if (ci.kind)
                         stream << " kind: " << RTags::eatString(clang_getCursorKindSpelling(ci.kind));// this somehow seems to hang when kind == 0
                     stream << " isDefinition: " << (ci.isDefinition() ? "true" : "false")
                            << " target: " << ci.targets
                            << " references:";
-                    for (Set<Location>::const_iterator rit = ci.references.begin(); rit != ci.references.end(); ++rit) {
+                    for (LocationSet::const_iterator rit = ci.references.begin(); rit != ci.references.end(); ++rit) {
                         stream << " " << *rit;
                     }
                 }
@@ -0,0 +1,194 @@
+#include <clang-c/Index.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ByteArray.h"
+#include "GccArguments.h"
+#include "RTags.h"
+#include "RTagsClang.h"
+#include "StopWatch.h"
+
+/*
+  Parses a file once and then walks it the way each of IndexerJob's backends
+  does, clang_visitChildren over the whole AST or clang_indexTranslationUnit
+  plus the visits for macros, labels and deletes, and prints how long each one took.
+  Both look up the location of each cursor and reference, the visitor also
+  has to ask for the USRs that the callbacks are handed. Usage:
+
+  indexbench [iterations] <compiler command line>
+*/
+
+struct Counts
+{
+    Counts()
+        : cursors(0), references(0)
+    {}
+    int cursors, references;
+};
+
+static inline void touch(const CXSourceLocation &location)
+{
+    CXFile file;
+    unsigned offset;
+    clang_getSpellingLocation(location, &file, 0, 0, &offset);
+}
+
+static inline void touch(const CXCursor &cursor)
+{
+    touch(clang_getCursorLocation(cursor));
+    CXString usr = clang_getCursorUSR(cursor);
+    clang_disposeString(usr);
+}
+
+static CXChildVisitResult visitAll(CXCursor cursor, CXCursor, CXClientData userData)
+{
+    Counts *counts = static_cast<Counts*>(userData);
+    switch (RTags::cursorType(clang_getCursorKind(cursor))) {
+    case RTags::Cursor:
+        touch(cursor);
+        ++counts->cursors;
+        break;
+    case RTags::Reference:
+        touch(clang_getCursorLocation(cursor));
+        touch(clang_getCursorReferenced(cursor));
+        ++counts->references;
+        break;
+    default:
+        break;
+    }
+    return CXChildVisit_Recurse;
+}
+
+static CXChildVisitResult visitPreprocessing(CXCursor cursor, CXCursor parent, CXClientData userData)
+{
+    switch (clang_getCursorKind(cursor)) {
+    case CXCursor_MacroDefinition:
+    case CXCursor_MacroExpansion:
+        visitAll(cursor, parent, userData);
+        break;
+    default:
+        break;
+    }
+    return CXChildVisit_Continue;
+}
+
+static CXChildVisitResult visitBody(CXCursor cursor, CXCursor parent, CXClientData userData)
+{
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    switch (kind) {
+    case CXCursor_LabelRef:
+    case CXCursor_CXXDeleteExpr:
+        return visitAll(cursor, parent, userData);
+    case CXCursor_VarDecl:
+        return CXChildVisit_Recurse;
+    default:
+        break;
+    }
+    return clang_isStatement(kind) || clang_isExpression(kind) ? CXChildVisit_Recurse : CXChildVisit_Continue;
+}
+
+static void indexDeclaration(CXClientData userData, const CXIdxDeclInfo *info)
+{
+    if (info->isImplicit)
+        return;
+    const CXCursorKind kind = clang_getCursorKind(info->cursor);
+    if (RTags::cursorType(kind) != RTags::Cursor)
+        return;
+    Counts *counts = static_cast<Counts*>(userData);
+    touch(clang_indexLoc_getCXSourceLocation(info->loc));
+    ++counts->cursors;
+    if (info->isDefinition) {
+        switch (kind) {
+        case CXCursor_FunctionDecl:
+        case CXCursor_CXXMethod:
+        case CXCursor_Constructor:
+        case CXCursor_Destructor:
+        case CXCursor_ConversionFunction:
+        case CXCursor_FunctionTemplate:
+            clang_visitChildren(info->cursor, visitBody, userData);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void indexEntityReference(CXClientData userData, const CXIdxEntityRefInfo *info)
+{
+    Counts *counts = static_cast<Counts*>(userData);
+    touch(clang_indexLoc_getCXSourceLocation(info->loc));
+    ++counts->references;
+}
+
+int main(int argc, char **argv)
+{
+    RTags::findApplicationDirPath(*argv);
+    int iterations = 1;
+    int first = 1;
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        iterations = atoi(argv[1]);
+        ++first;
+    }
+    ByteArray ba;
+    for (int i=first; i<argc; ++i) {
+        if (i > first)
+            ba.append(' ');
+        ba.append(argv[i]);
+    }
+
+    GccArguments args;
+    if (!args.parse(ba, RTags::applicationDirPath()) || args.inputFiles().isEmpty()) {
+        fprintf(stderr, "Usage: %s [iterations] <compiler command line>\n", argv[0]);
+        return 1;
+    }
+    const List<ByteArray> clangArgs = args.clangArgs();
+    const char **a = new const char*[clangArgs.size()];
+    for (int i=0; i<clangArgs.size(); ++i)
+        a[i] = clangArgs.at(i).constData();
+
+    CXIndex index = clang_createIndex(1, 1);
+    StopWatch timer;
+    CXTranslationUnit unit = clang_parseTranslationUnit(index, args.inputFiles().first().constData(),
+                                                        a, clangArgs.size(), 0, 0,
+                                                        CXTranslationUnit_DetailedPreprocessingRecord);
+    delete[] a;
+    if (!unit) {
+        fprintf(stderr, "Failed to parse %s\n", args.inputFiles().first().constData());
+        clang_disposeIndex(index);
+        return 1;
+    }
+    printf("parsed %s in %dms\n", args.inputFiles().first().constData(), timer.elapsed());
+
+    Counts visitor;
+    timer.start();
+    for (int i=0; i<iterations; ++i) {
+        visitor = Counts();
+        clang_visitChildren(clang_getTranslationUnitCursor(unit), visitAll, &visitor);
+    }
+    const int visitorTime = timer.elapsed();
+
+    Counts callbacks;
+    IndexerCallbacks cb;
+    memset(&cb, 0, sizeof(IndexerCallbacks));
+    cb.indexDeclaration = indexDeclaration;
+    cb.indexEntityReference = indexEntityReference;
+    timer.start();
+    for (int i=0; i<iterations; ++i) {
+        callbacks = Counts();
+        CXIndexAction action = clang_IndexAction_create(index);
+        clang_indexTranslationUnit(action, &callbacks, &cb, sizeof(IndexerCallbacks),
+                                   CXIndexOpt_IndexFunctionLocalSymbols, unit);
+        clang_IndexAction_dispose(action);
+        clang_visitChildren(clang_getTranslationUnitCursor(unit), visitPreprocessing, &callbacks);
+    }
+    const int callbacksTime = timer.elapsed();
+
+    printf("visitor:   %dms per run, %d cursors, %d references\n",
+           visitorTime / iterations, visitor.cursors, visitor.references);
+    printf("callbacks: %dms per run, %d cursors, %d references\n",
+           callbacksTime / iterations, callbacks.cursors, callbacks.references);
+
+    clang_disposeTranslationUnit(unit);
+    clang_disposeIndex(index);
+    return 0;
+}
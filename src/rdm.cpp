@@ -1,4 +1,5 @@
 #include "EventLoop.h"
+#include "IndexerWorker.h"
 #include "Log.h"
 #include "RTags.h"
 #include "Server.h"
@@ -64,12 +65,21 @@ void usage(FILE *f)
             "  --setenv|-e [arg]                 Set this environment variable (--setenv \"foobar=1\")\n"
             "  --completion-cache-size|-a [arg]  Cache this many translation units (default 10, min 1)\n"
             "  --no-unlimited-error|-f           Don't pass -ferror-limit=0 to clang\n"
-            "  --thread-count|-j [arg]           Spawn this many threads for thread pool\n");
+            "  --thread-count|-j [arg]           Spawn this many threads for thread pool\n"
+            "  --work-stealing|-w                Give each indexer thread its own job queue and let idle threads steal jobs\n"
+            "  --preamble-cache|-b               Share precompiled headers of the includes source files start with between jobs\n"
+            "  --index-callbacks|-X              Index with libclang's indexing callbacks instead of visiting every cursor\n"
+            "  --index-in-workers|-k             Index in separate worker processes\n"
+            "  --worker-max-jobs|-K [arg]        Replace a worker process after this many jobs (default 100)\n"
+            "  --worker-max-memory|-E [arg]      Replace a worker process once it uses more than this many mb (default 1024)\n"
+            "  --memory-budget|-M [arg]          Run fewer indexer jobs at a time to stay under this many mb\n");
 }
 
 int main(int argc, char** argv)
 {
     RTags::findApplicationDirPath(*argv);
+    if (argc == 2 && !strcmp(argv[1], "--indexer-worker"))
+        return IndexerWorker::exec();
 
     struct option opts[] = {
         { "help", no_argument, 0, 'h' },
@@ -96,6 +106,13 @@ int main(int argc, char** argv)
         { "ignore-printf-fixits", no_argument, 0, 'F' },
         { "no-unlimited-errors", no_argument, 0, 'f' },
         { "completion-cache-size", required_argument, 0, 'a' },
+        { "work-stealing", no_argument, 0, 'w' },
+        { "preamble-cache", no_argument, 0, 'b' },
+        { "index-callbacks", no_argument, 0, 'X' },
+        { "index-in-workers", no_argument, 0, 'k' },
+        { "worker-max-jobs", required_argument, 0, 'K' },
+        { "worker-max-memory", required_argument, 0, 'E' },
+        { "memory-budget", required_argument, 0, 'M' },
         { 0, 0, 0, 0 }
     };
     const ByteArray shortOptions = RTags::shortOptions(opts);
@@ -154,6 +171,8 @@ int main(int argc, char** argv)
 
     int jobs = ThreadPool::idealThreadCount();
     int completionCacheSize = 10;
+    int workerMaxJobs = 100, workerMaxMemory = 1024;
+    int memoryBudget = 0;
     unsigned options = 0;
     List<ByteArray> defaultArguments;
     ByteArray excludeFilters = EXCLUDEFILTER_DEFAULT;
@@ -203,6 +222,39 @@ int main(int argc, char** argv)
         case 'f':
             options |= Server::NoUnlimitedErrors;
             break;
+        case 'w':
+            options |= Server::WorkStealing;
+            break;
+        case 'b':
+            options |= Server::SharePreambles;
+            break;
+        case 'X':
+            options |= Server::IndexCallbacks;
+            break;
+        case 'k':
+            options |= Server::IndexInWorkers;
+            break;
+        case 'K':
+            workerMaxJobs = atoi(optarg);
+            if (workerMaxJobs < 1) {
+                fprintf(stderr, "Invalid argument to -K %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            memoryBudget = atoi(optarg);
+            if (memoryBudget < 1) {
+                fprintf(stderr, "Invalid argument to -M %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'E':
+            workerMaxMemory = atoi(optarg);
+            if (workerMaxMemory < 1) {
+                fprintf(stderr, "Invalid argument to -E %s\n", optarg);
+                return 1;
+            }
+            break;
         case 'e':
             putenv(optarg);
             break;
@@ -285,6 +337,9 @@ int main(int argc, char** argv)
     serverOpts.dataDir = dataDir;
     serverOpts.excludeFilters = excludeFilters.split(';');
     serverOpts.completionCacheSize = completionCacheSize;
+    serverOpts.workerMaxJobs = workerMaxJobs;
+    serverOpts.workerMaxMemory = workerMaxMemory;
+    serverOpts.memoryBudget = memoryBudget;
     if (!serverOpts.dataDir.endsWith('/'))
         serverOpts.dataDir.append('/');
     serverOpts.defaultArguments = defaultArguments;
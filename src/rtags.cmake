@@ -15,6 +15,7 @@ set(rtags_client_HDRS
     EventLoop.h
     EventReceiver.h
     FastDelegate.h
+    FileCache.h
     Job.h
     List.h
     LocalClient.h
@@ -27,6 +28,7 @@ set(rtags_client_HDRS
     Mutex.h
     MutexLocker.h
     Path.h
+    PathRegistry.h
     Preprocessor.h
     Process.h
     CompileMessage.h
@@ -43,6 +45,7 @@ set(rtags_client_HDRS
     SourceInformation.h
     ReadWriteLock.h
     Str.h
+    StringPool.h
     Thread.h
     ThreadLocal.h
     ThreadPool.h
@@ -58,17 +61,20 @@ set(rtags_client_SRCS
     CreateOutputMessage.cpp
     EventLoop.cpp
     EventReceiver.cpp
+    FileCache.cpp
     LocalClient.cpp
     Location.cpp
     Log.cpp
     Messages.cpp
     Path.cpp
+    PathRegistry.cpp
     Preprocessor.cpp
     Process.cpp
     CompileMessage.cpp
     QueryMessage.cpp
     RClient.cpp
     ReadWriteLock.cpp
+    StringPool.cpp
     Semaphore.cpp
     SharedMemory.cpp
     Thread.cpp
@@ -78,28 +84,43 @@ set(rtags_client_SRCS
 
 set(rtags_HDRS
     ${rtags_client_HDRS}
+    Arena.h
     CompileJob.h
     CompletionJob.h
     CursorInfo.h
     CursorInfoJob.h
+    Database.h
+    FileIndex.h
     FileManager.h
     FileSystemWatcher.h
     Filter.h
     FindFileJob.h
     FindSymbolsJob.h
     FollowLocationJob.h
+    FuzzySymbolIndex.h
+    FuzzySymbolsJob.h
     GccArguments.h
+    IndexScheduler.h
+    IndexerWorker.h
     IndexerJob.h
+    LatencyHistogram.h
     ListSymbolsJob.h
     LocalServer.h
+    LocationSet.h
+    MappedFile.h
     Match.h
+    MemoryBudget.h
     MemoryMonitor.h
+    PreambleCache.h
     Project.h
     RTagsClang.h
     ReferencesJob.h
     ScanJob.h
     Server.h
     StatusJob.h
+    SymbolNameTrie.h
+    SymbolStore.h
+    UsrIndex.h
     ValidateDBJob.h
     )
 
@@ -111,7 +132,9 @@ set(rtags_SRCS
     FindFileJob.cpp
     FindSymbolsJob.cpp
     FollowLocationJob.cpp
+    FuzzySymbolsJob.cpp
     ScanJob.cpp
+    Arena.cpp
     IndexerJob.cpp
     Job.cpp
     ListSymbolsJob.cpp
@@ -120,20 +143,34 @@ set(rtags_SRCS
     ValidateDBJob.cpp
     LocalServer.cpp
     CursorInfo.cpp
+    Database.cpp
+    MappedFile.cpp
     Server.cpp
     MemoryMonitor.cpp
+    LatencyHistogram.cpp
+    MemoryBudget.cpp
+    PreambleCache.cpp
     GccArguments.cpp
+    FileIndex.cpp
     FileManager.cpp
     Project.cpp
+    FuzzySymbolIndex.cpp
+    IndexScheduler.cpp
+    IndexerWorker.cpp
+    SymbolNameTrie.cpp
+    SymbolStore.cpp
+    UsrIndex.cpp
     RTagsClang.cpp
    )
 
 set(grtags_SRCS
     GRParser.cpp
     GRTags.cpp
+    FileCache.cpp
     Location.cpp
     Log.cpp
     Path.cpp
+    PathRegistry.cpp
     RTags.cpp
     ReadWriteLock.cpp
 )
@@ -158,3 +195,19 @@ endif()
 
 add_library(rtags ${rtags_SRCS})
 add_dependencies(rtags gperf)
+
+# Benchmarks, not installed and not built by default, "make benchmarks"
+# builds all of them
+add_executable(indexbench EXCLUDE_FROM_ALL indexbench.cpp)
+target_link_libraries(indexbench rtags ${clang_LIBS} ${system_LIBS} ${CORESERVICES_LIBRARY} ${COREFOUNDATION_LIBRARY})
+
+add_executable(threadpoolbench EXCLUDE_FROM_ALL threadpoolbench.cpp)
+target_link_libraries(threadpoolbench rtags ${clang_LIBS} ${system_LIBS} ${CORESERVICES_LIBRARY} ${COREFOUNDATION_LIBRARY})
+
+add_executable(visitorbench EXCLUDE_FROM_ALL visitorbench.cpp)
+target_link_libraries(visitorbench rtags ${clang_LIBS} ${system_LIBS} ${CORESERVICES_LIBRARY} ${COREFOUNDATION_LIBRARY})
+
+add_executable(symbolstorebench EXCLUDE_FROM_ALL symbolstorebench.cpp)
+target_link_libraries(symbolstorebench rtags ${clang_LIBS} ${system_LIBS} ${CORESERVICES_LIBRARY} ${COREFOUNDATION_LIBRARY})
+
+add_custom_target(benchmarks DEPENDS indexbench threadpoolbench visitorbench symbolstorebench)
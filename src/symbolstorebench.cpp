@@ -0,0 +1,139 @@
+#include "CursorInfo.h"
+#include "SymbolStore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+  Fills a SymbolStore and the SymbolMap it replaced with the same cursors,
+  each with a target and two references in random files, and times random
+  lookups, a full iteration and dirtying a percent of the files the way
+  Project does after a file is modified. Usage:
+
+  symbolstorebench [files] [cursors per file] [lookups]
+*/
+
+static inline uint64_t now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+// What Project did with a SymbolMap before SymbolStore
+static void dirtySymbols(SymbolMap &map, const Set<uint32_t> &dirty)
+{
+    SymbolMap::iterator it = map.begin();
+    while (it != map.end()) {
+        if (dirty.contains(it->first.fileId())) {
+            map.erase(it++);
+        } else {
+            it->second.dirty(dirty);
+            ++it;
+        }
+    }
+}
+
+static inline Location randomLocation(int files, int cursors)
+{
+    return Location((rand() % files) + 1, (rand() % cursors) * 16);
+}
+
+template <typename Symbols>
+static uint64_t lookup(const Symbols &symbols, const List<Location> &locations, int *found)
+{
+    const uint64_t start = now();
+    int count = 0;
+    for (int i=0; i<locations.size(); ++i) {
+        if (symbols.find(locations.at(i)) != symbols.end())
+            ++count;
+    }
+    *found = count;
+    return now() - start;
+}
+
+template <typename Symbols>
+static uint64_t iterate(const Symbols &symbols, int64_t *sum)
+{
+    const uint64_t start = now();
+    int64_t total = 0;
+    for (typename Symbols::const_iterator it = symbols.begin(); it != symbols.end(); ++it)
+        total += it->second.kind + it->second.references.size();
+    *sum = total;
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    const int files = argc > 1 ? atoi(argv[1]) : 2000;
+    const int cursors = argc > 2 ? atoi(argv[2]) : 500;
+    const int lookups = argc > 3 ? atoi(argv[3]) : 1000000;
+    if (files <= 0 || cursors <= 0 || lookups <= 0) {
+        fprintf(stderr, "Usage: %s [files] [cursors per file] [lookups]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    SymbolMap map;
+    SymbolStore store;
+    uint64_t mapInsert = 0, storeInsert = 0;
+    for (int f=1; f<=files; ++f) {
+        SymbolStore::FileSymbols fileSymbols;
+        fileSymbols.reserve(cursors);
+        for (int c=0; c<cursors; ++c) {
+            CursorInfo info;
+            info.kind = static_cast<CXCursorKind>(1 + (c % 50));
+            info.symbolLength = 4;
+            info.start = c * 16;
+            info.end = info.start + 8;
+            info.targets.insert(randomLocation(files, cursors));
+            info.references.insert(randomLocation(files, cursors));
+            info.references.insert(randomLocation(files, cursors));
+            fileSymbols.append(SymbolStore::Entry(Location(f, c * 16), info));
+        }
+        uint64_t start = now();
+        for (int c=0; c<cursors; ++c)
+            map[fileSymbols.at(c).first] = fileSymbols.at(c).second;
+        mapInsert += now() - start;
+        start = now();
+        store.replace(f, fileSymbols);
+        storeInsert += now() - start;
+    }
+
+    List<Location> locations;
+    locations.reserve(lookups);
+    for (int i=0; i<lookups; ++i)
+        locations.append(randomLocation(files, cursors));
+
+    printf("%d files with %d cursors each, %d lookups\n", files, cursors, lookups);
+    printf("build:   map %llums inserting, store %llums in replace()\n",
+           static_cast<unsigned long long>(mapInsert / 1000), static_cast<unsigned long long>(storeInsert / 1000));
+
+    int mapFound, storeFound;
+    const uint64_t mapLookup = lookup(map, locations, &mapFound);
+    const uint64_t storeLookup = lookup(store, locations, &storeFound);
+    printf("lookup:  map %llums, store %llums, %d/%d found\n",
+           static_cast<unsigned long long>(mapLookup / 1000), static_cast<unsigned long long>(storeLookup / 1000),
+           mapFound, storeFound);
+
+    int64_t mapSum, storeSum;
+    const uint64_t mapIterate = iterate(map, &mapSum);
+    const uint64_t storeIterate = iterate(store, &storeSum);
+    printf("iterate: map %llums, store %llums%s\n",
+           static_cast<unsigned long long>(mapIterate / 1000), static_cast<unsigned long long>(storeIterate / 1000),
+           mapSum == storeSum ? "" : ", results differ");
+
+    Set<uint32_t> dirty;
+    for (int f=1; f<=files; f += 100)
+        dirty.insert(f);
+    uint64_t start = now();
+    dirtySymbols(map, dirty);
+    const uint64_t mapDirty = now() - start;
+    start = now();
+    store.dirty(dirty);
+    const uint64_t storeDirty = now() - start;
+    printf("dirty %d files: map %llums, store %llums, %d/%d cursors left\n", dirty.size(),
+           static_cast<unsigned long long>(mapDirty / 1000), static_cast<unsigned long long>(storeDirty / 1000),
+           static_cast<int>(map.size()), store.size());
+    return 0;
+}
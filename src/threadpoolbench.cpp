@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+  Runs a batch of small jobs, with every 97th one a hundred times bigger and
+  every 50th one prioritized, through a ThreadPool in each of its modes.
+  Prints the throughput and how long jobs waited between start() and
+  running, the tail of which is what a query job stuck behind indexing
+  sees. Usage:
+
+  threadpoolbench [threads] [jobs]
+*/
+
+static inline uint64_t now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static volatile int sDone = 0;
+static volatile long sSink = 0;
+
+class BenchJob : public ThreadPool::Job
+{
+public:
+    BenchJob(int work, uint64_t *wait)
+        : mWork(work), mWait(wait), mQueued(now())
+    {}
+protected:
+    virtual void run()
+    {
+        *mWait = now() - mQueued;
+        long x = 0;
+        for (int i=0; i<mWork; ++i)
+            x += i * i;
+        __sync_add_and_fetch(&sSink, x & 1);
+        __sync_add_and_fetch(&sDone, 1);
+    }
+private:
+    const int mWork;
+    uint64_t *mWait;
+    const uint64_t mQueued;
+};
+
+static inline uint64_t percentile(const List<uint64_t> &sorted, double p)
+{
+    const int idx = std::min<int>(sorted.size() - 1, static_cast<int>(sorted.size() * p));
+    return sorted.at(idx);
+}
+
+int main(int argc, char **argv)
+{
+    const int threads = argc > 1 ? atoi(argv[1]) : ThreadPool::idealThreadCount();
+    const int jobs = argc > 2 ? atoi(argv[2]) : 200000;
+    if (threads <= 0 || jobs <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [jobs]\n", argv[0]);
+        return 1;
+    }
+
+    for (int mode=ThreadPool::Shared; mode<=ThreadPool::WorkStealing; ++mode) {
+        List<uint64_t> waits(jobs, 0);
+        sDone = 0;
+        {
+            ThreadPool pool(threads, static_cast<ThreadPool::Mode>(mode));
+            const uint64_t start = now();
+            for (int i=0; i<jobs; ++i) {
+                shared_ptr<ThreadPool::Job> job(new BenchJob(i % 97 ? 200 : 20000, &waits[i]));
+                pool.start(job, i % 50 ? 0 : 1);
+            }
+            while (sDone < jobs)
+                usleep(1000);
+            const uint64_t elapsed = std::max<uint64_t>(1, now() - start);
+
+            std::sort(waits.begin(), waits.end());
+            printf("%-13s %d threads, %d jobs in %llums, %llu jobs/s, wait p50 %lluus p99 %lluus p99.9 %lluus max %lluus\n",
+                   mode == ThreadPool::Shared ? "shared:" : "workstealing:", threads, jobs,
+                   static_cast<unsigned long long>(elapsed / 1000),
+                   static_cast<unsigned long long>(jobs * 1000000ull / elapsed),
+                   static_cast<unsigned long long>(percentile(waits, 0.5)),
+                   static_cast<unsigned long long>(percentile(waits, 0.99)),
+                   static_cast<unsigned long long>(percentile(waits, 0.999)),
+                   static_cast<unsigned long long>(waits.last()));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <clang-c/Index.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ByteArray.h"
+#include "GccArguments.h"
+#include "Mutex.h"
+#include "MutexLocker.h"
+#include "RTags.h"
+#include "StopWatch.h"
+#include "Thread.h"
+
+/*
+  What checking whether a job was aborted costs the visitor, once per cursor
+  the way IndexerJob::indexVisitor does it. Compares taking the job's mutex
+  for the check with reading a volatile flag:
+
+  - in a loop of checks on a number of threads at once, each with its own
+    job like indexer threads
+  - in clang_visitChildren over a translation unit, if a compiler command
+    line is given
+
+  visitorbench [threads] [compiler command line]
+*/
+
+struct AbortFlag
+{
+    AbortFlag()
+        : aborted(0)
+    {}
+    Mutex mutex;
+    volatile int aborted;
+
+    bool lockedCheck()
+    {
+        MutexLocker lock(&mutex);
+        return aborted;
+    }
+    bool check() const { return aborted; }
+};
+
+enum { Checks = 50 * 1000 * 1000 };
+
+class CheckThread : public Thread
+{
+public:
+    CheckThread(bool locked)
+        : mLocked(locked)
+    {}
+protected:
+    virtual void run()
+    {
+        int count = 0;
+        for (int i=0; i<Checks; ++i) {
+            if (!(mLocked ? mFlag.lockedCheck() : mFlag.check()))
+                ++count;
+        }
+        mCount = count;
+    }
+private:
+    const bool mLocked;
+    AbortFlag mFlag;
+    volatile int mCount;
+};
+
+static int checkLoop(int threads, bool locked)
+{
+    List<CheckThread*> running;
+    StopWatch timer;
+    for (int i=0; i<threads; ++i) {
+        running.append(new CheckThread(locked));
+        running.last()->start();
+    }
+    for (int i=0; i<threads; ++i) {
+        running.at(i)->join();
+        delete running.at(i);
+    }
+    return timer.elapsed();
+}
+
+struct VisitData
+{
+    AbortFlag flag;
+    bool locked;
+    int cursors;
+};
+
+static CXChildVisitResult visitor(CXCursor, CXCursor, CXClientData userData)
+{
+    VisitData *data = static_cast<VisitData*>(userData);
+    if (data->locked ? data->flag.lockedCheck() : data->flag.check())
+        return CXChildVisit_Break;
+    ++data->cursors;
+    return CXChildVisit_Recurse;
+}
+
+static int visit(CXTranslationUnit unit, bool locked, int *cursors)
+{
+    VisitData data;
+    data.locked = locked;
+    data.cursors = 0;
+    StopWatch timer;
+    clang_visitChildren(clang_getTranslationUnitCursor(unit), visitor, &data);
+    *cursors = data.cursors;
+    return timer.elapsed();
+}
+
+int main(int argc, char **argv)
+{
+    RTags::findApplicationDirPath(*argv);
+    int threads = 1;
+    int first = 1;
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        threads = atoi(argv[1]);
+        ++first;
+    }
+
+    printf("%d threads doing %d checks each: mutex %dms, volatile %dms\n",
+           threads, Checks, checkLoop(threads, true), checkLoop(threads, false));
+
+    if (first >= argc)
+        return 0;
+
+    ByteArray ba;
+    for (int i=first; i<argc; ++i) {
+        if (i > first)
+            ba.append(' ');
+        ba.append(argv[i]);
+    }
+    GccArguments args;
+    if (!args.parse(ba, RTags::applicationDirPath()) || args.inputFiles().isEmpty()) {
+        fprintf(stderr, "Usage: %s [threads] [compiler command line]\n", argv[0]);
+        return 1;
+    }
+    const List<ByteArray> clangArgs = args.clangArgs();
+    const char **a = new const char*[clangArgs.size()];
+    for (int i=0; i<clangArgs.size(); ++i)
+        a[i] = clangArgs.at(i).constData();
+    CXIndex index = clang_createIndex(1, 1);
+    CXTranslationUnit unit = clang_parseTranslationUnit(index, args.inputFiles().first().constData(),
+                                                        a, clangArgs.size(), 0, 0,
+                                                        CXTranslationUnit_DetailedPreprocessingRecord);
+    delete[] a;
+    if (!unit) {
+        fprintf(stderr, "Failed to parse %s\n", args.inputFiles().first().constData());
+        clang_disposeIndex(index);
+        return 1;
+    }
+    int cursors;
+    visit(unit, false, &cursors); // warm up
+    const int locked = visit(unit, true, &cursors);
+    const int unlocked = visit(unit, false, &cursors);
+    printf("visiting %d cursors: mutex %dms, volatile %dms\n", cursors, locked, unlocked);
+    clang_disposeTranslationUnit(unit);
+    clang_disposeIndex(index);
+    return 0;
+}